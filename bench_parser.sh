@@ -0,0 +1,60 @@
+#!/bin/sh
+# Compares the parse time of the Bison parser and the hand-written one: bench_parser.sh [functions] [runs]
+# Both are built with $CPP (clang++ by default, as in the Makefile); make also takes MAKEFLAGS from the environment.
+
+FUNCS=${1:-2000}
+RUNS=${2:-5}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+SRC=$WORK/bench_parser.sy
+
+# A large source exercising declarations, nested statements and all operator levels
+{
+	echo "const int N = 16, T[2][4] = {{1, 2}, {3, 4, 5}};"
+	echo "int g[N][4] = {}, acc = 0;"
+	i=0
+	while [ $i -lt $FUNCS ]; do
+		cat <<EOF
+int f$i(int a, int b[], int c[][4]) {
+	int x = a * 3 + b[a % N] - c[1][2] / 7, y[4] = {1, 2, 3};
+	while (x > 0 && !(x == $i) || a <= -x) {
+		if (x % 2 != 0) x = x - 1; else if (x >= 100) { x = x / 2; continue; } else break;
+		y[x % 4] = (y[x % 4] + x * $i) % 65536;
+	}
+	return x + y[0] + T[1][2];
+}
+EOF
+		i=$((i + 1))
+	done
+	echo "int main() {"
+	i=0
+	while [ $i -lt $FUNCS ]; do
+		echo "	acc = acc + f$i($i, g[0], g);"
+		i=$((i + 1))
+	done
+	echo "	return acc;"
+	echo "}"
+} > $SRC
+
+# Both scan with the hand-written lexer, so only the parsers differ
+make CPP="${CPP:-clang++}" LEXER=hand BUILD_DIR=$WORK/bison $WORK/bison/compiler > /dev/null || exit 1
+make CPP="${CPP:-clang++}" LEXER=hand PARSER=hand BUILD_DIR=$WORK/hand $WORK/hand/compiler > /dev/null || exit 1
+
+# The best of RUNS parse times reported by the compiler, in microseconds
+best() {
+	n=0
+	min=
+	while [ $n -lt $RUNS ]; do
+		t=$($1 -koopa $SRC -o /dev/null 2>&1 | sed -n 's/^Parsed in \([0-9]*\) us$/\1/p')
+		if [ -z "$min" ] || [ "$t" -lt "$min" ]; then min=$t; fi
+		n=$((n + 1))
+	done
+	echo $min
+}
+
+BISON_US=$(best $WORK/bison/compiler)
+HAND_US=$(best $WORK/hand/compiler)
+echo "$(wc -c < $SRC) bytes, $FUNCS functions"
+echo "bison:        $BISON_US us"
+echo "hand-written: $HAND_US us"
+echo "speedup: $(awk "BEGIN { printf \"%.2f\", $BISON_US / $HAND_US }")x"
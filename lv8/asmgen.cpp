@@ -5,14 +5,24 @@
 #include <sstream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <set>
 #include <map>
-#include <queue>
+#include <algorithm>
+#include <functional>
 #include <cassert>
 
 #include "ast.hpp"
 
 extern void StmtToIR(std::ostream &out, StmtInfo *mir) ;
+extern std::string cacheDir;
+extern std::string CacheKey(const std::string &source, const std::string &mode, const std::vector<std::string> &flags);
+extern bool CacheLoad(const std::string &dir, const std::string &key, const std::string &ext, std::string &data);
+extern void CacheStore(const std::string &dir, const std::string &key, const std::string &ext, const std::string &data);
+extern std::string ProgramToBinary(ProgramInfo *mir);
+extern void ParallelFor(std::size_t n, const std::function<void(std::size_t)> &work);
+extern std::string ScheduleASM(const std::string &text);
+extern int BranchPenalty();
 
 static constexpr int I12_MIN = -2048, I12_MAX = 2047;
 static constexpr std::size_t PTR_SIZE = 4;
@@ -32,54 +42,138 @@ const std::set<std::string> AVAILABLE = {
 	"t0", "t1", "t2",
 	"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"
 };
+// Registers that may hold a value across statements in a leaf function.
+// t4~t6 are never handed out, so that they stay free for temporaries.
+const std::vector<std::string> HOME_REGS = {
+	"a7", "a6", "a5", "a4", "a3", "a2", "a1", "a0",
+	"t0", "t1", "t2", "t3"
+};
+// Those of a function that calls: never an argument register
+const std::vector<std::string> CALLER_HOME_REGS = { "t0", "t1", "t2", "t3" };
+// Kept across calls, for a value live across one or when the others run out;
+// the function saves those it uses in its prologue, or wherever it saves ra
+const std::vector<std::string> CALLEE_HOME_REGS = {
+	"s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11"
+};
 class RegisterManager {
 public:
-	std::priority_queue<std::string> q;		// t6~t0, a7~a0
+	std::set<std::string> q;		// t registers first, then from the top: a7~a0
+	std::set<std::string> pinned;	// holding a value, never used as a temporary
+	std::map<std::string, std::size_t> freedAt;	// when each was last freed
+	std::size_t clock = 0;
 	RegisterManager() {
-		for(const auto &name: AVAILABLE) q.emplace(name);
+		clear();
 	}
+	// The t register freed longest ago, so that the scheduler is not held back
+	// by a register reused right away
 	std::string allocate() {
-		auto ret = q.top();
-		q.pop();
-		return ret;
+		assert(!q.empty());
+		auto ret = q.end();
+		for(auto it = q.rbegin(); it != q.rend() && (*it)[0] == 't'; ++ it)
+			if(ret == q.end() || freedAt[*it] < freedAt[*ret]) ret = std::prev(it.base());
+		if(ret == q.end()) ret = std::prev(q.end());
+		auto reg = *ret;
+		q.erase(ret);
+		return reg;
 	}
 	void free(const std::string &str) {
-		if(AVAILABLE.find(str) != AVAILABLE.end())
-			q.emplace(str);
+		if(AVAILABLE.find(str) != AVAILABLE.end() && pinned.find(str) == pinned.end() && q.emplace(str).second)
+			freedAt[str] = ++ clock;
 	} 
+	void pin(const std::string &str) {
+		pinned.emplace(str);
+		q.erase(str);
+	}
+	bool isTemp(const std::string &str) const {
+		return AVAILABLE.find(str) != AVAILABLE.end() && pinned.find(str) == pinned.end();
+	}
 	void clear() {
-		for(const auto &name: AVAILABLE) q.emplace(name);
+		q = AVAILABLE;
+		pinned.clear();
+		freedAt.clear();
+		clock = 0;
 	}
-} regMgr;
+};
+// Functions are emitted in parallel: the state of the current one is per thread,
+// while the globals are only read once ProgramToASM has filled them in.
+static thread_local RegisterManager regMgr;
 
 static std::set<std::string> globals;
+static std::set<std::string> writtenGlobals;	// stored to, or address taken
+static constexpr std::size_t SMALL_DATA = 8;	// like -G 8: .sdata/.sbss/.srodata candidates
 class StackManager {
 public:
 	std::size_t size;
 	std::map<std::string, std::size_t> stackAddr;
+	bool raWrapped;							// ra is saved only on the paths that call
+	std::set<std::string> raSave, raRestore;	// blocks saving ra on entry / restoring it at 'ret'
+	std::set<std::string> raSavedIn;		// blocks running with ra saved, on every path to them
+	std::set<std::string> calleeSaved;		// of CALLEE_HOME_REGS, holding values; saved along with ra
 	std::size_t getAddr(const std::string &ident) const {
 		auto it = stackAddr.find(ident);
 		assert(it != stackAddr.end());
 		return it -> second;
 	}
+	bool hasAddr(const std::string &ident) const {
+		return stackAddr.find(ident) != stackAddr.end();
+	}
 	void clear() {
 		size = 0;
 		stackAddr.clear();
+		raWrapped = false;
+		raSave.clear();
+		raRestore.clear();
+		raSavedIn.clear();
+		calleeSaved.clear();
 	}
-} stackMgr;
+};
+static thread_local StackManager stackMgr;
+
+static thread_local std::string crtFuncName, crtBlockName;
+static thread_local std::string nextBlockName;		// laid out after the current one, empty for the last
+static thread_local bool farBranch;				// the current block's branch may not reach, see LayoutToASM
+static thread_local std::map<std::string, std::size_t> crtParams;
+static thread_local FuncInfo *crtFunc;
+
+static thread_local std::map<std::string, std::string> varReg;
+static thread_local std::map<std::string, TypeInfo*> crtAllocs;
 
-static std::string crtFuncName;
-static std::map<std::string, std::size_t> crtParams;
-static FuncInfo *crtFunc;
+// A getelemptr/getptr chain with constant indices off an alloc or a global
+// emits no code: its offset is folded into every access through it.
+struct FoldedAddr {
+	std::string root;
+	std::size_t offset;
+};
+static thread_local std::map<std::string, FoldedAddr> foldedAddr;
+static thread_local std::size_t zeroLoops;
+static constexpr std::size_t ZERO_LOOP = 16;	// zero runs of this many words are cleared by a loop
+
+// With Zicond (-mzicond), the mask "0 - c" of a condition c, which is 0 or 1,
+// emits no code if it is only 'and'ed with: each 'and' is a czero.eqz on c.
+// If-conversion (see ipo.cpp) selects values this way.
+bool zicond = false;
+static thread_local std::map<std::string, std::string> condMask;	// mask -> condition
 
-static std::map<std::string, std::string> varReg;
+// With RVV (-mrvv), the body of a counted loop over i32 arrays handles vl
+// elements per trip instead of one, see FindVectorLoops.
+bool rvv = false;
+static const std::string VECTOR_LMUL = "m4";
+static const std::vector<std::string> VECTOR_GROUPS = { "v4", "v8", "v12", "v16", "v20", "v24" };
+static const std::string SPLAT_GROUP = "v28";		// for an invariant stored to every element
+struct VectorLoop {
+	std::string index;		// of the header's 'index < bound', counted up by one
+	std::string bound;		// a scalar the body doesn't store, or empty for boundConst
+	int boundConst;
+	StmtInfo *step;			// the 'add' of one to the index
+	std::map<std::string, std::string> vreg;	// values with an element per iteration
+};
+static thread_local std::map<const BlockInfo*, VectorLoop> vectorLoops;	// by body
 
 static bool isImm12(int val) {
 	return I12_MIN <= val && val <= I12_MAX;
 }
 
 static std::string GlobalName(const std::string &str) {
-	std::cerr << "GN " << str << '\n';
 	assert(str[0] == '@');
 	return str.substr(1);
 }
@@ -89,6 +183,11 @@ static bool isGlobal(const std::string &koopaIdent) {
 			globals.find(GlobalName(koopaIdent)) != globals.end();
 }
 
+static std::string GlobalRef(const std::string &koopaIdent, std::size_t offset) {
+	if(offset == 0) return GlobalName(koopaIdent);
+	return GlobalName(koopaIdent) + "+" + std::to_string(offset);
+}
+
 std::string BlockId(const std::string &str) {
 	assert(str.substr(0,6) == "%block");
 	return crtFuncName + "_b" + str.substr(6);
@@ -105,6 +204,89 @@ std::size_t SizeOfType(const TypeInfo *type) {
 	__builtin_unreachable();
 }
 
+/*
+	Frame lowering. Every access to the stack frame goes through these, so
+	that offsets out of the range of a 12-bit immediate are materialized
+	with 'lui' + 'add' and folded into the low part of the load/store.
+*/
+static void SplitOffset(int offset, int &hi, int &lo) {
+	hi = (offset + 0x800) >> 12;
+	lo = offset - (hi << 12);
+}
+
+static void LoadFrame(std::ostream &out, const std::string &reg, std::size_t offset) {
+	if(isImm12(int(offset))) {
+		out << "  lw " << reg << ", " << offset << "(sp)\n";
+		return ;
+	}
+	int hi, lo;
+	SplitOffset(int(offset), hi, lo);
+	out << "  lui " << reg << ", " << hi << '\n';
+	out << "  add " << reg << ", " << reg << ", sp\n";
+	out << "  lw " << reg << ", " << lo << "(" << reg << ")\n";
+}
+
+static void StoreFrame(std::ostream &out, const std::string &reg, std::size_t offset) {
+	if(isImm12(int(offset))) {
+		out << "  sw " << reg << ", " << offset << "(sp)\n";
+		return ;
+	}
+	int hi, lo;
+	SplitOffset(int(offset), hi, lo);
+	auto tmp = regMgr.allocate();
+	out << "  lui " << tmp << ", " << hi << '\n';
+	out << "  add " << tmp << ", " << tmp << ", sp\n";
+	out << "  sw " << reg << ", " << lo << "(" << tmp << ")\n";
+	regMgr.free(tmp);
+}
+
+static void FrameAddr(std::ostream &out, const std::string &reg, std::size_t offset) {
+	if(isImm12(int(offset))) {
+		out << "  addi " << reg << ", sp, " << offset << '\n';
+		return ;
+	}
+	out << "  li " << reg << ", " << offset << '\n';
+	out << "  add " << reg << ", sp, " << reg << '\n';
+}
+
+// Only caller-saved t0 is touched, so the arguments in a0~a7 survive the prologue
+static void AdjustSp(std::ostream &out, int delta) {
+	if(isImm12(delta)) {
+		out << "  addi sp, sp, " << delta << '\n';
+		return ;
+	}
+	out << "  li t0, " << delta << '\n';
+	out << "  add sp, sp, t0\n";
+}
+
+std::string SymbolToReg(std::ostream &out, const std::string &name, std::string target = "") {
+	std::string crt = target;
+	auto it = varReg.find(name);
+	if(it != varReg.end()) {
+		if(crt.empty() || crt == it->second) return it->second;
+		out << "  mv " << crt << ", " << it->second << '\n';
+		return crt;
+	}
+	if(crt.empty()) crt = regMgr.allocate();
+	auto param = crtParams.find(name);
+	auto fold = foldedAddr.find(name);
+	if(param != crtParams.end()) {
+		std::size_t id = param->second;
+		if(id < 8u)
+			out << "  mv " << crt << ", " << "a" << id << '\n';
+		else
+			LoadFrame(out, crt, stackMgr.size + (id - 8u) * 4u);
+	}
+	else if(fold != foldedAddr.end()) {
+		if(isGlobal(fold->second.root)) out << "  la " << crt << ", " << GlobalRef(fold->second.root, fold->second.offset) << '\n';
+		else FrameAddr(out, crt, stackMgr.getAddr(fold->second.root) + fold->second.offset);
+	}
+	else if(name[0] == '%') LoadFrame(out, crt, stackMgr.getAddr(name));
+	else if(isGlobal(name)) out << "  la " << crt << ", " << GlobalName(name) << '\n';
+	else FrameAddr(out, crt, stackMgr.getAddr(name));
+	return crt;
+}
+
 std::string ValueToReg(std::ostream &out, ValueInfo *mir, std::string target = "") {
 	std::string crt = target;
 	switch(mir->tag) {
@@ -115,30 +297,7 @@ std::string ValueToReg(std::ostream &out, ValueInfo *mir, std::string target = "
 				out << "  li " << crt << ", " << mir->i32 << '\n';
 				return crt;
 			}
-		case VT_SYMBOL: {
-			auto name = *mir->symbol;
-			auto it = varReg.find(name);
-			if(it != varReg.end()) return it->second;
-			else {
-				if(crt.empty()) crt = regMgr.allocate();
-				auto it = crtParams.find(name);
-				if(it != crtParams.end()) {
-					std::size_t id = it->second;
-					if(id < 8u)
-						out << "  mv " << crt << ", " << "a" << id << '\n';
-					else {
-						// TODO: support long address
-						out << "  lw " << crt << ", " << stackMgr.size + (id - 8u) * 4u << "(sp)\n";
-					}
-				}
-				else if(name[0] == '%') out << "  lw " << crt << ", " << stackMgr.getAddr(name) << "(sp)\n";
-				else {
-					out << "  li " << crt << ", " << stackMgr.getAddr(name) << '\n';
-					// TOFIX: this should be the real address
-				}
-				return crt;
-			}
-		}
+		case VT_SYMBOL: return SymbolToReg(out, *mir->symbol, target);
 		case VT_UNDEF: {
 			if(crt.empty()) return "zero";
 			else {
@@ -150,10 +309,176 @@ std::string ValueToReg(std::ostream &out, ValueInfo *mir, std::string target = "
 	__builtin_unreachable();
 }
 
-std::string SymdefExprToASM(std::ostream &out, ExprInfo *mir) {
+/*
+	Accesses through `ptr`, which is an alloc (not kept in a register), a
+	global, a folded address or a pointer value.
+*/
+static void LoadFrom(std::ostream &out, const std::string &reg, const std::string &ptr) {
+	FoldedAddr addr{ptr, 0};
+	if(auto fold = foldedAddr.find(ptr); fold != foldedAddr.end()) addr = fold->second;
+	else if(!crtAllocs.count(ptr) && !isGlobal(ptr)) {
+		auto base = SymbolToReg(out, ptr);
+		out << "  lw " << reg << ", 0(" << base << ")\n";
+		regMgr.free(base);
+		return ;
+	}
+	if(isGlobal(addr.root)) {
+		out << "  lui " << reg << ", %hi(" << GlobalRef(addr.root, addr.offset) << ")\n";
+		out << "  lw " << reg << ", %lo(" << GlobalRef(addr.root, addr.offset) << ")(" << reg << ")\n";
+	}
+	else LoadFrame(out, reg, stackMgr.getAddr(addr.root) + addr.offset);
+}
+
+static void StoreTo(std::ostream &out, const std::string &reg, const std::string &ptr) {
+	FoldedAddr addr{ptr, 0};
+	if(auto fold = foldedAddr.find(ptr); fold != foldedAddr.end()) addr = fold->second;
+	else if(!crtAllocs.count(ptr) && !isGlobal(ptr)) {
+		auto base = SymbolToReg(out, ptr);
+		out << "  sw " << reg << ", 0(" << base << ")\n";
+		regMgr.free(base);
+		return ;
+	}
+	if(isGlobal(addr.root)) {
+		auto tmp = regMgr.allocate();
+		out << "  lui " << tmp << ", %hi(" << GlobalRef(addr.root, addr.offset) << ")\n";
+		out << "  sw " << reg << ", %lo(" << GlobalRef(addr.root, addr.offset) << ")(" << tmp << ")\n";
+		regMgr.free(tmp);
+	}
+	else StoreFrame(out, reg, stackMgr.getAddr(addr.root) + addr.offset);
+}
+
+static void AddImm(std::ostream &out, const std::string &dst, const std::string &src, int imm) {
+	if(imm == 0) {
+		if(dst != src) out << "  mv " << dst << ", " << src << '\n';
+	}
+	else if(isImm12(imm)) out << "  addi " << dst << ", " << src << ", " << imm << '\n';
+	else {
+		auto tmp = regMgr.allocate();
+		out << "  li " << tmp << ", " << imm << '\n';
+		out << "  add " << dst << ", " << src << ", " << tmp << '\n';
+		regMgr.free(tmp);
+	}
+}
+
+// dst = idx * stride, by shifts for strides with at most two bits set
+static void ScaleIndex(std::ostream &out, const std::string &dst, const std::string &idx, std::size_t stride) {
+	int lo = __builtin_ctzll(stride), hi = 63 - __builtin_clzll(stride);
+	if(lo == hi) {
+		if(lo == 0) out << "  mv " << dst << ", " << idx << '\n';
+		else out << "  slli " << dst << ", " << idx << ", " << lo << '\n';
+	}
+	else if(__builtin_popcountll(stride) == 2) {
+		// stride = (2^(hi-lo) + 1) << lo
+		out << "  slli " << dst << ", " << idx << ", " << hi - lo << '\n';
+		out << "  add " << dst << ", " << dst << ", " << idx << '\n';
+		if(lo != 0) out << "  slli " << dst << ", " << dst << ", " << lo << '\n';
+	}
+	else {
+		out << "  li " << dst << ", " << stride << '\n';
+		out << "  mul " << dst << ", " << idx << ", " << dst << '\n';
+	}
+}
+
+static void FlattenInitializer(const InitializerInfo *init, const TypeInfo *type, std::vector<int> &words) {
+	switch(init->tag) {
+		case IT_UNDEF:
+		case IT_ZERO:
+			words.insert(words.end(), type->size() / 4u, 0);
+			break;
+		case IT_NUM:
+			words.emplace_back(init->num);
+			break;
+		case IT_AGGR:
+			for(auto sub: init->aggr) FlattenInitializer(sub, type->array.base, words);
+			break;
+		case IT_RUNS: {
+			std::size_t start = words.size();
+			for(auto &[pos, run]: init->runs) {
+				words.resize(start + pos, 0);
+				words.insert(words.end(), run.begin(), run.end());
+			}
+			words.resize(start + type->size() / 4u, 0);
+			break;
+		}
+	}
+}
+
+// The non-zero words of an initializer
+static std::vector<InitializerInfo::Run> InitializerRuns(const InitializerInfo *init, const TypeInfo *type) {
+	if(init->tag == IT_RUNS) return init->runs;
+	std::vector<int> words;
+	std::vector<InitializerInfo::Run> runs;
+	FlattenInitializer(init, type, words);
+	for(std::size_t i = 0; i < words.size(); ++ i) {
+		if(words[i] == 0) continue;
+		if(runs.empty() || runs.back().first + runs.back().second.size() != i)
+			runs.emplace_back(i, std::vector<int>());
+		runs.back().second.emplace_back(words[i]);
+	}
+	return runs;
+}
+
+// Clears words [from, to) of a local array; long runs by a loop, 4 words per iteration
+static void ClearFrame(std::ostream &out, std::size_t base, std::size_t from, std::size_t to) {
+	if(to - from >= ZERO_LOOP) {
+		std::size_t n = (to - from) / 4u * 4u;
+		auto ptr = regMgr.allocate(), end = regMgr.allocate();
+		auto label = crtFuncName + "_zero" + std::to_string(zeroLoops ++);
+		FrameAddr(out, ptr, base + from * 4u);
+		AddImm(out, end, ptr, int(n * 4u));
+		out << label << ":\n";
+		for(int k = 0; k < 4; ++ k) out << "  sw zero, " << k * 4 << "(" << ptr << ")\n";
+		out << "  addi " << ptr << ", " << ptr << ", 16\n";
+		out << "  bne " << ptr << ", " << end << ", " << label << '\n';
+		regMgr.free(ptr);
+		regMgr.free(end);
+		from += n;
+	}
+	for(; from < to; ++ from) StoreFrame(out, "zero", base + from * 4u);
+}
+
+// Stores an initializer into a local array, run by run
+static void StoreInitializer(std::ostream &out, InitializerInfo *init, const std::string &alloc) {
+	auto type = crtAllocs.at(alloc);
+	std::size_t base = stackMgr.getAddr(alloc), pos = 0;
+	for(auto &[from, run]: InitializerRuns(init, type)) {
+		ClearFrame(out, base, pos, from);
+		auto tmp = regMgr.allocate();
+		for(std::size_t i = 0; i < run.size(); ++ i) {
+			if(i == 0 || run[i] != run[i - 1]) out << "  li " << tmp << ", " << run[i] << '\n';
+			StoreFrame(out, tmp, base + (from + i) * 4u);
+		}
+		regMgr.free(tmp);
+		pos = from + run.size();
+	}
+	ClearFrame(out, base, pos, type->size() / 4u);
+}
+
+// Computes the expression into `target` (a temporary register if empty)
+std::string SymdefExprToASM(std::ostream &out, ExprInfo *mir, std::string target = "") {
+	auto dest = [&](const std::string &reuse = "") {
+		if(!target.empty()) return target;
+		if(!reuse.empty() && regMgr.isTemp(reuse)) return reuse;
+		return regMgr.allocate();
+	};
+	auto release = [&](const std::string &reg) {
+		if(reg != target) regMgr.free(reg);
+	};
 	std::string buf;
 	bool opCompare = (mir->op == OP_EQ || mir->op == OP_NEQ);
-	switch(mir->op) {
+	ValueInfo *masked = nullptr;
+	std::string cond;
+	if(mir->op == OP_LAND)
+		for(auto [mask, val]: {std::pair(mir->left, mir->right), std::pair(mir->right, mir->left)})
+			if(mask->tag == VT_SYMBOL && condMask.count(*mask->symbol)) masked = val, cond = condMask.at(*mask->symbol);
+	if(masked != nullptr) {
+		auto val = ValueToReg(out, masked), c = SymbolToReg(out, cond);
+		buf = dest(val);
+		out << "  czero.eqz " << buf << ", " << val << ", " << c << '\n';
+		if(buf != val) release(val);
+		release(c);
+	}
+	else switch(mir->op) {
 		case OP_POS:
 		case OP_NEG:
 		case OP_LNOT: break;
@@ -162,35 +487,31 @@ std::string SymdefExprToASM(std::ostream &out, ExprInfo *mir) {
 		case OP_LOR:
 		case OP_EQ:
 		case OP_NEQ:{
-			if(mir->right->tag == VT_INT && isImm12(mir->right->i32)) { 
-				auto tmp = ValueToReg(out, mir->left);
-				if(opCompare && mir->right->i32 == 0) buf = tmp;
+			ValueInfo *reg = nullptr;
+			int imm = 0;
+			if(mir->right->tag == VT_INT && isImm12(mir->right->i32)) reg = mir->left, imm = mir->right->i32;
+			else if(mir->left->tag == VT_INT && isImm12(mir->left->i32)) reg = mir->right, imm = mir->left->i32;
+			if(reg != nullptr) { 
+				auto tmp = ValueToReg(out, reg);
+				if(opCompare && imm == 0) buf = tmp;
 				else {
-					buf = regMgr.allocate();
-					out << "  " << OperatorASM(mir->op, true) << ' ' << buf << ", " << tmp << ", " << mir->right->i32 << '\n'; 
-					regMgr.free(tmp);
-				}
-			}
-			else if(mir->left->tag == VT_INT && isImm12(mir->left->i32)) {
-				auto tmp = ValueToReg(out, mir->right);
-				if(opCompare && mir->left->i32 == 0) buf = tmp;
-				else {
-					buf = regMgr.allocate();
-					out << "  " << OperatorASM(mir->op, true) << ' ' << buf << ", " << tmp << ", " << mir->left->i32 << '\n'; 
-					regMgr.free(tmp);
+					buf = dest(tmp);
+					out << "  " << OperatorASM(mir->op, true) << ' ' << buf << ", " << tmp << ", " << imm << '\n'; 
+					if(buf != tmp) release(tmp);
 				}
 			}
 			else {
 				auto left = ValueToReg(out, mir->left), right = ValueToReg(out, mir->right);
-				buf = left;
+				buf = dest(left);
 				out << "  " << OperatorASM(mir->op, false) << ' ' << buf << ", " << left << ", " << right << '\n';
-				regMgr.free(right);
+				if(buf != left) release(left);
+				if(buf != right) release(right);
 			}
 			std::string oldBuf = buf;
-			if(buf == "zero") buf = regMgr.allocate();
+			if(opCompare && buf != target && (!target.empty() || !regMgr.isTemp(buf))) buf = dest();
 			if(mir->op == OP_EQ) out << "  " << "seqz " << buf << ", " << oldBuf << '\n';
 			else if(mir->op == OP_NEQ) out << "  " << "snez " << buf << ", " << oldBuf << '\n';
-			if(buf != oldBuf) regMgr.free(oldBuf);
+			if(buf != oldBuf) release(oldBuf);
 			break;
 		}
 		case OP_SUB:
@@ -200,56 +521,95 @@ std::string SymdefExprToASM(std::ostream &out, ExprInfo *mir) {
 		case OP_LT:
 		case OP_GT: {
 			auto left = ValueToReg(out, mir->left), right = ValueToReg(out, mir->right);
-			buf = regMgr.allocate();
+			buf = dest();
 			out << "  " << OperatorASM(mir->op, false) << ' ' << buf << ", " << left << ", " << right << '\n';
-			regMgr.free(left);
-			regMgr.free(right);
+			release(left);
+			release(right);
 			break;
 		}
 		case OP_LE:
 		case OP_GE: {
 			auto left = ValueToReg(out, mir->left), right = ValueToReg(out, mir->right);
-			buf = regMgr.allocate();
+			buf = dest();
 			out << "  " << (mir->op == OP_LE ? "sgt" : "slt") << ' ' << buf << ", " << left << ", " << right << '\n';
 			out << "  " << "seqz " << buf << ", " << buf << '\n';
-			regMgr.free(left);
-			regMgr.free(right);
+			release(left);
+			release(right);
 			break;
 		}
 	}
+	if(!target.empty() && buf != target) {
+		out << "  mv " << target << ", " << buf << '\n';
+		release(buf);
+		buf = target;
+	}
 	return buf;
 }
 
 void StmtToASM(std::ostream &out, StmtInfo *mir) {
 	switch(mir->tag) {
 		case ST_SYMDEF: {
-			std::size_t addr = stackMgr.getAddr(* mir->symdef.name);
+			auto &name = * mir->symdef.name;
+			auto home = varReg.find(name);
+			bool inReg = home != varReg.end();
 			switch(mir->symdef.tag){
 				case SDT_EXPR: {
+					if(condMask.count(name)) break;		// no code, see condMask
+					if(inReg) {
+						SymdefExprToASM(out, mir->symdef.expr, home->second);
+						break;
+					}
 					auto crt = SymdefExprToASM(out, mir->symdef.expr);
 					// varReg[*mir->symdef.name] = crt;
-					out << "  sw " << crt << ", " << addr << "(sp)\n";
+					StoreFrame(out, crt, stackMgr.getAddr(name));
 					regMgr.free(crt);
 					break;
 				}
 				case SDT_LOAD: {
-					auto buf = regMgr.allocate();
-					auto name = * mir->symdef.load;
-					if(isGlobal(name)) {
-						out << "  la " << buf << ", " << GlobalName(name) <<'\n';
-						out << "  lw " << buf << ", " << "0(" << buf << ")\n";
-						out << "  sw " << buf << ", " << addr << "(sp)\n";
+					auto buf = inReg ? home->second : regMgr.allocate();
+					auto src = * mir->symdef.load;
+					auto srcHome = crtAllocs.count(src) ? varReg.find(src) : varReg.end();
+					if(srcHome != varReg.end()) {
+						if(!inReg) {
+							StoreFrame(out, srcHome->second, stackMgr.getAddr(name));
+							regMgr.free(buf);
+							break;
+						}
+						if(buf != srcHome->second) out << "  mv " << buf << ", " << srcHome->second << '\n';
+					}
+					else LoadFrom(out, buf, src);
+					if(!inReg) {
+						StoreFrame(out, buf, stackMgr.getAddr(name));
+						regMgr.free(buf);
 					}
+					break;
+				}
+				case SDT_GETELEMPTR:
+				case SDT_GETPTR: {
+					if(foldedAddr.count(name)) break;		// no code, see FoldedAddr
+					auto &ptr = mir->symdef.ptr;
+					std::size_t stride = SizeOfType(ptr.base);
+					auto buf = inReg ? home->second : regMgr.allocate();
+					auto base = SymbolToReg(out, *ptr.src);
+					if(ptr.index->tag == VT_INT) AddImm(out, buf, base, ptr.index->i32 * int(stride));
 					else {
-						auto addrSrc = stackMgr.getAddr(name);
-						out << "  lw " << buf << ", " << addrSrc << "(sp)\n";
-						out << "  sw " << buf << ", " << addr << "(sp)\n";
+						auto idx = ValueToReg(out, ptr.index);
+						auto scaled = inReg ? regMgr.allocate() : buf;
+						ScaleIndex(out, scaled, idx, stride);
+						out << "  add " << buf << ", " << base << ", " << scaled << '\n';
+						if(scaled != buf) regMgr.free(scaled);
+						regMgr.free(idx);
+					}
+					if(base != buf) regMgr.free(base);
+					if(!inReg) {
+						StoreFrame(out, buf, stackMgr.getAddr(name));
+						regMgr.free(buf);
 					}
-					regMgr.free(buf);
 					break;
 				}
 				case SDT_ALLOC:
-					out << "  #  " << "value of " << *mir->symdef.name << " is " << addr <<'\n';
+					if(inReg) out << "  #  " << "value of " << name << " is in " << home->second <<'\n';
+					else out << "  #  " << "value of " << name << " is " << stackMgr.getAddr(name) <<'\n';
 					break;
 				case SDT_FUNCALL: {
 					auto &params = *mir->symdef.func.para;
@@ -257,72 +617,169 @@ void StmtToASM(std::ostream &out, StmtInfo *mir) {
 						if(i < 8u) ValueToReg(out, params[i], "a" + std::to_string(i));
 						else {
 							auto buf = ValueToReg(out, params[i]);
-							out << "  sw " << buf << ", " << (i-8u)*4u << "(sp)\n";
+							StoreFrame(out, buf, (i-8u)*4u);
 							regMgr.free(buf);
 						}
 					}
 					out << "  call " << GlobalName(*mir->symdef.func.fun) << '\n';
-					out << "  sw " << "a0" << ", " << addr << "(sp)\n";
+					if(inReg) out << "  mv " << home->second << ", a0\n";
+					else if(!name.empty()) StoreFrame(out, "a0", stackMgr.getAddr(name));
 					break;
 				}
 			}
 			break;
 		}
 		case ST_STORE: {
-			assert(mir -> store.isValue);
 			auto name = * mir->store.addr;
-			std::string src = ValueToReg(out, mir->store.val);
-			if(isGlobal(name)) {
-				std::string dest = regMgr.allocate();
-				out << "  la " << dest << ", " << GlobalName(name) << "\n";
-				out << "  sw " << src << ", " << 0 << "(" << dest << ")\n";
-				regMgr.free(dest);
+			if(!mir->store.isValue) {
+				StoreInitializer(out, mir->store.init, name);
+				break;
 			}
-			else {
-				std::size_t addr = stackMgr.getAddr(name);
-				out << "  sw " << src << ", " << addr << "(sp)\n";
-				// TODO: support long address on every occurance of 'lw' and 'sw'
+			auto home = crtAllocs.count(name) ? varReg.find(name) : varReg.end();
+			if(home != varReg.end()) {
+				ValueToReg(out, mir->store.val, home->second);
+				break;
 			}
+			std::string src = ValueToReg(out, mir->store.val);
+			StoreTo(out, src, name);
 			regMgr.free(src);
 			break;
 		}
 		case ST_RETURN: {
-			if(mir->ret.val != nullptr){
-				if(mir->ret.val->tag == VT_SYMBOL) {
-					auto val = ValueToReg(out, mir->ret.val);
-					out << "  " << "mv a0, " << val << '\n';
-					regMgr.free(val);
-				}
-				else {
-					out << "  " << "li a0, " << mir->ret.val->i32 << '\n';
-				}
+			if(mir->ret.val != nullptr) ValueToReg(out, mir->ret.val, "a0");
+			if(stackMgr.raRestore.count(crtBlockName)) {
+				LoadFrame(out, "ra", stackMgr.getAddr("_ra"));
+				for(auto &reg: stackMgr.calleeSaved) LoadFrame(out, reg, stackMgr.getAddr("_" + reg));
 			}
-			out << "  " << "j " << crtFuncName << "_epilogue\n";
+			if(stackMgr.size == 0) out << "  " << "ret\n";
+			else if(!nextBlockName.empty()) out << "  " << "j " << crtFuncName << "_epilogue\n";
 			// 'ret' should be after the epilogue, so output it in FuncToASM, instead of here
 			break;
 		}
 		case ST_BR: {
 			auto cond = ValueToReg(out, mir->jump.cond);
-			out << "  " << "bnez " << cond << ", " 
-						<< BlockId(*mir->jump.blkThen) << "\n";
-			out << "  " << "j " << BlockId(*mir->jump.blkElse) << '\n';
+			if(farBranch) {		// over a 'j' to the target, which reaches ±1 MiB
+				auto skip = BlockId(crtBlockName) + "_far";
+				bool thenNext = *mir->jump.blkThen == nextBlockName;
+				out << "  " << (thenNext ? "bnez " : "beqz ") << cond << ", " << skip << '\n';
+				out << "  " << "j " << BlockId(thenNext ? *mir->jump.blkElse : *mir->jump.blkThen) << '\n';
+				out << skip << ":\n";
+				if(!thenNext && *mir->jump.blkElse != nextBlockName)
+					out << "  " << "j " << BlockId(*mir->jump.blkElse) << '\n';
+			}
+			else if(*mir->jump.blkThen == nextBlockName)		// falls through
+				out << "  " << "beqz " << cond << ", " << BlockId(*mir->jump.blkElse) << '\n';
+			else {
+				out << "  " << "bnez " << cond << ", " 
+							<< BlockId(*mir->jump.blkThen) << "\n";
+				if(*mir->jump.blkElse != nextBlockName)
+					out << "  " << "j " << BlockId(*mir->jump.blkElse) << '\n';
+			}
 			regMgr.free(cond);
 			break;
 		}
 		case ST_JUMP: {
-			out << "  " << "j " << BlockId(*mir->jump.blkThen) << '\n';
+			if(*mir->jump.blkThen != nextBlockName)
+				out << "  " << "j " << BlockId(*mir->jump.blkThen) << '\n';
 			break;
 		}
 	}
 }
 
+// A scalar variable in its home register, or loaded into `reg`
+static std::string ScalarToReg(std::ostream &out, const std::string &reg, const std::string &src) {
+	auto home = crtAllocs.count(src) ? varReg.find(src) : varReg.end();
+	if(home != varReg.end()) return home->second;
+	LoadFrom(out, reg, src);
+	return reg;
+}
+
+// Sets vl to the elements left, min(bound - index, VLMAX), into `reg`
+static void SetVectorLength(std::ostream &out, const VectorLoop &loop, const std::string &reg, const std::string &index) {
+	auto bound = reg;
+	if(loop.bound.empty()) out << "  li " << reg << ", " << loop.boundConst << '\n';
+	else bound = ScalarToReg(out, reg, loop.bound);
+	out << "  sub " << reg << ", " << bound << ", " << index << '\n';
+	out << "  vsetvli " << reg << ", " << reg << ", e32, " << VECTOR_LMUL << ", ta, ma\n";
+}
+
+// A statement of a vectorized body; false if it is scalar
+static bool VectorStmtToASM(std::ostream &out, StmtInfo *mir, const VectorLoop &loop) {
+	auto group = [&](const ValueInfo *val) {
+		auto it = val->tag == VT_SYMBOL ? loop.vreg.find(*val->symbol) : loop.vreg.end();
+		return it == loop.vreg.end() ? std::string() : it->second;
+	};
+	if(mir->tag == ST_STORE) {
+		auto &addr = *mir->store.addr;
+		if(addr.front() == '@') return false;
+		auto src = group(mir->store.val);
+		if(src.empty()) {
+			auto val = ValueToReg(out, mir->store.val);
+			out << "  vmv.v.x " << SPLAT_GROUP << ", " << val << '\n';
+			regMgr.free(val);
+			src = SPLAT_GROUP;
+		}
+		auto ptr = SymbolToReg(out, addr);
+		out << "  vse32.v " << src << ", (" << ptr << ")\n";
+		regMgr.free(ptr);
+		return true;
+	}
+	if(mir->tag != ST_SYMDEF) return false;
+	auto &name = *mir->symdef.name;
+	if(mir == loop.step) {		// the index goes up by vl, which is found again
+		auto &expr = *mir->symdef.expr;
+		auto index = ValueToReg(out, expr.left->tag == VT_SYMBOL ? expr.left : expr.right);
+		auto vl = regMgr.allocate();
+		SetVectorLength(out, loop, vl, index);
+		auto home = varReg.find(name);
+		auto buf = home != varReg.end() ? home->second : vl;
+		out << "  add " << buf << ", " << index << ", " << vl << '\n';
+		if(home == varReg.end()) StoreFrame(out, buf, stackMgr.getAddr(name));
+		regMgr.free(vl);
+		regMgr.free(index);
+		return true;
+	}
+	auto dst = loop.vreg.find(name);
+	if(dst == loop.vreg.end()) return false;
+	if(mir->symdef.tag == SDT_LOAD) {
+		auto ptr = SymbolToReg(out, *mir->symdef.load);
+		out << "  vle32.v " << dst->second << ", (" << ptr << ")\n";
+		regMgr.free(ptr);
+		return true;
+	}
+	auto &expr = *mir->symdef.expr;
+	std::string op = expr.op == OP_ADD ? "vadd" : expr.op == OP_SUB ? "vsub" : "vmul";
+	auto left = group(expr.left), right = group(expr.right);
+	if(!left.empty() && !right.empty()) {
+		out << "  " << op << ".vv " << dst->second << ", " << left << ", " << right << '\n';
+		return true;
+	}
+	auto scalar = ValueToReg(out, left.empty() ? expr.left : expr.right);
+	if(left.empty() && expr.op == OP_SUB) op = "vrsub";
+	out << "  " << op << ".vx " << dst->second << ", " << (left.empty() ? right : left) << ", " << scalar << '\n';
+	regMgr.free(scalar);
+	return true;
+}
+
 void BlockToASM(std::ostream &out, BlockInfo *mir) {
+	crtBlockName = mir->name;
 	out << BlockId(mir->name) << ":\n";
+	if(stackMgr.raSave.count(mir->name)) {
+		StoreFrame(out, "ra", stackMgr.getAddr("_ra"));
+		for(auto &reg: stackMgr.calleeSaved) StoreFrame(out, reg, stackMgr.getAddr("_" + reg));
+	}
+	auto vector = vectorLoops.find(mir);
+	if(vector != vectorLoops.end()) {
+		out << "  # vectorized: " << VECTOR_LMUL << " groups of e32\n";
+		auto vl = regMgr.allocate(), buf = regMgr.allocate();
+		SetVectorLength(out, vector->second, vl, ScalarToReg(out, buf, vector->second.index));
+		regMgr.free(vl);
+		regMgr.free(buf);
+	}
 	for(auto stmt: mir->stmt) {
-		StmtToIR(std::cerr, stmt);
 		out << "  #";
 		StmtToIR(out, stmt);
-		StmtToASM(out, stmt);
+		if(vector == vectorLoops.end() || !VectorStmtToASM(out, stmt, vector->second)) StmtToASM(out, stmt);
 		out << '\n';
 	}
 }
@@ -338,102 +795,885 @@ void InitializerToASM(std::ostream &out, InitializerInfo *mir, TypeInfo *type) {
 			out << "  .word " << mir->num << '\n';
 			break;
 		case IT_AGGR:
+			for(auto sub: mir->aggr) InitializerToASM(out, sub, type->array.base);
 			break;
+		case IT_RUNS: {
+			// .zero for the gaps, and up to 8 values per .word
+			std::size_t pos = 0;
+			for(auto &[from, run]: mir->runs) {
+				if(from > pos) out << "  .zero " << (from - pos) * 4u << '\n';
+				for(std::size_t i = 0; i < run.size(); ++ i)
+					out << (i % 8u == 0 ? "  .word " : ", ") << run[i] << (i % 8u == 7u || i + 1 == run.size() ? "\n" : "");
+				pos = from + run.size();
+			}
+			if(type->size() / 4u > pos) out << "  .zero " << (type->size() / 4u - pos) * 4u << '\n';
+			break;
+		}
+	}
+}
+
+static std::vector<std::string> Successors(const BlockInfo *block) {
+	if(block->stmt.empty()) return {};
+	auto stmt = block->stmt.back();
+	if(stmt->tag == ST_JUMP) return { *stmt->jump.blkThen };
+	if(stmt->tag == ST_BR) return { *stmt->jump.blkThen, *stmt->jump.blkElse };
+	return {};
+}
+
+static bool isCall(const StmtInfo *stmt) {
+	return stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_FUNCALL;
+}
+
+template <typename F>
+static void ForEachUse(StmtInfo *stmt, F &&use) {
+	auto value = [&](ValueInfo *val) {
+		if(val != nullptr && val->tag == VT_SYMBOL) use(*val->symbol);
+	};
+	switch(stmt->tag) {
+		case ST_SYMDEF:
+			switch(stmt->symdef.tag) {
+				case SDT_EXPR:
+					value(stmt->symdef.expr->left);
+					value(stmt->symdef.expr->right);
+					break;
+				case SDT_LOAD: use(*stmt->symdef.load); break;
+				case SDT_GETELEMPTR:
+				case SDT_GETPTR:
+					use(*stmt->symdef.ptr.src);
+					value(stmt->symdef.ptr.index);
+					break;
+				case SDT_ALLOC: break;
+				case SDT_FUNCALL:
+					for(auto p: *stmt->symdef.func.para) value(p);
+					break;
+			}
+			break;
+		case ST_RETURN: value(stmt->ret.val); break;
+		case ST_STORE:
+			if(stmt->store.isValue) value(stmt->store.val);
+			use(*stmt->store.addr);
+			break;
+		case ST_BR: value(stmt->jump.cond); break;
+		case ST_JUMP: break;
 	}
 }
 
+/*
+	Zero-initialized globals go to .bss and globals that are never written
+	to .rodata, so neither is materialized in .data. Globals of at most
+	SMALL_DATA bytes use the small-data sections; the linker can then relax
+	their 'lui' + '%lo' accesses into a single gp-relative one.
+*/
 void VarToASM(std::ostream &out, VarInfo *mir) {
 	std::string varName = GlobalName(mir->name);
 	globals.emplace(varName);
 
-	out << "  .data\n"		// TODO: .bss
-		<< "  .globl " << varName << '\n';
+	bool zero = mir->init == nullptr || mir->init->tag == IT_ZERO || mir->init->tag == IT_UNDEF ||
+				(mir->init->tag == IT_NUM && mir->init->num == 0);
+	bool small = mir->type->size() <= SMALL_DATA;
+	if(zero) out << (small ? "  .section .sbss,\"aw\",@nobits\n" : "  .bss\n");
+	else if(writtenGlobals.find(mir->name) == writtenGlobals.end())
+		out << (small ? "  .section .srodata,\"a\"\n" : "  .section .rodata\n");
+	else out << (small ? "  .section .sdata,\"aw\"\n" : "  .data\n");
+	out << "  .globl " << varName << '\n'
+		<< "  .align 2\n";
 	out << varName << ":\n";
-	InitializerToASM(out, mir->init, mir->type);
+	if(zero) out << "  .zero " << mir->type->size() << '\n';
+	else InitializerToASM(out, mir->init, mir->type);
 	out << '\n';
 }
 
-void FuncToASM(std::ostream &out, FuncInfo *mir) {
-	globals.emplace(mir->name);
+// Globals that may change at run time: stored to, or with their address taken.
+// Pointers derived by getelemptr/getptr count as the global they point into.
+static void FindWrittenGlobals(ProgramInfo *mir) {
+	writtenGlobals.clear();
+	for(auto func: mir->funcs) {
+		std::map<std::string, std::string> root;
+		auto rootOf = [&](const std::string &name) {
+			auto it = root.find(name);
+			return it == root.end() ? name : it->second;
+		};
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				bool isPtr = stmt->tag == ST_SYMDEF &&
+							 (stmt->symdef.tag == SDT_GETELEMPTR || stmt->symdef.tag == SDT_GETPTR);
+				if(isPtr) root[*stmt->symdef.name] = rootOf(*stmt->symdef.ptr.src);
+				if(stmt->tag == ST_STORE) writtenGlobals.emplace(rootOf(*stmt->store.addr));
+				ForEachUse(stmt, [&](const std::string &name) {
+					bool isAccess = (stmt->tag == ST_STORE && name == *stmt->store.addr) ||
+									(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD) ||
+									(isPtr && name == *stmt->symdef.ptr.src);
+					if(!isAccess) writtenGlobals.emplace(rootOf(name));
+				});
+			}
+	}
+}
+
+static void FindCondMasks(FuncInfo *mir) {
+	std::map<std::string, ExprInfo*> exprs;
+	for(auto block: mir->block)
+		for(auto stmt: block->stmt)
+			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_EXPR) exprs[*stmt->symdef.name] = stmt->symdef.expr;
+	auto isBoolean = [&](const ValueInfo *val) {
+		if(val->tag != VT_SYMBOL || !exprs.count(*val->symbol)) return false;
+		auto op = exprs.at(*val->symbol)->op;
+		return op == OP_LE || op == OP_GE || op == OP_LT || op == OP_GT || op == OP_EQ || op == OP_NEQ;
+	};
+	for(auto &[name, expr]: exprs)
+		if(expr->op == OP_SUB && expr->left->tag == VT_INT && expr->left->i32 == 0 && isBoolean(expr->right))
+			condMask[name] = *expr->right->symbol;
+	for(auto block: mir->block)
+		for(auto stmt: block->stmt) {
+			std::size_t masks = 0;
+			ForEachUse(stmt, [&](const std::string &name) { masks += condMask.count(name); });
+			if(masks == 0) continue;
+			bool isAnd = stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_EXPR && stmt->symdef.expr->op == OP_LAND;
+			if(isAnd && masks == 1) continue;
+			ForEachUse(stmt, [&](const std::string &name) { condMask.erase(name); });
+		}
+}
+
+/*
+	Finds the loops to vectorize with RVV: a header of loads and the test
+	'index < bound', and a single body block it branches to, that jumps back
+	to it and ends by adding one to the index. A scalar local index and a
+	bound that the body doesn't store make the trip count known on entry.
+
+	In the body, the index is only used as the last index of a pointer to an
+	i32, which is then an element of a vector. Loads and stores through such
+	pointers, and the additions, subtractions and multiplications of their
+	values, happen element-wise in vector register groups; everything else
+	must be invariant in the loop. As other stores, calls or values
+	depending on the index in other ways would need the iterations in order,
+	they keep the loop scalar. So does a stored array that may overlap
+	another one accessed: the pointers have to be the same, or into
+	different global or local arrays.
+*/
+static bool PlanVectorLoop(const BlockInfo *head, const BlockInfo *body, VectorLoop &loop) {
+	enum Kind { INVARIANT, INDEX, ELEMENT, VECTOR };
+	std::map<std::string, Kind> kind;
+	std::map<std::string, const StmtInfo*> headDef, bodyDef;
+	std::map<std::string, std::string> key, root;
+	auto cond = head->stmt.back()->jump.cond;
+	if(cond->tag != VT_SYMBOL) return false;
+	for(auto it = head->stmt.begin(); it + 1 != head->stmt.end(); ++ it) {
+		auto stmt = *it;
+		if(stmt->tag != ST_SYMDEF) return false;
+		auto &name = *stmt->symdef.name;
+		if(stmt->symdef.tag == SDT_LOAD && stmt->symdef.load->front() == '@') key[name] = *stmt->symdef.load;
+		else if(stmt->symdef.tag != SDT_EXPR || name != *cond->symbol) return false;
+		headDef[name] = stmt;
+	}
+	if(!headDef.count(*cond->symbol)) return false;
+	auto test = headDef.at(*cond->symbol);
+	if(test->symdef.tag != SDT_EXPR || test->symdef.expr->op != OP_LT) return false;
+	auto left = test->symdef.expr->left, right = test->symdef.expr->right;
+	if(left->tag != VT_SYMBOL || !headDef.count(*left->symbol)) return false;
+	auto first = headDef.at(*left->symbol);
+	if(first->symdef.tag != SDT_LOAD) return false;
+	loop.index = *first->symdef.load;
+	auto alloc = crtAllocs.find(loop.index);
+	if(alloc == crtAllocs.end() || alloc->second->tag != TT_INT32) return false;
+	for(auto &[name, def]: headDef)
+		if(def->symdef.tag == SDT_LOAD && *def->symdef.load == loop.index) kind[name] = INDEX;
+	if(right->tag == VT_INT) loop.boundConst = right->i32;
+	else if(right->tag == VT_SYMBOL && headDef.count(*right->symbol) && headDef.at(*right->symbol)->symdef.tag == SDT_LOAD) {
+		loop.bound = *headDef.at(*right->symbol)->symdef.load;
+		if(loop.bound == loop.index) return false;
+	}
+	else return false;
+
+	// the step: '%s = add (load index), 1', stored to the index right before the jump back
+	auto &stmts = body->stmt;
+	if(stmts.size() < 2) return false;
+	auto last = stmts[stmts.size() - 2];
+	if(last->tag != ST_STORE || !last->store.isValue || *last->store.addr != loop.index) return false;
+	if(last->store.val->tag != VT_SYMBOL) return false;
+	std::map<std::string, std::size_t> uses;
+	for(auto stmt: stmts) {
+		ForEachUse(stmt, [&](const std::string &name) { ++ uses[name]; });
+		if(stmt->tag == ST_SYMDEF) bodyDef[*stmt->symdef.name] = stmt;
+	}
+	auto &stepName = *last->store.val->symbol;
+	loop.step = bodyDef.count(stepName) ? const_cast<StmtInfo*>(bodyDef.at(stepName)) : nullptr;
+	if(loop.step == nullptr || loop.step->symdef.tag != SDT_EXPR || uses[stepName] != 1) return false;
+
+	auto kindOf = [&](const ValueInfo *val) {
+		if(val->tag != VT_SYMBOL) return INVARIANT;
+		auto it = kind.find(*val->symbol);
+		return it == kind.end() ? INVARIANT : it->second;	// defined before the loop
+	};
+	// pointers the same in every iteration are told apart by how they are computed
+	auto keyOf = [&](const std::string &name) {
+		auto it = key.find(name);
+		return it == key.end() ? name : it->second;
+	};
+	auto valueKey = [&](const ValueInfo *val) {
+		return val->tag == VT_INT ? std::to_string(val->i32) : val->tag == VT_SYMBOL ? keyOf(*val->symbol) : "undef";
+	};
+	auto rootOf = [&](const std::string &name) {
+		auto it = root.find(name);
+		if(it != root.end()) return it->second;
+		auto alloc = crtAllocs.find(name);
+		bool array = isGlobal(name) || (alloc != crtAllocs.end() && alloc->second->tag == TT_ARRAY);
+		return array ? name : std::string();
+	};
+	std::vector<std::pair<std::string, bool> > accesses;	// (element pointer, stored)
+	for(auto it = stmts.begin(); it + 2 < stmts.end(); ++ it) {
+		auto stmt = *it;
+		if(stmt == loop.step) continue;
+		if(stmt->tag == ST_STORE) {
+			if(!stmt->store.isValue) return false;
+			auto addr = kind.find(*stmt->store.addr);
+			if(addr == kind.end() || addr->second != ELEMENT) return false;
+			auto val = kindOf(stmt->store.val);
+			if(val != INVARIANT && val != VECTOR) return false;
+			accesses.emplace_back(*stmt->store.addr, true);
+			continue;
+		}
+		if(stmt->tag != ST_SYMDEF) return false;
+		auto &sym = stmt->symdef;
+		auto &name = *sym.name;
+		switch(sym.tag) {
+			case SDT_LOAD: {
+				auto &src = *sym.load;
+				if(src == loop.index) kind[name] = INDEX;
+				else if(src.front() == '@') {
+					kind[name] = INVARIANT;
+					key[name] = src;
+				}
+				else {
+					auto ptr = kind.find(src);
+					if(ptr == kind.end() || ptr->second != ELEMENT) return false;
+					kind[name] = VECTOR;
+					accesses.emplace_back(src, false);
+				}
+				break;
+			}
+			case SDT_GETELEMPTR:
+			case SDT_GETPTR: {
+				auto src = kind.find(*sym.ptr.src);
+				if(src != kind.end() && src->second != INVARIANT) return false;
+				auto index = kindOf(sym.ptr.index);
+				if(index == INDEX) {
+					if(sym.ptr.base->tag != TT_INT32) return false;
+					kind[name] = ELEMENT;
+				}
+				else if(index == INVARIANT) kind[name] = INVARIANT;
+				else return false;
+				key[name] = "(" + keyOf(*sym.ptr.src) + (index == INDEX ? " i" : " " + valueKey(sym.ptr.index)) + ")";
+				root[name] = rootOf(*sym.ptr.src);
+				break;
+			}
+			case SDT_EXPR: {
+				auto &expr = *sym.expr;
+				auto l = kindOf(expr.left), r = kindOf(expr.right);
+				if(l == INDEX || r == INDEX || l == ELEMENT || r == ELEMENT) return false;
+				if(l == VECTOR || r == VECTOR) {
+					if(expr.op != OP_ADD && expr.op != OP_SUB && expr.op != OP_MUL) return false;
+					kind[name] = VECTOR;
+				}
+				else {
+					kind[name] = INVARIANT;
+					key[name] = "(" + valueKey(expr.left) + " " + std::to_string(int(expr.op)) + " " + valueKey(expr.right) + ")";
+				}
+				break;
+			}
+			default: return false;
+		}
+	}
+	auto &step = *loop.step->symdef.expr;
+	auto one = step.left->tag == VT_SYMBOL ? step.right : step.left, var = step.left->tag == VT_SYMBOL ? step.left : step.right;
+	if(step.op != OP_ADD || one->tag != VT_INT || one->i32 != 1 || kindOf(var) != INDEX) return false;
+
+	bool stores = false;
+	for(auto &[x, xStored]: accesses) {
+		stores = stores || xStored;
+		for(auto &[y, yStored]: accesses) {
+			if(!(xStored || yStored) || keyOf(x) == keyOf(y)) continue;
+			auto xRoot = root.at(x), yRoot = root.at(y);
+			if(xRoot.empty() || yRoot.empty() || xRoot == yRoot) return false;
+		}
+	}
+	if(!stores) return false;
+
+	// a register group for each vector, from its definition to its last use
+	std::map<std::string, std::size_t> lastUse;
+	for(std::size_t i = 0; i < stmts.size(); ++ i)
+		ForEachUse(stmts[i], [&](const std::string &name) { lastUse[name] = i; });
+	std::vector<std::string> free(VECTOR_GROUPS.rbegin(), VECTOR_GROUPS.rend());
+	for(std::size_t i = 0; i < stmts.size(); ++ i) {
+		ForEachUse(stmts[i], [&](const std::string &name) {
+			auto group = loop.vreg.find(name);
+			if(group != loop.vreg.end() && lastUse.at(name) == i) free.emplace_back(group->second);
+		});
+		if(stmts[i]->tag != ST_SYMDEF || kind[*stmts[i]->symdef.name] != VECTOR) continue;
+		if(free.empty()) return false;
+		auto &name = *stmts[i]->symdef.name;
+		loop.vreg[name] = free.back();
+		free.pop_back();
+		if(!lastUse.count(name)) free.emplace_back(loop.vreg[name]);
+	}
+	return true;
+}
+
+static void FindVectorLoops(FuncInfo *mir) {
+	std::map<std::string, const BlockInfo*> blocks;
+	std::map<std::string, std::size_t> preds;
+	for(auto block: mir->block) {
+		blocks[block->name] = block;
+		for(auto &succ: Successors(block)) ++ preds[succ];
+	}
+	for(auto head: mir->block) {
+		if(head->stmt.empty() || head->stmt.back()->tag != ST_BR) continue;
+		auto body = blocks.at(*head->stmt.back()->jump.blkThen);
+		if(body == head || preds[body->name] != 1 || body->stmt.back()->tag != ST_JUMP ||
+		   *body->stmt.back()->jump.blkThen != head->name)
+			continue;
+		VectorLoop loop;
+		if(PlanVectorLoop(head, body, loop)) vectorLoops.emplace(body, std::move(loop));
+	}
+}
+
+static bool isVectorValue(const std::string &name) {
+	for(auto &[body, loop]: vectorLoops)
+		if(loop.vreg.count(name)) return true;
+	return false;
+}
+
+/*
+	Keeps the values of a function in registers.
+
+	Every temporary and every scalar `alloc` gets a live interval over the
+	linear order of statements. An interval touching a loop (a backward
+	jump) is stretched over the whole loop, unless it is that of a
+	temporary used in a single block, which is dead at the end of the
+	block, wherever the block jumps. The intervals are then colored
+	with HOME_REGS by linear scan; whatever doesn't fit stays on the stack.
+	Of the active intervals and the new one, that is the one whose uses run
+	the fewest times, by the profile or else by a guess.
+	In a function that calls, the intervals without a call inside them are
+	colored with CALLER_HOME_REGS, as a call clobbers them; those with one
+	get CALLEE_HOME_REGS, which are also taken when the others run out.
+	Where the save of ra is shrink-wrapped, those of the callee-saved
+	registers are too, so a value only gets one if it is written where ra
+	is saved already.
+*/
+static void AllocateRegisters(FuncInfo *mir, bool isLeaf) {
+	std::map<std::string, std::size_t> blockPos;
+	std::map<std::string, std::pair<std::size_t, std::size_t> > range;
+	std::set<std::string> escaped;
+	std::vector<std::pair<std::size_t, std::size_t> > loops;
+	std::vector<std::size_t> calls;
+	std::map<std::string, const BlockInfo*> blockOf;	// of a temporary, null if in several
+	std::map<std::string, std::vector<std::size_t> > refs;
+	std::map<std::string, std::uint64_t> weight;		// executions of its uses
+	std::set<std::string> unsaved;						// written where ra may not be saved
+	const BlockInfo *crtBlock = nullptr;
+	std::size_t pos = 0;
+
+	auto touch = [&](const std::string &name) {
+		refs[name].emplace_back(pos);
+		weight[name] += crtBlock->freq;
+		auto it = range.find(name);
+		if(it == range.end()) range.emplace(name, std::make_pair(pos, pos));
+		else it->second.second = pos;
+		auto [at, first] = blockOf.emplace(name, crtBlock);
+		if(!first && at->second != crtBlock) at->second = nullptr;
+	};
+	for(auto block: mir->block) {
+		blockPos[block->name] = pos;
+		pos += block->stmt.size();
+	}
+	pos = 0;
+	for(auto block: mir->block) {
+		crtBlock = block;
+		for(auto stmt: block->stmt) {
+			if(stackMgr.raWrapped && !stackMgr.raSavedIn.count(block->name)) {
+				if(stmt->tag == ST_SYMDEF) unsaved.emplace(*stmt->symdef.name);
+				if(stmt->tag == ST_STORE) unsaved.emplace(*stmt->store.addr);
+			}
+			if(stmt->tag == ST_SYMDEF) {
+				auto &name = *stmt->symdef.name;
+				if(stmt->symdef.tag == SDT_ALLOC && stmt->symdef.alloc->tag == TT_ARRAY) escaped.emplace(name);
+				if(!name.empty()) touch(name);
+			}
+			ForEachUse(stmt, [&](const std::string &name) {
+				touch(name);
+				if(auto mask = condMask.find(name); mask != condMask.end()) touch(mask->second);
+			});
+			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_EXPR) {
+				for(auto val: {stmt->symdef.expr->left, stmt->symdef.expr->right})
+					if(val->tag == VT_SYMBOL && val->symbol->front() == '@' && !crtParams.count(*val->symbol))
+						escaped.emplace(*val->symbol);	// address taken
+			}
+			if(isCall(stmt)) calls.emplace_back(pos);
+			++ pos;
+		}
+		for(auto &succ: Successors(block))
+			if(blockPos[succ] < pos) loops.emplace_back(blockPos[succ], pos - 1);
+	}
+
+	// without a profile, a use is guessed to run 8 times per loop around it
+	bool profiled = std::any_of(mir->block.begin(), mir->block.end(), [](const BlockInfo *block) { return block->freq != 0; });
+	if(!profiled)
+		for(auto &[name, at]: refs) {
+			std::uint64_t total = 0;
+			for(auto p: at) {
+				std::uint64_t freq = 1;
+				for(auto &loop: loops)
+					if(loop.first <= p && p <= loop.second && freq < (1u << 24)) freq *= 8;
+				total += freq;
+			}
+			weight[name] = total;
+		}
+	// a callee-saved register costs a store and a load each time the function, or the save, runs
+	std::uint64_t saveCost = 2;
+	if(profiled) {
+		saveCost = 0;
+		for(auto block: mir->block)
+			if(stackMgr.raWrapped ? stackMgr.raSave.count(block->name) : block == mir->block.front()) saveCost += 2 * block->freq;
+	}
+
+	std::vector<std::pair<std::pair<std::size_t, std::size_t>, std::string> > intervals;
+	std::set<std::string> acrossCall;
+	for(auto &[name, r]: range) {
+		if(crtParams.count(name) || isGlobal(name) || escaped.count(name) || foldedAddr.count(name) || condMask.count(name) ||
+		   isVectorValue(name))
+			continue;
+		bool local = name.front() == '%' && blockOf.at(name) != nullptr;
+		for(bool changed = !local; changed; ) {
+			changed = false;
+			for(auto &loop: loops)
+				if(r.first <= loop.second && loop.first <= r.second &&
+				  (loop.first < r.first || r.second < loop.second)) {
+					r.first = std::min(r.first, loop.first);
+					r.second = std::max(r.second, loop.second);
+					changed = true;
+				}
+		}
+		// defined by a call, or passed to one, is fine: it is in a register only around it
+		auto across = std::upper_bound(calls.begin(), calls.end(), r.first);
+		if(across != calls.end() && *across < r.second) acrossCall.emplace(name);
+		intervals.emplace_back(r, name);
+	}
+	std::sort(intervals.begin(), intervals.end());
+
+	std::vector<std::string> pool;
+	for(auto &reg: isLeaf ? HOME_REGS : CALLER_HOME_REGS) {
+		bool isParam = false;
+		for(std::size_t i = 0; i < std::min<std::size_t>(mir->params.size(), 8u); ++ i)
+			if(reg == "a" + std::to_string(i)) isParam = true;
+		if(!isParam) pool.emplace_back(reg);
+	}
+	std::reverse(pool.begin(), pool.end());		// pop from the back: a7 first
+	std::vector<std::string> saved(CALLEE_HOME_REGS.rbegin(), CALLEE_HOME_REGS.rend());
+	auto release = [&](const std::string &reg) {
+		(reg.front() == 's' ? saved : pool).emplace_back(reg);
+	};
+	// A register for name, empty if none: a caller-saved one unless it lives across a call, or else a
+	// callee-saved one; a register not saved yet only if the value is used more often than it would be
+	auto take = [&](const std::string &name, bool across, bool savable) {
+		std::string reg;
+		if(!across && !pool.empty()) {
+			reg = pool.back();
+			pool.pop_back();
+		}
+		else if(savable) {
+			auto used = std::find_if(saved.rbegin(), saved.rend(), [](auto &s) { return stackMgr.calleeSaved.count(s); });
+			if(used != saved.rend()) {
+				reg = *used;
+				saved.erase(std::next(used).base());
+			}
+			else if(!saved.empty() && weight[name] > saveCost) {
+				reg = saved.back();
+				saved.pop_back();
+			}
+		}
+		return reg;
+	};
+	std::vector<std::pair<std::size_t, std::string> > active;		// (end, reg)
+	std::map<std::string, std::string> owner;						// reg -> name
+	for(auto &[r, name]: intervals) {
+		for(auto it = active.begin(); it != active.end(); ) {
+			if(it->first <= r.first) {
+				release(it->second);
+				it = active.erase(it);
+			}
+			else ++ it;
+		}
+		bool across = acrossCall.count(name), savable = !unsaved.count(name);
+		if(across && !savable) continue;
+		auto reg = take(name, across, savable);
+		if(reg.empty()) {
+			auto cheapest = active.end();
+			for(auto it = active.begin(); it != active.end(); ++ it)
+				if((it->second.front() == 's' ? savable : !across) &&
+				   (cheapest == active.end() || weight[owner[it->second]] < weight[owner[cheapest->second]]))
+					cheapest = it;
+			if(cheapest == active.end() || weight[owner[cheapest->second]] >= weight[name]) continue;		// spilled
+			varReg.erase(owner[cheapest->second]);
+			reg = cheapest->second;
+			active.erase(cheapest);
+		}
+		if(reg.front() == 's') stackMgr.calleeSaved.emplace(reg);
+		owner[reg] = name;
+		varReg[name] = reg;
+		regMgr.pin(reg);
+		active.emplace_back(r.second, reg);
+	}
+	if(!isLeaf) return ;
+	for(std::size_t i = 0; i < std::min<std::size_t>(mir->params.size(), 8u); ++ i)
+		regMgr.pin("a" + std::to_string(i));
+}
 
+/*
+	Shrink-wraps the save of ra: instead of the prologue, ra is saved on
+	entry to each block that calls and isn't preceded by a save, and
+	restored at the returns reached by such a save. This is only valid if
+	ra still holds the return address wherever it is saved, and if every
+	return after a call is covered by a save; otherwise we fall back to
+	saving it in the prologue. The callee-saved registers in use are saved
+	and restored along with it.
+*/
+static void ShrinkWrapRa(FuncInfo *mir) {
+	std::map<std::string, BlockInfo*> blocks;
+	std::map<std::string, std::vector<std::string> > preds;
+	for(auto block: mir->block) {
+		blocks[block->name] = block;
+		for(auto &succ: Successors(block)) preds[succ].emplace_back(block->name);
+	}
+	std::map<std::string, bool> mayCalled, saved;	// state at the exit of each block
+	auto hasCall = [](BlockInfo *block) {
+		return std::any_of(block->stmt.begin(), block->stmt.end(), isCall);
+	};
+	auto in = [&](BlockInfo *block, bool &mayIn, bool &savedIn) {
+		mayIn = false;
+		savedIn = block != mir->block.front();
+		for(auto &p: preds[block->name]) {
+			mayIn = mayIn || mayCalled[p];
+			savedIn = savedIn && saved[p];
+		}
+		if(block == mir->block.front()) savedIn = false;
+	};
+	for(auto block: mir->block) mayCalled[block->name] = false, saved[block->name] = true;
+	for(bool changed = true; changed; ) {
+		changed = false;
+		for(auto block: mir->block) {
+			bool mayIn, savedIn;
+			in(block, mayIn, savedIn);
+			bool call = hasCall(block);
+			bool mayOut = mayIn || call, savedOut = savedIn || call;
+			if(mayOut != mayCalled[block->name] || savedOut != saved[block->name]) {
+				mayCalled[block->name] = mayOut;
+				saved[block->name] = savedOut;
+				changed = true;
+			}
+		}
+	}
+	std::set<std::string> save, restore;
+	for(auto block: mir->block) {
+		bool mayIn, savedIn;
+		in(block, mayIn, savedIn);
+		if(hasCall(block) && !savedIn) {
+			if(mayIn) return;		// ra may be clobbered already
+			save.emplace(block->name);
+		}
+		if(!block->stmt.empty() && block->stmt.back()->tag == ST_RETURN && mayCalled[block->name]) {
+			if(!saved[block->name]) return;
+			restore.emplace(block->name);
+		}
+	}
+	stackMgr.raWrapped = true;
+	stackMgr.raSave = save;
+	stackMgr.raRestore = restore;
+	for(auto block: mir->block) {
+		bool mayIn, savedIn;
+		in(block, mayIn, savedIn);
+		if(savedIn || save.count(block->name)) stackMgr.raSavedIn.emplace(block->name);
+	}
+}
+
+/*
+	The order the blocks are emitted in, each falling through to the next
+	where it jumps to it. With a profile, the blocks are chained bottom-up
+	(as by Pettis and Hansen): the edges are taken by the cycles saved if
+	their jump falls through, most first, and each links the chain ending
+	at its source to the one starting at its target. A jump saves a 'j',
+	a branch only its being taken (the core's branch penalty), and with an
+	epilogue, a return falls into it if its block comes last. The chains then follow each other in
+	the order of the MIR, which is kept without a profile.
+*/
+static std::vector<BlockInfo*> BlockLayout(FuncInfo *mir, bool epilogue) {
+	bool profiled = std::any_of(mir->block.begin(), mir->block.end(), [](const BlockInfo *block) { return block->freq != 0; });
+	if(!profiled) return mir->block;
+	int n = mir->block.size(), exit = n;		// the epilogue
+	std::map<std::string, int> id;
+	for(int i = 0; i < n; ++ i) id[mir->block[i]->name] = i;
+	std::vector<std::pair<std::uint64_t, std::pair<int, int> > > edges;
+	std::uint64_t penalty = BranchPenalty();
+	for(int i = 0; i < n; ++ i) {
+		auto block = mir->block[i];
+		if(block->stmt.empty()) continue;
+		auto last = block->stmt.back();
+		auto saved = last->tag == ST_BR ? penalty : penalty + 1;
+		for(auto &succ: Successors(block))
+			edges.push_back({saved * std::min(block->freq, mir->block[id.at(succ)]->freq), {i, id.at(succ)}});
+		if(last->tag == ST_RETURN && epilogue) edges.push_back({(penalty + 1) * block->freq, {i, exit}});
+	}
+	std::stable_sort(edges.begin(), edges.end(), [](auto &x, auto &y) { return x.first > y.first; });
+	std::vector<int> next(n + 1, -1), prev(n + 1, -1);
+	auto headOf = [&](int x) {
+		while(prev[x] != -1) x = prev[x];
+		return x;
+	};
+	auto tailOf = [&](int x) {
+		while(next[x] != -1) x = next[x];
+		return x;
+	};
+	auto chainSize = [&](int x) {
+		int size = 0;
+		for(x = headOf(x); x != -1; x = next[x]) ++ size;
+		return size;
+	};
+	for(auto &[saved, edge]: edges) {
+		auto [from, to] = edge;
+		if(saved == 0 || to == 0 || next[from] != -1 || prev[to] != -1 || headOf(from) == to) continue;
+		// a chain from the entry to the epilogue leaves no place for the others
+		if(headOf(from) == 0 && tailOf(to) == exit && chainSize(from) + chainSize(to) < n + 1) continue;
+		next[from] = to;
+		prev[to] = from;
+	}
+	std::vector<BlockInfo*> order;
+	int last = -1;
+	for(int i = 0; i <= n; ++ i) {
+		if(prev[i] != -1) continue;
+		if(tailOf(i) == exit) {
+			last = i;
+			continue;
+		}
+		for(int x = i; x != -1; x = next[x]) order.emplace_back(mir->block[x]);
+	}
+	for(int x = last; x != -1 && x != exit; x = next[x]) order.emplace_back(mir->block[x]);
+	return order;
+}
+
+// Bytes an instruction line may take: two instructions for a pseudo-instruction that may expand
+static std::size_t InstSize(std::string_view line) {
+	if(line.substr(0, 2) != "  " || line.substr(2, 1) == "#" || line.substr(2, 1) == ".") return 0;
+	auto op = line.substr(2, line.find(' ', 2) - 2);
+	return op == "li" || op == "la" || op == "call" ? 8 : 4;
+}
+
+static std::size_t CodeSize(const std::string &text) {
+	std::size_t size = 0;
+	for(std::size_t from = 0; from < text.size(); ) {
+		auto end = std::min(text.find('\n', from), text.size());
+		size += InstSize(std::string_view(text).substr(from, end - from));
+		from = end + 1;
+	}
+	return size;
+}
+
+/*
+	Emits the blocks in the order of layout. A conditional branch reaches
+	only ±4 KiB, so the blocks are emitted with short branches first, then
+	each one whose branch may not reach its targets, given the sizes of
+	the blocks in between, again with its branch inverted over a 'j'.
+	Sizes are upper bounds, and count every branch as relaxed.
+*/
+static void LayoutToASM(std::ostream &out, const std::vector<BlockInfo*> &layout) {
+	constexpr std::size_t BRANCH_REACH = 4096 - 4;
+	std::size_t n = layout.size();
+	std::vector<std::string> text(n);
+	std::vector<std::size_t> zeroLoopsAt(n), start(n + 1, 0);
+	std::map<std::string, std::size_t> index;
+	auto emit = [&](std::size_t i, bool far) {
+		std::ostringstream buf;
+		nextBlockName = i + 1 < n ? layout[i + 1]->name : "";
+		farBranch = far;
+		zeroLoops = zeroLoopsAt[i];		// the same labels again
+		BlockToASM(buf, layout[i]);
+		text[i] = buf.str();
+	};
+	for(std::size_t i = 0; i < n; ++ i) {
+		index[layout[i]->name] = i;
+		zeroLoopsAt[i] = zeroLoops;
+		emit(i, false);
+		start[i + 1] = start[i] + CodeSize(text[i]) + 8;		// the 'j' and label of a relaxed branch
+	}
+	for(std::size_t i = 0; i < n; ++ i) {
+		if(layout[i]->stmt.empty() || layout[i]->stmt.back()->tag != ST_BR) continue;
+		bool far = false;
+		for(auto &succ: Successors(layout[i])) {
+			auto j = index.at(succ);
+			far |= (j > i ? start[j] - start[i] : start[i + 1] - start[j]) > BRANCH_REACH;
+		}
+		if(far) emit(i, true);
+	}
+	farBranch = false;
+	for(auto &block: text) out << block;
+}
+
+void FuncToASM(std::ostream &out, FuncInfo *mir) {
 	std::size_t stackSize = 0, maxParam = 0;
 	bool isLeaf = true;
 	stackMgr.clear();
+	regMgr.clear();
+	varReg.clear();
+	crtAllocs.clear();
+	foldedAddr.clear();
+	condMask.clear();
+	zeroLoops = 0;
+	crtParams.clear();
+	crtFunc = mir;
+	crtFuncName = mir->name;
+	for(std::size_t i = 0; i < mir->params.size(); ++ i) {
+		crtParams[mir->params[i]->name] = i;
+	}
+
 	for(auto block: mir->block) 
 		for(auto stmt: block->stmt) 
-			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_FUNCALL) {
+			if(isCall(stmt)) {
 				isLeaf = false;
 				maxParam = std::max(maxParam, stmt->symdef.func.para -> size() );
 			}
 	if(maxParam > 8)
 		stackSize += 4u * (maxParam - 8);
 
+	for(auto block: mir->block)
+		for(auto stmt: block->stmt) {
+			if(stmt->tag != ST_SYMDEF) continue;
+			auto &sym = stmt->symdef;
+			if(sym.tag == SDT_ALLOC) crtAllocs[*sym.name] = sym.alloc;
+			if((sym.tag != SDT_GETELEMPTR && sym.tag != SDT_GETPTR) || sym.ptr.index->tag != VT_INT) continue;
+			FoldedAddr addr{*sym.ptr.src, 0};
+			if(auto fold = foldedAddr.find(addr.root); fold != foldedAddr.end()) addr = fold->second;
+			else if(!crtAllocs.count(addr.root) && !isGlobal(addr.root)) continue;
+			long offset = long(addr.offset) + long(sym.ptr.index->i32) * long(SizeOfType(sym.ptr.base));
+			if(offset < 0) continue;
+			foldedAddr[*sym.name] = {addr.root, std::size_t(offset)};
+		}
+
+	if(zicond) FindCondMasks(mir);
+	vectorLoops.clear();
+	if(rvv) FindVectorLoops(mir);
+	if(!isLeaf) ShrinkWrapRa(mir);
+	AllocateRegisters(mir, isLeaf);
+
+	// Small slots go next to sp and large allocs to the top of the frame,
+	// so that most accesses keep a short offset even in a large frame.
+	if(!isLeaf) {
+		stackMgr.stackAddr["_ra"] = stackSize;
+		stackSize += 4;		// for storing ra
+	}
+	for(auto &reg: stackMgr.calleeSaved) {
+		stackMgr.stackAddr["_" + reg] = stackSize;
+		stackSize += 4;
+	}
 	for(auto block: mir->block) 
 		for(auto stmt: block->stmt) 
-			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag != SDT_ALLOC) {
+			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag != SDT_ALLOC && !stmt->symdef.name->empty() &&
+			   varReg.find(* stmt->symdef.name) == varReg.end() && !foldedAddr.count(* stmt->symdef.name) &&
+			   !condMask.count(* stmt->symdef.name) && !isVectorValue(* stmt->symdef.name)) {
 				// Stack for results of instruction
 				stackMgr.stackAddr[* stmt->symdef.name] = stackSize;
 				stackSize += 4;
 			}
+	std::vector<StmtInfo*> allocs;
 	for(auto block: mir->block)
 		for(auto stmt: block->stmt)
-			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_ALLOC) {
-				// Stack for alloc
-				stackMgr.stackAddr[* stmt->symdef.name] = stackSize;
-				stackSize += SizeOfType(stmt->symdef.alloc);
-			}
-	if(!isLeaf) {
-		stackMgr.stackAddr["_ra"] = stackSize;
-		stackSize += 4;		// for storing ra
+			if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_ALLOC &&
+			   varReg.find(* stmt->symdef.name) == varReg.end())
+				allocs.emplace_back(stmt);
+	std::stable_sort(allocs.begin(), allocs.end(), [](StmtInfo *x, StmtInfo *y) {
+		return SizeOfType(x->symdef.alloc) < SizeOfType(y->symdef.alloc);
+	});
+	for(auto stmt: allocs) {
+		// Stack for alloc
+		stackMgr.stackAddr[* stmt->symdef.name] = stackSize;
+		stackSize += SizeOfType(stmt->symdef.alloc);
 	}
 	stackSize = ((stackSize + 15) >> 4) << 4;	// aligning
 	stackMgr.size = stackSize;
 
-	crtFunc = mir;
-	crtFuncName = mir->name;
-	for(std::size_t i = 0; i < mir->params.size(); ++ i) {
-		crtParams[mir->params[i]->name] = i;
-	}
-
 	out << "  .text\n";
-	out << "  .globl " << crtFuncName << '\n';
+	// only main is called from outside, see ipo.cpp
+	if(crtFuncName == "main") out << "  .globl " << crtFuncName << '\n';
 	out << mir->name << ":\n";
 	out << "  # prologue of " << mir->name << '\n';
-	if(isImm12(-int(stackSize))) {
-		out << "  addi sp, sp, " << -int(stackSize) << '\n';
+	if(stackSize != 0) AdjustSp(out, -int(stackSize));
+	if(!stackMgr.raWrapped) {
+		if(!isLeaf) StoreFrame(out, "ra", stackMgr.getAddr("_ra"));
+		for(auto &reg: stackMgr.calleeSaved) StoreFrame(out, reg, stackMgr.getAddr("_" + reg));
 	}
-	else {
-		out << "  li a0, " << -int(stackSize) << '\n';
-		out << "  add sp, sp, a0\n";
-	}
-	if(!isLeaf) out << "  sw ra, " << stackMgr.stackAddr["_ra"] << "(sp)\n";
 	out << '\n';
 
-	for(auto block: mir->block) {
-		BlockToASM(out, block);
+	LayoutToASM(out, BlockLayout(mir, stackSize != 0));
+	if(stackSize == 0) {
+		out << '\n';
+		return ;		// every 'ret' is emitted in place
 	}
 	out << mir->name << "_epilogue:\n";
 	out << "  # epilogue of " << mir->name << '\n';
-	if(!isLeaf) out << "  lw ra, " << stackMgr.stackAddr["_ra"] << "(sp)\n";
-	if(isImm12(int(stackSize))) {
-		out << "  addi sp, sp, " << int(stackSize) << '\n';
-	}
-	else {
-		auto tmp = regMgr.allocate();
-		out << "  li " << tmp << ", " << int(stackSize) << '\n';
-		out << "  add sp, sp, " << tmp << "\n";
-		regMgr.free(tmp);
+	if(!stackMgr.raWrapped) {
+		if(!isLeaf) LoadFrame(out, "ra", stackMgr.getAddr("_ra"));
+		for(auto &reg: stackMgr.calleeSaved) LoadFrame(out, reg, stackMgr.getAddr("_" + reg));
 	}
+	AdjustSp(out, int(stackSize));
 	out << "  " << "ret\n";
 	out << '\n';
 }
 
+/*
+	The code of a function only depends on its MIR and on which of the
+	names it uses are globals, so with a cache directory it is kept under
+	the hash of these and reused as long as neither changes.
+*/
+static void CachedFuncToASM(std::ostream &out, FuncInfo *mir) {
+	ProgramInfo prog;
+	prog.vars.init(0);
+	prog.funcs.init(1);
+	prog.funcs[0] = mir;
+	std::vector<std::string> used(1, ProgramToBinary(&prog));
+	prog.funcs[0] = nullptr;
+	std::set<std::string> seen;
+	for(auto block: mir->block)
+		for(auto stmt: block->stmt)
+			ForEachUse(stmt, [&](const std::string &name) {
+				if(isGlobal(name) && seen.insert(name).second) used.emplace_back(name);
+			});
+	if(zicond) used.emplace_back("-mzicond");
+	if(rvv) used.emplace_back("-mrvv");
+	for(auto block: mir->block) used.emplace_back(std::to_string(block->freq));
+	used.emplace_back("branch " + std::to_string(BranchPenalty()));		// for the layout
+	auto key = CacheKey("", "-riscv", used);
+
+	std::string text;
+	if(!CacheLoad(cacheDir, key, "fS", text)) {
+		std::ostringstream buf;
+		FuncToASM(buf, mir);
+		text = buf.str();
+		CacheStore(cacheDir, key, "fS", text);
+	}
+	out << text;
+}
+
 void ProgramToASM(std::ostream &out, ProgramInfo *mir) {
+	FindWrittenGlobals(mir);
 	for(auto var: mir -> vars) {
 		VarToASM(out, var);
 	}
+	for(auto func: mir -> funcs) globals.emplace(func->name);
 	std::cerr << "begin func\n";
-	for(auto func: mir -> funcs) {
-		FuncToASM(out, func);
-	}
+	// each function into its own buffer, then in the order of the program
+	std::vector<std::string> text(mir->funcs.len);
+	ParallelFor(mir->funcs.len, [&](std::size_t i) {
+		std::ostringstream buf;
+		if(cacheDir.empty()) FuncToASM(buf, mir->funcs[i]);
+		else CachedFuncToASM(buf, mir->funcs[i]);
+		// scheduled after the cache, which so holds code for any latencies
+		text[i] = ScheduleASM(buf.str());
+	});
+	for(auto &func: text) out << func;
 }
\ No newline at end of file
@@ -1,15 +1,99 @@
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <sstream>
+#include <string_view>
+#include <unordered_set>
+
 #include "ast.hpp"
 
+extern std::string cacheDir;
+extern std::string CacheKey(const std::string &source, const std::string &mode, const std::vector<std::string> &flags);
+extern bool CacheLoad(const std::string &dir, const std::string &key, const std::string &ext, std::string &data);
+extern void CacheStore(const std::string &dir, const std::string &key, const std::string &ext, const std::string &data);
+extern std::string ProgramToBinary(ProgramInfo *mir);
+extern ProgramInfo *BinaryToProgram(const char *data, std::size_t size);
+extern void EvalAddGlobal(VarInfo *var, bool constant, bool dynamic);
+extern void EvalAddFunction(FuncInfo *func);
+extern std::optional<int> EvalCall(const std::string &func, const std::vector<int> &args, bool startup,
+								   std::vector<std::string> &called);
+
+
+void *BaseAST::operator new(std::size_t size) {
+	static constexpr std::size_t CHUNK = 64 << 10, ALIGN = alignof(std::max_align_t);
+	static std::vector<std::unique_ptr<char[]> > chunks;
+	static char *crt = nullptr;
+	static std::size_t left = 0;
+	size = (size + ALIGN - 1) / ALIGN * ALIGN;
+	if(size > CHUNK / 4) return chunks.emplace_back(new char[size]).get();
+	if(left < size) {
+		crt = chunks.emplace_back(new char[CHUNK]).get();
+		left = CHUNK;
+	}
+	left -= size;
+	crt += size;
+	return crt - size;
+}
+
+void BaseAST::Dump(std::ostream &out) const {
+	Visit([&](auto &node) { node.Dump(out); });
+}
+MIRRet BaseAST::DumpMIR(std::vector<MIRInfo*> *buf) const {
+	return Visit([&](auto &node) { return node.DumpMIR(buf); });
+}
+std::optional<int> BaseAST::Fold() const {
+	return Visit([](auto &node) { return node.Fold(); });
+}
+int BaseAST::Calc() const {
+	auto val = Fold();
+	if(!val) {
+		std::ostringstream expr;
+		expr << *this;
+		throw sysy_error("not a constant expression: " + expr.str());
+	}
+	return *val;
+}
+
+void ASTDeleter::operator() (const BaseAST *ast) const {
+	ast->Visit([](auto &node) { delete &node; });
+}
+
+// Identifiers are copied once per distinct name; the AST copies what it keeps
+const std::string *InternIdent(const char *str, std::size_t len) {
+	struct Hash {
+		using is_transparent = void;
+		std::size_t operator() (std::string_view s) const { return std::hash<std::string_view>{}(s); }
+	};
+	static std::unordered_set<std::string, Hash, std::equal_to<> > idents;
+	std::string_view name(str, len);
+	auto it = idents.find(name);
+	if(it == idents.end()) it = idents.emplace(name).first;
+	return &*it;
+}
+
+struct ArrayShape {
+	bool pointer;					// a parameter int a[][...], whose first dimension is omitted
+	std::vector<std::size_t> dims;
+	bool constant;
+	std::vector<std::pair<std::size_t, int> > vals;	// non-zero elements of a const or global array, by position
+};
 
 struct DomainManager {
 	struct LayerInfo {
 		std::map<std::string, std::string> recVar;
 		std::map<std::string, int > recConst;
+		std::map<std::string, ArrayShape> recShape;
 		std::string blkBreak, blkContinue;
 	};
 	std::vector<LayerInfo> rec;
 	std::map<std::string, std::size_t> cnt;
 	std::set<std::string> used;
+	// What a function can see of the globals, keyed "v:" for variables and constants,
+	// "f:" for functions and "n:" for every global name, and with a cache, "b:" for the
+	// lowered body of a function, which calls evaluated at compile time depend on; the
+	// global symbols a function's lowering looks up are collected in deps
+	std::map<std::string, std::string> globalSig;
+	std::map<std::string, std::string> *deps = nullptr;
 	DomainManager() {
 		rec.emplace_back();
 	}
@@ -23,19 +107,47 @@ struct DomainManager {
 			while(true) {
 				++ cnt[name];
 				res = "@" + name + "_" + std::to_string(cnt[name]);
-				if(used.find(res) == used.end()) break;
+				depend("n:" + res.substr(1));
+				if(used.find(res) == used.end() && signature("n:" + res.substr(1)).empty()) break;
 			}
 		}
 		used.emplace(res);
 		rec.back().recVar.emplace(name, res);
 		return res;
 	}
+	// Starts a function: its local names and numbering don't depend on the functions before it
+	void enterFunc() {
+		cnt.clear();
+		used.clear();
+	}
+	std::string signature(const std::string &key) const {
+		auto it = globalSig.find(key);
+		return it == globalSig.end() ? "" : it->second;
+	}
+	void depend(const std::string &key) {
+		if(deps != nullptr) (*deps)[key] = signature(key);
+	}
 	void newConst(const std::string &name, int imm) {
 		rec.back().recConst.emplace(name, imm);
 	}
+	void newShape(const std::string &name, const ArrayShape &shape) {
+		rec.back().recShape[name] = shape;
+	}
+	const ArrayShape *findShape(const std::string &name) {	// nullptr if not an array
+		for(int i = (int)rec.size() - 1; i >= 0; -- i) {
+			if(rec[i].recVar.find(name) != rec[i].recVar.end()) {
+				if(i == 0) depend("v:" + name);
+				auto it = rec[i].recShape.find(name);
+				return it == rec[i].recShape.end() ? nullptr : &it->second;
+			}
+			if(rec[i].recConst.find(name) != rec[i].recConst.end()) return nullptr;
+		}
+		return nullptr;
+	}
 	MIRRet find(const std::string &name) {
 		std::cerr << "find " << name << '\n';
 		for(int i = (int)rec.size() - 1; i >= 0; -- i) {
+			if(i == 0) depend("v:" + name);
 			auto it = rec[i].recVar.find(name);
 			if(it != rec[i].recVar.end()) 
 				return MIRRet(nullptr, it->second);
@@ -78,6 +190,13 @@ static DomainManager domainMgr;
 static std::map<std::string, FuncDef*> funcMgr;
 
 std::vector<StmtVarDef*> globVarsToInit;
+static std::map<std::string, int> globStaticVals;		// global scalar variables not in globVarsToInit
+
+// Before main, where global initializers run: the global variables still hold their static values,
+// unless an initializer already ran code at run time
+static bool AtStartup() {
+	return domainMgr.rec.size() == 1 && globVarsToInit.empty();
+}
 
 static BlockInfo *NewBlockInfo() {
 	auto block = new BlockInfo;
@@ -87,7 +206,7 @@ static BlockInfo *NewBlockInfo() {
 }
 static BlockInfo *GetLastBlock(std::vector<MIRInfo*> *buf) {
 	assert(! buf->empty());
-	return dynamic_cast<BlockInfo*>(buf->back());
+	return static_cast<BlockInfo*>(buf->back());	// buf only ever holds blocks
 }
 static StmtInfo *GenJump(const std::string &name){
 	auto stmtJump = new StmtInfo;
@@ -101,11 +220,151 @@ static std::size_t LinkedSize(const T *obj) {
 	std::size_t ret = 0;
 	while(obj != nullptr) {
 		++ ret;
-		obj = dynamic_cast<T*>(obj->next.get());
+		obj = As<T>(obj->next.get());
 	}
 	return ret;
 }
 
+static std::vector<std::size_t> CalcDims(const std::vector<PtrAST> &dims) {
+	std::vector<std::size_t> ret;
+	for(auto &d: dims) {
+		int len = d->Calc();
+		if(len <= 0) throw sysy_error("array length must be positive, got " + std::to_string(len));
+		ret.emplace_back(len);
+	}
+	return ret;
+}
+
+static std::size_t ProductOf(const std::vector<std::size_t> &dims, std::size_t from = 0) {
+	std::size_t ret = 1;
+	for(std::size_t i = from; i < dims.size(); ++ i) ret *= dims[i];
+	return ret;
+}
+
+// [[i32, dims[n-1]], ..., dims[from]]
+static TypeInfo *ArrayTypeOf(const std::vector<std::size_t> &dims, std::size_t from = 0) {
+	auto ret = new TypeInfo(TT_INT32);
+	for(std::size_t i = dims.size(); i > from; -- i) ret = TypeInfo::Array(ret, dims[i - 1]);
+	return ret;
+}
+
+/*
+	Flattens an initializer of an array by the rules of SysY: a nested
+	list initializes the largest sub-array aligned at the current position.
+	Only the given elements are listed, by increasing position.
+*/
+using FlatInit = std::vector<std::pair<std::size_t, const BaseAST*> >;
+static void FlattenInit(const BaseAST *init, const std::vector<std::size_t> &dims, std::size_t d,
+						std::size_t pos, FlatInit &flat) {
+	if(init->kind != AST_K_INITLIST) {
+		if(d != dims.size()) throw sysy_error("a scalar can't initialize an array");
+		flat.emplace_back(pos, init);
+		return ;
+	}
+	std::size_t end = pos + ProductOf(dims, d), crt = pos;
+	for(auto &item: As<InitList>(init)->items) {
+		if(crt >= end) throw sysy_error("too many initializers for array");
+		if(item->kind != AST_K_INITLIST) {
+			flat.emplace_back(crt ++, item.get());
+			continue;
+		}
+		std::size_t sub = d + 1;
+		while(sub < dims.size() && (crt - pos) % ProductOf(dims, sub) != 0) ++ sub;
+		if(sub == dims.size()) throw sysy_error("initializer list isn't aligned to a sub-array");
+		FlattenInit(item.get(), dims, sub, crt, flat);
+		crt += ProductOf(dims, sub);
+	}
+}
+
+// Groups the non-zero elements, sorted by position, into runs
+static InitializerInfo *MakeInitializer(const std::vector<std::pair<std::size_t, int> > &vals,
+										const std::vector<std::size_t> &dims) {
+	auto ret = new InitializerInfo;
+	ret->tag = IT_ZERO;
+	for(auto &[pos, val]: vals) {
+		if(val == 0) continue;
+		ret->tag = IT_RUNS;
+		auto &runs = ret->runs;
+		if(runs.empty() || runs.back().first + runs.back().second.size() != pos)
+			runs.emplace_back(pos, std::vector<int>());
+		runs.back().second.emplace_back(val);
+	}
+	if(ret->tag == IT_RUNS) ret->dims = dims;
+	return ret;
+}
+
+// Calculates a constant array initializer
+static std::vector<std::pair<std::size_t, int> > ConstArrayValues(const BaseAST *init,
+																  const std::vector<std::size_t> &dims) {
+	FlatInit flat;
+	std::vector<std::pair<std::size_t, int> > vals;
+	if(init != nullptr) FlattenInit(init, dims, 0, 0, flat);
+	for(auto &[pos, item]: flat)
+		if(int val = item->Calc(); val != 0) vals.emplace_back(pos, val);
+	return vals;
+}
+
+static std::string GenGetPtr(std::vector<MIRInfo*> *buf, SymbolDefTag tag, const std::string &src,
+							 ValueInfo *index, TypeInfo *base) {
+	auto stmt = new StmtInfo;
+	stmt->tag = ST_SYMDEF;
+	stmt->symdef.tag = tag;
+	stmt->symdef.name = new std::string(GetTmp());
+	stmt->symdef.ptr.src = new std::string(src);
+	stmt->symdef.ptr.index = index;
+	stmt->symdef.ptr.base = base;
+	GetLastBlock(buf) -> stmt.emplace_back(stmt);
+	return *stmt->symdef.name;
+}
+
+static std::string GenLoad(std::vector<MIRInfo*> *buf, const std::string &src) {
+	auto stmt = new StmtInfo;
+	stmt->tag = ST_SYMDEF;
+	stmt->symdef.tag = SDT_LOAD;
+	stmt->symdef.name = new std::string(GetTmp());
+	stmt->symdef.load = new std::string(src);
+	GetLastBlock(buf) -> stmt.emplace_back(stmt);
+	return *stmt->symdef.name;
+}
+
+static void GenStore(std::vector<MIRInfo*> *buf, ValueInfo *val, const std::string &addr) {
+	auto stmt = new StmtInfo;
+	stmt->tag = ST_STORE;
+	stmt->store.isValue = true;
+	stmt->store.val = val;
+	stmt->store.addr = new std::string(addr);
+	GetLastBlock(buf) -> stmt.emplace_back(stmt);
+}
+
+/*
+	Walks the indices of an array lvalue with getptr/getelemptr and returns
+	the pointer reached. `full` tells whether every dimension is indexed,
+	i.e. the pointer points to a single int.
+*/
+static std::string ArrayElemPtr(const LVal *lval, const std::string &var, const ArrayShape &shape,
+								std::vector<MIRInfo*> *buf, bool &full, std::size_t &crt) {
+	auto &dims = shape.dims;
+	std::size_t total = dims.size() + (shape.pointer ? 1 : 0);
+	if(lval->index.size() > total) throw sysy_error("too many indices for array " + lval->ident);
+	std::string ptr = var;
+	std::size_t k = 0;
+	crt = 0;		// ptr points to ArrayTypeOf(dims, crt)
+	if(shape.pointer) {
+		ptr = GenLoad(buf, var);
+		if(!lval->index.empty()) {
+			ptr = GenGetPtr(buf, SDT_GETPTR, ptr, genValue(lval->index[0]->DumpMIR(buf)), ArrayTypeOf(dims));
+			k = 1;
+		}
+	}
+	for(; k < lval->index.size(); ++ k) {
+		auto idx = genValue(lval->index[k]->DumpMIR(buf));
+		++ crt;
+		ptr = GenGetPtr(buf, SDT_GETELEMPTR, ptr, idx, ArrayTypeOf(dims, crt));
+	}
+	full = lval->index.size() == total;
+	return ptr;
+}
+
 void CompUnit::Dump(std::ostream &out) const {
 	out << "CompUnit { ";
 	for(std::size_t i = 0; i < glob_def.size(); ++ i) {
@@ -114,14 +373,86 @@ void CompUnit::Dump(std::ostream &out) const {
 	}
 	out << " }";
 }
+static std::string DimsSig(const std::vector<std::size_t> &dims) {
+	std::string ret;
+	for(auto d: dims) ret += "[" + std::to_string(d) + "]";
+	return ret;
+}
+
+// The cached MIR of a function, if every global it looked up still resolves the same way
+static FuncInfo *ReuseFunction(const std::string &entry) {
+	std::istringstream in(entry);
+	std::size_t count;
+	if(!(in >> count) || in.get() != '\n') return nullptr;
+	for(std::size_t i = 0; i < count; ++ i) {
+		std::string key, sig;
+		if(!std::getline(in, key, '\t') || !std::getline(in, sig)) return nullptr;
+		if(domainMgr.signature(key) != sig) return nullptr;
+	}
+	std::size_t pos = in.tellg();
+	ProgramInfo *prog;
+	try {
+		prog = BinaryToProgram(entry.data() + pos, entry.size() - pos);
+	}
+	catch(const sysy_error &) {
+		return nullptr;
+	}
+	FuncInfo *func = nullptr;
+	if(prog->funcs.len == 1) std::swap(func, prog->funcs[0]);
+	delete prog;
+	return func;
+}
+
+/*
+	With a cache directory, the MIR of each function is kept under the hash
+	of its subtree (for main, also of the global initializers it runs),
+	along with the global symbols its lowering looked up. Since temps,
+	blocks and locals are numbered within the function, the entry stays
+	valid for as long as those globals do, whatever else changes.
+
+	  <#deps>\n  <key>\t<signature>\n ...  <binary MIR of the function alone>
+*/
+static FuncInfo *LowerFunction(FuncDef *func) {
+	if(cacheDir.empty()) return static_cast<FuncInfo*>(func->DumpMIR(nullptr).mir);
+
+	std::ostringstream subtree;
+	subtree << *func;
+	if(func->ident == "main")
+		for(auto stmt: globVarsToInit) subtree << ", " << stmt->name << " = " << *stmt->expr;
+	auto key = CacheKey(subtree.str(), "func", {});
+	std::string entry;
+	if(CacheLoad(cacheDir, key, "fmir", entry))
+		if(auto mir = ReuseFunction(entry)) {
+			domainMgr.globalSig["b:" + func->ident] = CacheKey(entry, "body", {});
+			return mir;
+		}
+
+	std::map<std::string, std::string> deps;
+	domainMgr.deps = &deps;
+	auto mir = static_cast<FuncInfo*>(func->DumpMIR(nullptr).mir);
+	domainMgr.deps = nullptr;
+
+	entry = std::to_string(deps.size()) + "\n";
+	for(auto &[name, sig]: deps) entry += name + "\t" + sig + "\n";
+	ProgramInfo prog;
+	prog.vars.init(0);
+	prog.funcs.init(1);
+	prog.funcs[0] = mir;
+	entry += ProgramToBinary(&prog);
+	prog.funcs[0] = nullptr;
+	CacheStore(cacheDir, key, "fmir", entry);
+	domainMgr.globalSig["b:" + func->ident] = CacheKey(entry, "body", {});
+	return mir;
+}
+
 MIRRet CompUnit::DumpMIR(std::vector<MIRInfo*>*) const {
 	std::vector<FuncDef*> func_lib = {
 		new FuncDef(new BType("int"), "getint", {}),
 		new FuncDef(new BType("int"), "getch", {}),
-		// new FuncDef(new BType("int"), "getarray", {}),
+		new FuncDef(new BType("int"), "getarray", {new BType{"int"}}),
 		new FuncDef(new BType("void"), "putint", {new BType{"int"}}),
 		new FuncDef(new BType("void"), "putch", {new BType{"int"}}),
-		// new FuncDef(new BType("void"), "putarray", {new BType{"int"}, }),
+		new FuncDef(new BType("void"), "putarray", {new BType{"int"}, new BType{"int"}}),
 		new FuncDef(new BType("void"), "starttime", {}),
 		new FuncDef(new BType("void"), "stoptime", {})
 	};
@@ -132,8 +463,12 @@ MIRRet CompUnit::DumpMIR(std::vector<MIRInfo*>*) const {
 		auto &detail = item.second;
 		if(tag == AST_GT_FUNC) ++ countFunc;
 		else if(tag == AST_GT_VAR)
-			countVar += LinkedSize( dynamic_cast<StmtVarDef*>(
-				dynamic_cast<Stmt*>(detail.get())->detail.get()) );
+			countVar += LinkedSize(As<StmtVarDef>(As<Stmt>(detail.get())->detail.get()));
+		else if(tag == AST_GT_CONST) {	// const arrays are stored in memory
+			auto stmt = As<StmtConstDef>(As<Stmt>(detail.get())->detail.get());
+			for(; stmt != nullptr; stmt = As<StmtConstDef>(stmt->next.get()))
+				if(!stmt->dims.empty()) ++ countVar;
+		}
 	}
 
 	std::cerr << "countVar = " << countVar << '\n';
@@ -148,6 +483,27 @@ MIRRet CompUnit::DumpMIR(std::vector<MIRInfo*>*) const {
 	for(std::size_t i = 0; i < func_lib.size(); ++ i) {
 		auto func = func_lib[i];
 		funcMgr[func -> ident] = func;
+		domainMgr.globalSig["f:" + func->ident] = As<BType>(func->func_type.get())->type;
+		domainMgr.globalSig["n:" + func->ident] = "1";
+	}
+	// every global name up front, so that no local is named like a global declared later
+	for(auto &item: glob_def) {
+		if(item.first == AST_GT_FUNC) {
+			domainMgr.globalSig["n:" + As<FuncDef>(item.second.get())->ident] = "1";
+			continue;
+		}
+		for(auto stmt = As<Stmt>(item.second.get())->detail.get(); stmt != nullptr;) {
+			if(stmt->kind == AST_K_VARDEF) {
+				auto var = As<StmtVarDef>(stmt);
+				domainMgr.globalSig["n:" + var->name] = "1";
+				stmt = var->next.get();
+			}
+			else {
+				auto def = As<StmtConstDef>(stmt);
+				domainMgr.globalSig["n:" + def->name] = "1";
+				stmt = def->next.get();
+			}
+		}
 	}
 
 	for(auto &item: glob_def) {
@@ -155,19 +511,43 @@ MIRRet CompUnit::DumpMIR(std::vector<MIRInfo*>*) const {
 		auto &detail = item.second;
 		switch(tag) {
 			case AST_GT_FUNC: {
-				auto func = dynamic_cast<FuncDef*>(detail.get());
+				auto func = As<FuncDef>(detail.get());
 				funcMgr[func->ident] = func;
-				tmp -> funcs[countFunc] = dynamic_cast<FuncInfo*>(detail -> DumpMIR(nullptr).mir);
+				domainMgr.globalSig["f:" + func->ident] = As<BType>(func->func_type.get())->type;
+				tmp -> funcs[countFunc] = LowerFunction(func);
+				EvalAddFunction(tmp->funcs[countFunc]);
 				++ countFunc;
 				break;
 			}
-			case AST_GT_CONST:
-				detail->DumpMIR(nullptr);
+			case AST_GT_CONST: {
+				auto stmt = As<StmtConstDef>(As<Stmt>(detail.get())->detail.get());
+				for(; stmt != nullptr; stmt = As<StmtConstDef>(stmt->next.get())) {
+					if(stmt->dims.empty()) {
+						int val = stmt->expr->Calc();
+						domainMgr.newConst(stmt->name, val);
+						domainMgr.globalSig["v:" + stmt->name] = "const " + std::to_string(val);
+						continue;
+					}
+					auto dims = CalcDims(stmt->dims);
+					auto var = new VarInfo;
+					var->name = domainMgr.newVar(stmt->name);
+					var->type = ArrayTypeOf(dims);
+					auto vals = ConstArrayValues(stmt->expr.get(), dims);
+					std::string sig = "const" + DimsSig(dims);
+					for(auto &[pos, val]: vals) sig += " " + std::to_string(pos) + ":" + std::to_string(val);
+					domainMgr.globalSig["v:" + stmt->name] = sig;
+					var->init = MakeInitializer(vals, dims);
+					domainMgr.newShape(stmt->name, ArrayShape{false, dims, true, vals});
+					EvalAddGlobal(var, true, false);
+					tmp->vars[countVar] = var;
+					++ countVar;
+				}
 				break;
+			}
 			case AST_GT_VAR: {
 				std::vector<StmtVarDef*> stmts;
-				for(auto stmt = dynamic_cast<Stmt*>(detail.get())->detail.get(); stmt != nullptr;) {
-					auto ptr = dynamic_cast<StmtVarDef*>(stmt);
+				for(auto stmt = As<Stmt>(detail.get())->detail.get(); stmt != nullptr;) {
+					auto ptr = As<StmtVarDef>(stmt);
 					stmts.emplace_back(ptr);
 					if(ptr->next == nullptr) break;
 					stmt = ptr->next.get();
@@ -175,23 +555,38 @@ MIRRet CompUnit::DumpMIR(std::vector<MIRInfo*>*) const {
 				for(auto stmt: stmts) {
 					auto var = new VarInfo;
 					var->name = domainMgr.newVar(stmt->name);
-					var->type = dynamic_cast<TypeInfo*>(stmt->type->DumpMIR(nullptr).mir);
+					domainMgr.globalSig["v:" + stmt->name] = "var";
+					if(!stmt->dims.empty()) {
+						auto dims = CalcDims(stmt->dims);
+						domainMgr.globalSig["v:" + stmt->name] += DimsSig(dims);
+						var->type = ArrayTypeOf(dims);
+						auto vals = ConstArrayValues(stmt->expr.get(), dims);
+						var->init = MakeInitializer(vals, dims);
+						domainMgr.newShape(stmt->name, ArrayShape{false, dims, false, vals});
+						EvalAddGlobal(var, false, false);
+						tmp->vars[countVar] = var;
+						++ countVar;
+						continue;
+					}
+					var->type = static_cast<TypeInfo*>(stmt->type->DumpMIR(nullptr).mir);
 					var->init = new InitializerInfo;
 					if(stmt->expr == nullptr) {
 						var->init->tag = IT_ZERO;
 					}
-					else if(stmt->expr->isConst()) {
-						int result = stmt->expr->Calc();
-						if(result == 0) var->init->tag = IT_ZERO;
+					else if(auto result = stmt->expr->Fold()) {
+						if(*result == 0) var->init->tag = IT_ZERO;
 						else {
 							var->init->tag = IT_NUM;
-							var->init->num = result;
+							var->init->num = *result;
 						}
 					}
 					else {
 						var->init->tag = IT_ZERO;
 						globVarsToInit.emplace_back(stmt);
 					}
+					bool dynamic = !globVarsToInit.empty() && globVarsToInit.back() == stmt;
+					if(!dynamic) globStaticVals[stmt->name] = var->init->tag == IT_NUM ? var->init->num : 0;
+					EvalAddGlobal(var, false, dynamic);
 					tmp->vars[countVar] = var;
 					++ countVar;
 				}
@@ -205,7 +600,16 @@ MIRRet CompUnit::DumpMIR(std::vector<MIRInfo*>*) const {
 }
 
 void FuncParam::Dump(std::ostream &out) const {
-	out << "FuncParam { " << *type << ", " << name << " }";
+	out << "FuncParam { " << *type << ", " << name;
+	if(isArray) {
+		out << "[]";
+		for(auto &d: dims) out << "[" << *d << "]";
+	}
+	out << " }";
+}
+TypeInfo *FuncParam::GetType() const {
+	if(!isArray) return static_cast<TypeInfo*>(type->DumpMIR(nullptr).mir);
+	return TypeInfo::Pointer(ArrayTypeOf(CalcDims(dims)));
 }
 MIRRet FuncParam::DumpMIR(std::vector<MIRInfo*>*) const {
 	return MIRRet();
@@ -220,6 +624,8 @@ void FuncDef::Dump(std::ostream &out) const {
 	out << " ], " << ident << ", " << *block << " }";
 }
 MIRRet FuncDef::DumpMIR(std::vector<MIRInfo*>*) const {
+	cntTmp = cntBlock = 0;
+	domainMgr.enterFunc();
 	auto blkEntry = NewBlockInfo();
 
 	std::vector<MIRInfo*> buf(1, blkEntry);
@@ -242,15 +648,16 @@ MIRRet FuncDef::DumpMIR(std::vector<MIRInfo*>*) const {
 	}
 
 	for(std::size_t i = 0; i < params.size(); ++ i) {
-		auto para = dynamic_cast<FuncParam*>(params[i].get());
+		auto para = As<FuncParam>(params[i].get());
 		domainMgr.newVar(para->name);
 
 		auto stmtDef = new StmtInfo;
 		stmtDef->tag = ST_SYMDEF;
 		stmtDef->symdef.tag = SDT_ALLOC;
 		stmtDef->symdef.name = new std::string(domainMgr.find(para->name).res);
-		stmtDef->symdef.alloc = dynamic_cast<TypeInfo*>(para->type->DumpMIR(nullptr).mir);
+		stmtDef->symdef.alloc = para->GetType();
 		GetLastBlock(&buf) -> stmt.emplace_back(stmtDef);
+		if(para->isArray) domainMgr.newShape(para->name, ArrayShape{true, CalcDims(para->dims), false, {}});
 
 		auto stmtInit = new StmtInfo;
 		stmtInit->tag = ST_STORE;
@@ -266,7 +673,7 @@ MIRRet FuncDef::DumpMIR(std::vector<MIRInfo*>*) const {
 		auto stmtRet = new StmtInfo;
 		stmtRet->tag = ST_RETURN;
 		stmtRet->ret.val = nullptr;
-		if(	dynamic_cast<BType*>(func_type.get()) -> type != "void") {
+		if(As<BType>(func_type.get()) -> type != "void") {
 			std::cerr << "[Warning] Maybe control reaches end of non-void function.\n";
 			stmtRet->ret.val = new ValueInfo(0);
 		}
@@ -274,18 +681,18 @@ MIRRet FuncDef::DumpMIR(std::vector<MIRInfo*>*) const {
 	}
 
 	auto tmp = new FuncInfo;
-	tmp -> ret = dynamic_cast<TypeInfo*>(func_type -> DumpMIR(nullptr).mir);
+	tmp -> ret = static_cast<TypeInfo*>(func_type -> DumpMIR(nullptr).mir);
 	tmp -> name = ident;
 	tmp -> params = std::vector<VarInfo*>(params.size(), nullptr);
 	tmp -> block = std::vector<BlockInfo*>(buf.size(), nullptr);
 
 	for(std::size_t i = 0; i < buf.size(); ++ i)
-		tmp -> block[i] = dynamic_cast<BlockInfo*>(buf[i]);
+		tmp -> block[i] = static_cast<BlockInfo*>(buf[i]);
 	for(std::size_t i = 0; i < params.size(); ++ i) {
 		auto var = new VarInfo;
-		auto p =  dynamic_cast<FuncParam*>(params[i].get());
+		auto p = As<FuncParam>(params[i].get());
 		var -> name = param_init[i];
-		var -> type = dynamic_cast<TypeInfo*>(p -> type -> DumpMIR(nullptr).mir);
+		var -> type = p -> GetType();
 		var -> init = nullptr;
 		tmp -> params[i] = var;
 	}
@@ -337,19 +744,39 @@ void FunCall::Dump(std::ostream &out) const {
 	for(const auto &p: params) out << ", " << *p ;
 	out << " }";
 }
-bool FunCall::isConst() const {
-	return false;	// TOFIX
-}
-int FunCall::Calc() const {
-	std::cerr << "[Error] Const functions aren't supported yet.\n";
-	abort();
-	return 0;
+/*
+	A call to a pure function with constant arguments is evaluated by the
+	interpreter (see EvalCall). Before main, as in a global initializer, it
+	may read the variables initialized so far, unless one was initialized
+	at run time, which may have had side effects.
+*/
+std::optional<int> FunCall::Fold() const {
+	if(folded) return value;
+	folded = true;
+	auto callee = funcMgr.find(func);
+	if(callee == funcMgr.end() || callee->second->block == nullptr) return value;
+	if(As<BType>(callee->second->func_type.get())->type == "void") return value;
+	for(auto &p: callee->second->params)
+		if(As<FuncParam>(p.get())->isArray) return value;
+	std::vector<int> args;
+	for(auto &p: params) {
+		auto arg = p->Fold();
+		if(!arg) return value;
+		args.emplace_back(*arg);
+	}
+	std::vector<std::string> called;
+	value = EvalCall(func, args, AtStartup(), called);
+	domainMgr.depend("b:" + func);
+	for(auto &name: called) domainMgr.depend("b:" + name);
+	return value;
 }
 MIRRet FunCall::DumpMIR(std::vector<MIRInfo*> *buf) const {
+	if(auto val = Fold()) return MIRRet(nullptr, *val);
 	auto stmt = new StmtInfo;
 	stmt->tag = ST_SYMDEF;
 	stmt->symdef.tag = SDT_FUNCALL;
-	if( dynamic_cast<BType*>(funcMgr[func]->func_type.get()) -> type != "void")
+	domainMgr.depend("f:" + func);
+	if(As<BType>(funcMgr[func]->func_type.get()) -> type != "void")
 		stmt->symdef.name = new std::string(GetTmp());
 	else
 		stmt->symdef.name = new std::string("");
@@ -366,32 +793,54 @@ void Expr::Dump(std::ostream &out) const {
 	if(IsUnaryOperator(op)) out << OperatorStr(op) << " { " << *left << " }";
 	else out << OperatorStr(op) << " { " << *left << ", " << *right << " }";
 }
-bool Expr::isConst() const {
-	if(IsUnaryOperator(op)) return left->isConst();
-	else return left->isConst() && right->isConst();
-}
-int Expr::Calc() const {
+/*
+	Folds bottom-up and keeps the result, so that neither repeated queries
+	nor the lowering of enclosing expressions walk the subtree again.
+	Arithmetic wraps around as on the target; a division by zero or of
+	INT_MIN by -1 is left to run time. "0 && e" and "1 || e" fold whatever
+	e is, as e is never evaluated.
+*/
+std::optional<int> Expr::Fold() const {
+	if(folded) return value;
+	folded = true;
+	auto l = left->Fold();
+	if(op == OP_LAND || op == OP_LOR) {
+		if(l && (*l != 0) == (op == OP_LOR)) return value = int(op == OP_LOR);
+		auto r = right->Fold();
+		if(l && r) value = int(*r != 0);
+		return value;
+	}
+	if(IsUnaryOperator(op)) {
+		if(!l) return value;
+		if(op == OP_POS) value = *l;
+		else if(op == OP_NEG) value = int(0u - unsigned(*l));
+		else value = int(!*l);
+		return value;
+	}
+	auto r = right->Fold();
+	if(!l || !r) return value;
+	int a = *l, b = *r;
 	switch(op) {
-		case OP_POS:  return  left->Calc();
-		case OP_NEG:  return -left->Calc();
-		case OP_LNOT: return !left->Calc();
-		case OP_MUL:  return left->Calc() *  right->Calc();
-		case OP_DIV:  return left->Calc() /  right->Calc();
-		case OP_MOD:  return left->Calc() %  right->Calc();
-		case OP_ADD:  return left->Calc() +  right->Calc();
-		case OP_SUB:  return left->Calc() -  right->Calc();
-		case OP_LE:   return left->Calc() <= right->Calc();
-		case OP_GE:   return left->Calc() >= right->Calc();
-		case OP_LT:   return left->Calc() <  right->Calc();
-		case OP_GT:   return left->Calc() >  right->Calc();
-		case OP_EQ:   return left->Calc() == right->Calc();
-		case OP_NEQ:  return left->Calc() != right->Calc();
-		case OP_LAND: return left->Calc() && right->Calc();
-		case OP_LOR:  return left->Calc() || right->Calc();
-	}
-	__builtin_unreachable();
+		case OP_MUL: value = int(unsigned(a) * unsigned(b)); break;
+		case OP_DIV:
+		case OP_MOD:
+			if(b == 0 || (a == INT_MIN && b == -1)) break;
+			value = op == OP_DIV ? a / b : a % b;
+			break;
+		case OP_ADD: value = int(unsigned(a) + unsigned(b)); break;
+		case OP_SUB: value = int(unsigned(a) - unsigned(b)); break;
+		case OP_LE:  value = a <= b; break;
+		case OP_GE:  value = a >= b; break;
+		case OP_LT:  value = a <  b; break;
+		case OP_GT:  value = a >  b; break;
+		case OP_EQ:  value = a == b; break;
+		case OP_NEQ: value = a != b; break;
+		default: break;
+	}
+	return value;
 }
 MIRRet Expr::DumpMIR(std::vector<MIRInfo*> *buf) const {		// Dump Expr to vector<BlockInfo*>
+	if(auto val = Fold()) return MIRRet(nullptr, *val);
 	if(op == OP_POS) return left->DumpMIR(buf);
 	std::string crt;
 	
@@ -491,33 +940,52 @@ MIRRet Expr::DumpMIR(std::vector<MIRInfo*> *buf) const {		// Dump Expr to vector
 }
 
 void LVal::Dump(std::ostream &out) const {
-	out << "LVal { " << ident << " }";
-}
-bool LVal::isConst() const {
-	return false;
+	out << "LVal { " << ident;
+	for(auto &i: index) out << "[" << *i << "]";
+	out << " }";
 }
-int LVal::Calc() const {
-	auto found = domainMgr.find(ident);
-	assert(found.isImm);
-	return found.imm;
+// A const scalar, or an element of a const array at constant indices within its bounds;
+// at start-up, a global variable as well
+std::optional<int> LVal::Fold() const {
+	if(folded) return value;
+	folded = true;
+	if(index.empty()) {
+		auto found = domainMgr.find(ident);
+		if(found.isImm) value = found.imm;
+		else if(auto it = globStaticVals.find(ident); it != globStaticVals.end() && AtStartup()) value = it->second;
+		return value;
+	}
+	auto shape = domainMgr.findShape(ident);
+	if(shape == nullptr || !(shape->constant || AtStartup()) || index.size() != shape->dims.size()) return value;
+	std::size_t pos = 0;
+	for(std::size_t i = 0; i < index.size(); ++ i) {
+		auto idx = index[i]->Fold();
+		if(!idx || *idx < 0 || std::size_t(*idx) >= shape->dims[i]) return value;
+		pos = pos * shape->dims[i] + *idx;
+	}
+	auto it = std::lower_bound(shape->vals.begin(), shape->vals.end(), std::make_pair(pos, INT_MIN));
+	value = it != shape->vals.end() && it->first == pos ? it->second : 0;
+	return value;
 }
 MIRRet LVal::DumpMIR(std::vector<MIRInfo*> *buf) const {		// Dump LVal to vector<StmtInfo*>
+	if(auto val = Fold()) return MIRRet(nullptr, *val);
 	auto found = domainMgr.find(ident);
-	if(found.isImm) return found;
-	else {
-		auto tmp = new StmtInfo;
-		tmp->tag = ST_SYMDEF;
-		tmp->symdef.tag = SDT_LOAD;
-		tmp->symdef.name = new std::string(GetTmp());
-		tmp->symdef.load = new std::string(found.res);
-		GetLastBlock(buf) -> stmt.emplace_back(tmp);
-		return MIRRet(nullptr, *tmp->symdef.name);
-	}
+	auto shape = domainMgr.findShape(ident);
+	if(shape == nullptr) return MIRRet(nullptr, GenLoad(buf, found.res));
+
+	bool full;
+	std::size_t crt;
+	auto ptr = ArrayElemPtr(this, found.res, *shape, buf, full, crt);
+	if(full) return MIRRet(nullptr, GenLoad(buf, ptr));
+	if(shape->pointer && index.empty()) return MIRRet(nullptr, ptr);
+	// An array decays to a pointer to its first element
+	return MIRRet(nullptr, GenGetPtr(buf, SDT_GETELEMPTR, ptr, new ValueInfo(0), ArrayTypeOf(shape->dims, crt + 1)));
 }
 
 void Stmt::Dump(std::ostream &out) const {
 	out << "Stmt";
 	if(tag == AST_ST_ELSE) out << " (ELSE)";
+	else if(tag == AST_ST_WHILE) out << " (WHILE)";
 	else if(tag == AST_ST_BREAK) out << " (BREAK)";
 	else if(tag == AST_ST_CONTINUE) out << " (CONTINUE)";
 	if(detail != nullptr)
@@ -548,7 +1016,7 @@ MIRRet Stmt::DumpMIR(std::vector<MIRInfo*> *buf) const {		// Dump Stmt to vector
 			break;
 		case AST_ST_IF: {
 			assert(detail != nullptr);
-			StmtIf *realDetail = dynamic_cast<StmtIf*>(detail.get());
+			auto realDetail = As<StmtIf>(detail.get());
 			auto cond = genValue(realDetail -> expr -> DumpMIR(buf));
 			auto crtBlock = GetLastBlock(buf);
 
@@ -574,7 +1042,7 @@ MIRRet Stmt::DumpMIR(std::vector<MIRInfo*> *buf) const {		// Dump Stmt to vector
 				buf->emplace_back(blkElse);
 				
 				domainMgr.push();
-				dynamic_cast<Stmt*>(realDetail->match.get()) -> DumpMIR(buf);
+				As<Stmt>(realDetail->match.get()) -> DumpMIR(buf);
 				domainMgr.pop();
 				if(! GetLastBlock(buf)->closed())
 					GetLastBlock(buf) -> stmt.emplace_back(GenJump(blkNext->name));
@@ -591,7 +1059,7 @@ MIRRet Stmt::DumpMIR(std::vector<MIRInfo*> *buf) const {		// Dump Stmt to vector
 			auto blkRun = NewBlockInfo();
 			auto blkEnd = NewBlockInfo();
 			
-			StmtIf *realDetail = dynamic_cast<StmtIf*>(detail.get());
+			auto realDetail = As<StmtIf>(detail.get());
 			auto stmtEntry = new StmtInfo;
 			stmtEntry->tag = ST_JUMP;
 			stmtEntry->jump.blkThen = new std::string(blkCheck->name);
@@ -633,10 +1101,10 @@ MIRRet StmtIf::DumpMIR(std::vector<MIRInfo*> *) const {
 	return MIRRet();
 }
 bool StmtIf::tryMatch(Stmt *stmtElse) {
-	auto realStmt = dynamic_cast<Stmt*>(stmt.get());
+	auto realStmt = As<Stmt>(stmt.get());
 	bool matched = false;
 	if(realStmt->tag == AST_ST_IF) {
-		auto realStmtIf = dynamic_cast<StmtIf*>(realStmt->detail.get());
+		auto realStmtIf = As<StmtIf>(realStmt->detail.get());
 		if(realStmtIf->tryMatch(stmtElse))
 			matched = true;
 	}
@@ -648,18 +1116,60 @@ bool StmtIf::tryMatch(Stmt *stmtElse) {
 		}
 		else {
 			std::cerr << "Try 2\n";
-			auto realElseStmt = dynamic_cast<Stmt*>(dynamic_cast<Stmt*>(match.get())->detail.get());
+			auto realElseStmt = As<Stmt>(As<Stmt>(match.get())->detail.get());
 			if(realElseStmt -> tag == AST_ST_IF && 
-			  dynamic_cast<StmtIf*>(realElseStmt->detail.get()) -> tryMatch(stmtElse) )
+			  As<StmtIf>(realElseStmt->detail.get()) -> tryMatch(stmtElse) )
 				matched =true; 
 		}
 	}
 	return matched;
 }
 
+// Stores the constant part of the initializer at once, then the rest element by element
+static void InitLocalArray(std::vector<MIRInfo*> *buf, const std::string &var,
+						   const std::vector<std::size_t> &dims, const BaseAST *init) {
+	FlatInit flat, dynamic;
+	std::vector<std::pair<std::size_t, int> > vals;
+	FlattenInit(init, dims, 0, 0, flat);
+	for(auto &[pos, item]: flat) {
+		if(auto val = item->Fold()) vals.emplace_back(pos, *val);
+		else dynamic.emplace_back(pos, item);
+	}
+	auto stmt = new StmtInfo;
+	stmt->tag = ST_STORE;
+	stmt->store.isValue = false;
+	stmt->store.init = MakeInitializer(vals, dims);
+	stmt->store.addr = new std::string(var);
+	GetLastBlock(buf) -> stmt.emplace_back(stmt);
+
+	for(auto &[pos, item]: dynamic) {
+		auto val = genValue(item->DumpMIR(buf));
+		std::string ptr = var;
+		for(std::size_t d = 0; d < dims.size(); ++ d) {
+			std::size_t idx = pos / ProductOf(dims, d + 1) % dims[d];
+			ptr = GenGetPtr(buf, SDT_GETELEMPTR, ptr, new ValueInfo(int(idx)), ArrayTypeOf(dims, d + 1));
+		}
+		GenStore(buf, val, ptr);
+	}
+}
+
+void InitList::Dump(std::ostream &out) const {
+	out << "InitList { ";
+	for(std::size_t i = 0; i < items.size(); ++ i) {
+		if(i > 0) out << ", ";
+		out << *items[i];
+	}
+	out << " }";
+}
+MIRRet InitList::DumpMIR(std::vector<MIRInfo*> *) const {
+	throw sysy_error("an initializer list isn't an expression");
+}
+
 void StmtVarDef::Dump(std::ostream &out) const {
-	if(expr == nullptr) out << "StmtVarDef { " << *type << ", " << name << ", " << "[NOTHING]" << " }";
-	else out << "StmtVarDef { " << *type << ", " << name << ", " << *expr << " }";
+	out << "StmtVarDef { " << *type << ", " << name;
+	for(auto &d: dims) out << "[" << *d << "]";
+	if(expr == nullptr) out << ", " << "[NOTHING]" << " }";
+	else out << ", " << *expr << " }";
 	if(next != nullptr) out << ", " << *next;
 }
 MIRRet StmtVarDef::DumpMIR(std::vector<MIRInfo*> *buf) const {
@@ -669,8 +1179,17 @@ MIRRet StmtVarDef::DumpMIR(std::vector<MIRInfo*> *buf) const {
 	tmp->tag = ST_SYMDEF;
 	tmp->symdef.tag = SDT_ALLOC;
 	tmp->symdef.name = new std::string(varName);
-	tmp->symdef.alloc = dynamic_cast<TypeInfo*>(type -> DumpMIR(nullptr).mir);
-	dynamic_cast<BlockInfo*>(buf->back()) -> stmt.emplace_back(tmp);
+	if(!dims.empty()) {
+		auto realDims = CalcDims(dims);
+		tmp->symdef.alloc = ArrayTypeOf(realDims);
+		GetLastBlock(buf) -> stmt.emplace_back(tmp);
+		domainMgr.newShape(name, ArrayShape{false, realDims, false, {}});
+		if(expr != nullptr) InitLocalArray(buf, varName, realDims, expr.get());
+		if(next) next->DumpMIR(buf);
+		return MIRRet();
+	}
+	tmp->symdef.alloc = static_cast<TypeInfo*>(type -> DumpMIR(nullptr).mir);
+	GetLastBlock(buf) -> stmt.emplace_back(tmp);
 	
 	if(expr != nullptr){
 		auto res = expr->DumpMIR(buf);
@@ -679,7 +1198,7 @@ MIRRet StmtVarDef::DumpMIR(std::vector<MIRInfo*> *buf) const {
 		tmp->store.isValue = true;
 		tmp->store.val = genValue(res);
 		tmp->store.addr = new std::string(varName);
-		dynamic_cast<BlockInfo*>(buf->back()) -> stmt.emplace_back(tmp);
+		GetLastBlock(buf) -> stmt.emplace_back(tmp);
 	}
 
 	if(next) next->DumpMIR(buf);
@@ -687,13 +1206,34 @@ MIRRet StmtVarDef::DumpMIR(std::vector<MIRInfo*> *buf) const {
 }
 
 void StmtConstDef::Dump(std::ostream &out) const {
-	out << "StmtConstDef { " << *type << ", " << name << ", " << *expr << " }";
+	out << "StmtConstDef { " << *type << ", " << name;
+	for(auto &d: dims) out << "[" << *d << "]";
+	out << ", " << *expr << " }";
 	if(next != nullptr) out << ", " << *next;
 }
-MIRRet StmtConstDef::DumpMIR(std::vector<MIRInfo*> *) const {
-	domainMgr.newConst(name, expr -> Calc());
+MIRRet StmtConstDef::DumpMIR(std::vector<MIRInfo*> *buf) const {
+	if(!dims.empty()) {
+		// A local const array still lives in memory, as it may be indexed by variables
+		auto realDims = CalcDims(dims);
+		auto vals = ConstArrayValues(expr.get(), realDims);
+		auto varName = domainMgr.newVar(name);
+		auto tmp = new StmtInfo;
+		tmp->tag = ST_SYMDEF;
+		tmp->symdef.tag = SDT_ALLOC;
+		tmp->symdef.name = new std::string(varName);
+		tmp->symdef.alloc = ArrayTypeOf(realDims);
+		GetLastBlock(buf) -> stmt.emplace_back(tmp);
+		tmp = new StmtInfo;
+		tmp->tag = ST_STORE;
+		tmp->store.isValue = false;
+		tmp->store.init = MakeInitializer(vals, realDims);
+		tmp->store.addr = new std::string(varName);
+		GetLastBlock(buf) -> stmt.emplace_back(tmp);
+		domainMgr.newShape(name, ArrayShape{false, realDims, true, vals});
+	}
+	else domainMgr.newConst(name, expr -> Calc());
 	// TODO: check if type is matched with the result of expr
-	if(next != nullptr) next->DumpMIR(nullptr);
+	if(next != nullptr) next->DumpMIR(buf);
 	return MIRRet();
 }
 
@@ -702,13 +1242,22 @@ void StmtAssign::Dump(std::ostream &out) const {
 }
 MIRRet StmtAssign::DumpMIR(std::vector<MIRInfo*> *buf) const {
 	auto res = expr->DumpMIR(buf);
+	auto realLVal = As<LVal>(lval.get());
+	auto found = domainMgr.find(realLVal -> ident);
+	assert( ! found.isImm );
+	std::string addr = found.res;
+	if(auto shape = domainMgr.findShape(realLVal -> ident); shape != nullptr) {
+		bool full;
+		std::size_t crt;
+		addr = ArrayElemPtr(realLVal, found.res, *shape, buf, full, crt);
+		if(!full) throw sysy_error("can't assign to array " + realLVal -> ident);
+	}
 	auto tmp = new StmtInfo;
-	assert( ! domainMgr.find(dynamic_cast<LVal*>(lval.get()) -> ident).isImm );
 	tmp -> tag = ST_STORE;
 	tmp -> store.isValue = true;
 	tmp -> store.val = genValue(res);
-	tmp -> store.addr = new std::string(domainMgr.find(dynamic_cast<LVal*>(lval.get()) -> ident).res);
-	dynamic_cast<BlockInfo*>(buf->back()) -> stmt.emplace_back(tmp);
+	tmp -> store.addr = new std::string(addr);
+	GetLastBlock(buf) -> stmt.emplace_back(tmp);
 	return MIRRet();
 }
 
@@ -719,15 +1268,14 @@ void StmtReturn::Dump(std::ostream &out) const {
 MIRRet StmtReturn::DumpMIR(std::vector<MIRInfo*> *buf) const {
 	auto tmp = new StmtInfo;
 	tmp -> tag = ST_RETURN;
-	tmp -> ret.val = genValue(expr->DumpMIR(buf));
-	dynamic_cast<BlockInfo*>(buf->back()) -> stmt.emplace_back(tmp);
+	tmp -> ret.val = expr == nullptr ? nullptr : genValue(expr->DumpMIR(buf));		// 'return;' of a void function
+	GetLastBlock(buf) -> stmt.emplace_back(tmp);
 	return MIRRet();
 }
 
 void Number::Dump(std::ostream &out) const {
 	out << val ;
 }
-int Number::Calc() const { return val; }
 MIRRet Number::DumpMIR(std::vector<MIRInfo*>*) const {
 	return MIRRet(nullptr, val);
 }
\ No newline at end of file
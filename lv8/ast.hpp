@@ -7,6 +7,7 @@
 #include <utility>
 #include <set>
 #include <map>
+#include <optional>
 #include <cassert>
 
 #include "sysy_exceptions.hpp"
@@ -49,9 +50,11 @@ static std::string OperatorStr(Operator op) {
 	return STR[op];
 }
 
-// enum ASTTag {
-	// AST_CUNIT, AST_FUNCDEF, AST_FUNCTYPE, AST_
-// };
+enum ASTKind {
+	AST_K_COMPUNIT, AST_K_FUNCPARAM, AST_K_BTYPE, AST_K_FUNCDEF, AST_K_BLOCK,
+	AST_K_FUNCALL, AST_K_EXPR, AST_K_LVAL, AST_K_NUMBER,
+	AST_K_STMT, AST_K_STMTIF, AST_K_INITLIST, AST_K_VARDEF, AST_K_CONSTDEF, AST_K_ASSIGN, AST_K_RETURN
+};
 
 enum ASTGolbTag {
 	AST_GT_FUNC, AST_GT_CONST, AST_GT_VAR
@@ -84,47 +87,78 @@ static auto genValue = [](const MIRRet &src) {
   otherwise, use DumpMIR(nullptr).mir .
 */
 
+/*
+  ## On the node kinds
+
+  Nodes carry their kind instead of a vtable: Dump, DumpMIR and Fold on a
+  BaseAST switch over it (see Visit) to the same function of the node's
+  class, and As<T> is the checked downcast.
+*/
+
 class BaseAST {
 public:
-	virtual ~BaseAST() = default;
-	// virtual ASTTag Type() const = 0;
-	virtual void Dump(std::ostream&) const = 0;
-	virtual MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const = 0;
-	virtual int Calc() const { return 0; }	// if the node is an expr, return the result
-	virtual bool isConst() const { return true; }
+	const ASTKind kind;
+	void Dump(std::ostream&) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
+	std::optional<int> Fold() const;	// the value of a constant expression
+	int Calc() const;					// the value of an expression that must be constant
+	bool isConst() const { return Fold().has_value(); }
+	template <typename F> decltype(auto) Visit(F &&f) const;	// f(*this as its class)
 	friend std::ostream &operator<< (std::ostream &stream, const BaseAST &ast) {
 		ast.Dump (stream);
 		return stream;
 	}
+	// Nodes are bump-allocated and their memory is kept until the end of the compilation
+	static void *operator new(std::size_t size);
+	static void operator delete(void *) noexcept {}
+protected:
+	BaseAST(ASTKind kind): kind{kind} {}
+	~BaseAST() = default;
 };
 
-using PtrAST = std::unique_ptr<BaseAST>;
+// Destroys a node as its class
+struct ASTDeleter {
+	void operator() (const BaseAST *ast) const;
+};
+
+using PtrAST = std::unique_ptr<BaseAST, ASTDeleter>;
 using SharedAST = std::shared_ptr<BaseAST>;
 
-class CompUnit: public BaseAST {
+template <ASTKind K>
+class ASTNode: public BaseAST {
+public:
+	static constexpr ASTKind KIND = K;
+	ASTNode(): BaseAST(K) {}
+	std::optional<int> Fold() const { return std::nullopt; }
+};
+
+class CompUnit: public ASTNode<AST_K_COMPUNIT> {
 public:
 	std::vector<std::pair<ASTGolbTag, PtrAST> > glob_def;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*>*) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*>*) const;
 };
 
-class FuncParam: public BaseAST {
+class FuncParam: public ASTNode<AST_K_FUNCPARAM> {
 public:
 	PtrAST type;
 	std::string name;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*>*) const override;
+	bool isArray;				// int name[][dims...]
+	std::vector<PtrAST> dims;	// without the first, omitted one
+	TypeInfo *GetType() const;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*>*) const;
 };
 
-class BType: public BaseAST {
+class BType: public ASTNode<AST_K_BTYPE> {
 public:
 	std::string type;
 	BType() {}
 	BType(const std::string &type): type{type} {}
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*>*) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*>*) const;
 };
-class FuncDef: public BaseAST {
+class FuncDef: public ASTNode<AST_K_FUNCDEF> {
 public:
 	PtrAST func_type;
 	std::string ident;
@@ -139,106 +173,154 @@ public:
 			params[i] = PtrAST(para[i]);
 		block = nullptr;
 	}
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*>*) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*>*) const;
 };
 
-class Block: public BaseAST {
+class Block: public ASTNode<AST_K_BLOCK> {
 public:
 	std::vector<PtrAST> stmt;
-	// bool isConst() const override;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	// bool isConst() const;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class FunCall: public BaseAST {
+class FunCall: public ASTNode<AST_K_FUNCALL> {
 public:
 	std::string func;
 	std::vector<PtrAST> params;
-	int Calc() const override;
-	bool isConst() const override;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	mutable bool folded = false;		// as in Expr
+	mutable std::optional<int> value;
+	std::optional<int> Fold() const;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class Expr: public BaseAST {
+class Expr: public ASTNode<AST_K_EXPR> {
 public:
 	Operator op;
 	PtrAST left, right;
+	mutable bool folded = false;		// Fold is computed once: a node is only ever lowered in one scope
+	mutable std::optional<int> value;
 	Expr() {}
 	Expr(Operator op, BaseAST* &&left, BaseAST* &&right): op{op}, left{left}, right{right} {}
-	int Calc() const override;
-	bool isConst() const override;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	std::optional<int> Fold() const;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class LVal: public BaseAST {
+class LVal: public ASTNode<AST_K_LVAL> {
 public:
 	std::string ident;
-	int Calc() const override;
-	bool isConst() const override;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	std::vector<PtrAST> index;
+	mutable bool folded = false;		// as in Expr
+	mutable std::optional<int> value;
+	std::optional<int> Fold() const;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class Stmt: public BaseAST {
+class Stmt: public ASTNode<AST_K_STMT> {
 public:
 	ASTStmtTag tag;
 	PtrAST detail;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *) const;
 };
 
-class StmtIf: public BaseAST {		// if, while
+class StmtIf: public ASTNode<AST_K_STMTIF> {		// if, while
 public:
 	PtrAST expr, stmt;
 	PtrAST match;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *) const;
 	bool tryMatch(Stmt *stmtElse);
 };
 
-class StmtVarDef: public BaseAST {
+class InitList: public ASTNode<AST_K_INITLIST> {	// { InitVal, ... } of an array
+public:
+	std::vector<PtrAST> items;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *) const;
+};
+
+class StmtVarDef: public ASTNode<AST_K_VARDEF> {
 public:
 	std::string name;
 	SharedAST type;
+	std::vector<PtrAST> dims;	// empty if not an array
 	PtrAST expr, next;	// if uninitialized, expr is nullptr
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class StmtConstDef: public BaseAST {
+class StmtConstDef: public ASTNode<AST_K_CONSTDEF> {
 public:
 	std::string name;
 	SharedAST type;
+	std::vector<PtrAST> dims;
 	PtrAST expr, next;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *) const;
 };
 
-class StmtAssign: public BaseAST {
+class StmtAssign: public ASTNode<AST_K_ASSIGN> {
 public:
 	PtrAST lval, expr;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class StmtReturn: public BaseAST {
+class StmtReturn: public ASTNode<AST_K_RETURN> {
 public:
 	PtrAST expr;
-	void Dump(std::ostream &out) const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const override;
+	void Dump(std::ostream &out) const;
+	MIRRet DumpMIR(std::vector<MIRInfo*> *buf) const;
 };
 
-class Number: public BaseAST {
+class Number: public ASTNode<AST_K_NUMBER> {
 public:
 	int val;
-	void Dump(std::ostream &out) const override;
-	int Calc() const override;
-	MIRRet DumpMIR(std::vector<MIRInfo*>*) const override;
+	void Dump(std::ostream &out) const;
+	std::optional<int> Fold() const { return val; }
+	MIRRet DumpMIR(std::vector<MIRInfo*>*) const;
 };
 
+template <typename F>
+decltype(auto) BaseAST::Visit(F &&f) const {
+	switch(kind) {
+		case AST_K_COMPUNIT: return f(static_cast<const CompUnit&>(*this));
+		case AST_K_FUNCPARAM: return f(static_cast<const FuncParam&>(*this));
+		case AST_K_BTYPE: return f(static_cast<const BType&>(*this));
+		case AST_K_FUNCDEF: return f(static_cast<const FuncDef&>(*this));
+		case AST_K_BLOCK: return f(static_cast<const Block&>(*this));
+		case AST_K_FUNCALL: return f(static_cast<const FunCall&>(*this));
+		case AST_K_EXPR: return f(static_cast<const Expr&>(*this));
+		case AST_K_LVAL: return f(static_cast<const LVal&>(*this));
+		case AST_K_NUMBER: return f(static_cast<const Number&>(*this));
+		case AST_K_STMT: return f(static_cast<const Stmt&>(*this));
+		case AST_K_STMTIF: return f(static_cast<const StmtIf&>(*this));
+		case AST_K_INITLIST: return f(static_cast<const InitList&>(*this));
+		case AST_K_VARDEF: return f(static_cast<const StmtVarDef&>(*this));
+		case AST_K_CONSTDEF: return f(static_cast<const StmtConstDef&>(*this));
+		case AST_K_ASSIGN: return f(static_cast<const StmtAssign&>(*this));
+		case AST_K_RETURN: return f(static_cast<const StmtReturn&>(*this));
+	}
+	__builtin_unreachable();
+}
+
+// nullptr stays nullptr
+template <typename T>
+T *As(BaseAST *ast) {
+	assert(ast == nullptr || ast->kind == T::KIND);
+	return static_cast<T*>(ast);
+}
+template <typename T>
+const T *As(const BaseAST *ast) {
+	assert(ast == nullptr || ast->kind == T::KIND);
+	return static_cast<const T*>(ast);
+}
+
 using ASTree = std::unique_ptr<CompUnit>;
 
 
@@ -0,0 +1,168 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+	On-disk compilation cache. An entry is named by the SHA-256 of
+	everything that determines the output: the source bytes, the mode, the
+	flags and the compiler itself (the hash of its executable, so any
+	rebuild invalidates the cache). Entries are written to a temporary file
+	and renamed into place, so concurrent compilers never see a partial
+	entry; two writers of the same key simply race to identical content.
+
+	  <dir>/<first 2 hex digits>/<other 62>.<ext>
+*/
+
+// Set by the driver when caching: the frontend and the backend then reuse unchanged functions
+std::string cacheDir;
+
+namespace {
+
+class Sha256 {
+public:
+	Sha256() {
+		static const std::uint32_t INIT[8] = {
+			0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+		std::memcpy(h, INIT, sizeof(h));
+	}
+
+	void Update(const void *data, std::size_t len) {
+		auto p = static_cast<const std::uint8_t*>(data);
+		total += len;
+		while(len > 0) {
+			std::size_t n = std::min(len, 64 - fill);
+			std::memcpy(buf + fill, p, n);
+			fill += n, p += n, len -= n;
+			if(fill == 64) Block(buf), fill = 0;
+		}
+	}
+	void Update(const std::string &str) {
+		// length-prefixed, so that consecutive fields can't run into each other
+		std::uint64_t len = str.size();
+		Update(&len, sizeof(len));
+		Update(str.data(), str.size());
+	}
+
+	std::string HexDigest() {
+		std::uint64_t bits = total * 8;
+		std::uint8_t pad = 0x80, zero = 0;
+		Update(&pad, 1);
+		while(fill != 56) Update(&zero, 1);
+		for(int i = 7; i >= 0; -- i) {
+			std::uint8_t byte = bits >> (i * 8);
+			Update(&byte, 1);
+		}
+		std::string ret;
+		char hex[9];
+		for(auto word: h) {
+			std::snprintf(hex, sizeof(hex), "%08x", word);
+			ret += hex;
+		}
+		return ret;
+	}
+
+private:
+	std::uint32_t h[8];
+	std::uint8_t buf[64];
+	std::size_t fill = 0;
+	std::uint64_t total = 0;
+
+	static std::uint32_t Rotr(std::uint32_t x, int n) {
+		return (x >> n) | (x << (32 - n));
+	}
+
+	void Block(const std::uint8_t *p) {
+		static const std::uint32_t K[64] = {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+		std::uint32_t w[64];
+		for(int i = 0; i < 16; ++ i)
+			w[i] = std::uint32_t(p[i * 4]) << 24 | std::uint32_t(p[i * 4 + 1]) << 16 |
+				   std::uint32_t(p[i * 4 + 2]) << 8 | std::uint32_t(p[i * 4 + 3]);
+		for(int i = 16; i < 64; ++ i) {
+			std::uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			std::uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+		std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+		for(int i = 0; i < 64; ++ i) {
+			std::uint32_t t1 = k + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+			std::uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			k = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
+		}
+		h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+	}
+};
+
+bool ReadFile(const std::string &path, std::string &data) {
+	std::ifstream fin(path, std::ios::binary);
+	if(!fin) return false;
+	std::stringstream buf;
+	buf << fin.rdbuf();
+	data = buf.str();
+	return true;
+}
+
+// Identifies the running compiler by the hash of its executable
+const std::string &CompilerVersion() {
+	static const std::string version = []() {
+		std::string exe;
+		Sha256 sha;
+		if(ReadFile("/proc/self/exe", exe)) sha.Update(exe);
+		else sha.Update(std::string(__DATE__ " " __TIME__));
+		return sha.HexDigest();
+	}();
+	return version;
+}
+
+std::string EntryPath(const std::string &dir, const std::string &key, const std::string &ext) {
+	return dir + "/" + key.substr(0, 2) + "/" + key.substr(2) + "." + ext;
+}
+
+}
+
+std::string CacheKey(const std::string &source, const std::string &mode, const std::vector<std::string> &flags) {
+	Sha256 sha;
+	sha.Update(CompilerVersion());
+	sha.Update(source);
+	sha.Update(mode);
+	for(auto &flag: flags) sha.Update(flag);
+	return sha.HexDigest();
+}
+
+bool CacheLoad(const std::string &dir, const std::string &key, const std::string &ext, std::string &data) {
+	return ReadFile(EntryPath(dir, key, ext), data);
+}
+
+// Best effort: a failure only means the next compilation misses
+void CacheStore(const std::string &dir, const std::string &key, const std::string &ext, const std::string &data) {
+	std::string sub = dir + "/" + key.substr(0, 2);
+	if(mkdir(dir.c_str(), 0777) && errno != EEXIST) return ;
+	if(mkdir(sub.c_str(), 0777) && errno != EEXIST) return ;
+	std::string tmp = sub + "/.tmp." + std::to_string(getpid()) + "." + key.substr(2, 16);
+	{
+		std::ofstream fout(tmp, std::ios::binary);
+		fout.write(data.data(), data.size());
+		if(!fout) {
+			fout.close();
+			unlink(tmp.c_str());
+			return ;
+		}
+	}
+	if(rename(tmp.c_str(), EntryPath(dir, key, ext).c_str())) unlink(tmp.c_str());
+}
@@ -0,0 +1,655 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <cassert>
+
+#include "mir.hpp"
+#include "sysy_exceptions.hpp"
+
+/*
+	MIR interpreter, behind '-run'.
+
+	Every function is decoded once into a flat array of register-based
+	instructions: each symbol of the function gets a slot in its frame, and
+	so does each distinct constant, so that an operand is always a slot.
+	Memory is an array of words; a pointer is the index of a word. Calls
+	use an explicit stack of frames, so deep recursion in the program
+	doesn't overflow the native stack.
+
+	Integer division follows RISC-V, for the results to match the backend.
+
+	The frontend also uses it to evaluate calls at compile time (see
+	EvalCall), adding globals and functions as it lowers them.
+
+	With a profile to write (-fprofile-generate), each block starts by
+	counting itself, and the counts are written out when main returns, for
+	-fprofile-use to read back into the MIR (see LoadProfile).
+*/
+
+namespace {
+
+enum Opcode: std::uint8_t {
+	OC_MUL, OC_DIV, OC_MOD, OC_ADD, OC_SUB,
+	OC_LE, OC_GE, OC_LT, OC_GT, OC_EQ, OC_NEQ,
+	OC_AND, OC_OR,
+	OC_LOAD,		// a = mem[b]
+	OC_STORE,		// mem[b] = a
+	OC_FILL,		// initializes the array at a by inits[b]
+	OC_GEP,			// a = b + c * d, d being the stride in words
+	OC_CALL,		// a = d(args[b], ..., args[b+c-1]); a < 0 drops the result, d < 0 is a native
+	OC_RET,			// returns a, or nothing if a < 0
+	OC_BR,			// jumps to b if a else to c
+	OC_JUMP,		// jumps to b
+	OC_PROFILE,		// counts an execution of block a
+};
+
+struct Inst {
+	Opcode op;
+	std::int32_t a, b, c, d;
+};
+
+struct ArrayInit {
+	std::size_t words;
+	std::vector<InitializerInfo::Run> runs;
+};
+
+struct Function {
+	FuncInfo *mir;
+	bool decoded = false, valid = true;		// decoded lazily at compile time; invalid if that failed
+	std::string name;
+	std::vector<Inst> code;
+	std::vector<std::int32_t> args;			// operands of calls
+	std::vector<std::int32_t> consts;		// in slots [0, consts.size())
+	std::size_t params;						// in the slots following the constants
+	std::vector<std::pair<std::int32_t, std::uint32_t> > allocs;	// (slot, offset in the frame)
+	std::uint32_t frameWords;
+	std::size_t slots;
+	std::vector<ArrayInit> inits;
+	std::vector<std::string> blocks;					// with -fprofile-generate,
+	mutable std::vector<std::uint64_t> counts;		// the executions of each
+	explicit Function(FuncInfo *mir): mir{mir} {}
+};
+
+enum Native { NT_GETINT, NT_GETCH, NT_GETARRAY, NT_PUTINT, NT_PUTCH, NT_PUTARRAY, NT_STARTTIME, NT_STOPTIME };
+const std::map<std::string, Native> NATIVES = {
+	{"getint", NT_GETINT}, {"getch", NT_GETCH}, {"getarray", NT_GETARRAY},
+	{"putint", NT_PUTINT}, {"putch", NT_PUTCH}, {"putarray", NT_PUTARRAY},
+	{"starttime", NT_STARTTIME}, {"stoptime", NT_STOPTIME}
+};
+
+constexpr std::size_t MAX_MEM_WORDS = std::size_t(1) << 28;		// 1 GiB
+constexpr std::size_t EVAL_MEM_WORDS = std::size_t(1) << 20;	// 4 MiB, at compile time
+
+// What compile-time evaluation may read of a global
+enum GlobalAccess: std::uint8_t {
+	GA_CONST,		// always, it never changes
+	GA_STATIC,		// only at start-up, where it holds its initializer
+	GA_DYNAMIC		// never, it is initialized at run time
+};
+
+std::size_t WordsOf(const TypeInfo *type) {
+	return type->size() / 4u;
+}
+
+// The non-zero words of an initializer, by offset
+void CollectRuns(const InitializerInfo *init, const TypeInfo *type, std::size_t pos,
+				 std::vector<InitializerInfo::Run> &runs) {
+	switch(init->tag) {
+		case IT_UNDEF:
+		case IT_ZERO:
+			break;
+		case IT_NUM:
+			if(init->num != 0) runs.emplace_back(pos, std::vector<int>{init->num});
+			break;
+		case IT_AGGR:
+			for(std::size_t i = 0; i < init->aggr.size(); ++ i)
+				CollectRuns(init->aggr[i], type->array.base, pos + i * WordsOf(type->array.base), runs);
+			break;
+		case IT_RUNS:
+			for(auto &[off, run]: init->runs) runs.emplace_back(pos + off, run);
+			break;
+	}
+}
+
+class Interpreter {
+public:
+	Interpreter(FILE *in = nullptr, FILE *out = nullptr): in{in}, out{out} {
+		mem.resize(4);		// word 0 stays unused, as the null pointer
+		globalEnd = mem.size();
+	}
+	Interpreter(ProgramInfo *mir, FILE *in, FILE *out, FILE *profile = nullptr): Interpreter(in, out) {
+		this->profile = profile;
+		for(std::size_t i = 0; i < mir->vars.len; ++ i) AddGlobal(mir->vars[i], GA_STATIC);
+		for(std::size_t i = 0; i < mir->funcs.len; ++ i) {
+			funcId[mir->funcs[i]->name] = i;
+			funcs.emplace_back(mir->funcs[i]);
+		}
+		for(auto &fn: funcs) Decode(fn.mir, fn);
+	}
+
+	void AddGlobal(VarInfo *var, GlobalAccess kind) {
+		std::uint32_t addr = globalEnd, words = WordsOf(var->type);
+		globals[var->name] = addr;
+		globalEnd += words;
+		if(mem.size() < globalEnd) mem.resize(globalEnd);
+		std::fill(mem.begin() + addr, mem.begin() + globalEnd, 0);
+		access.resize(globalEnd, GA_CONST);
+		std::fill(access.begin() + addr, access.begin() + globalEnd, kind);
+		if(var->init == nullptr) return ;
+		std::vector<InitializerInfo::Run> runs;
+		CollectRuns(var->init, var->type, 0, runs);
+		for(auto &[off, run]: runs)
+			std::copy(run.begin(), run.end(), mem.begin() + addr + off);
+	}
+
+	void AddFunction(FuncInfo *mir) {
+		funcId[mir->name] = funcs.size();
+		funcs.emplace_back(mir);
+	}
+
+	// The result of func(args), if it is pure and returns within the budget
+	std::optional<int> Evaluate(const std::string &func, const std::vector<int> &args, bool startup,
+								std::size_t budget, std::size_t &used, std::vector<std::string> &called) {
+		auto it = funcId.find(func);
+		if(it == funcId.end() || !Ready(funcs[it->second]) || funcs[it->second].params != args.size())
+			return std::nullopt;
+		evalStartup = startup;
+		evalSteps = budget;
+		evalCalled.assign(funcs.size(), false);
+		std::optional<int> ret;
+		try {
+			ret = Execute<true>(it->second, args);
+		}
+		catch(const sysy_error &) {}
+		used = budget - evalSteps;
+		for(std::size_t i = 0; i < funcs.size(); ++ i)
+			if(evalCalled[i]) called.emplace_back(funcs[i].name);
+		return ret;
+	}
+
+	int Run() {
+		auto it = funcId.find("main");
+		if(it == funcId.end()) throw sysy_error("no main function to run");
+		int ret = Execute<false>(it->second, {});
+		if(profile != nullptr) WriteProfile();
+		if(timerUs != 0) {
+			long long us = timerUs;
+			std::fprintf(stderr, "TOTAL: %lldH-%lldM-%lldS-%lldus\n",
+						 us / 3600000000ll, us / 60000000ll % 60, us / 1000000ll % 60, us % 1000000ll);
+		}
+		std::fflush(out);
+		return ret;
+	}
+
+private:
+	FILE *in, *out, *profile = nullptr;
+	std::vector<std::int32_t> mem;
+	std::uint32_t globalEnd;				// globals lie below, the stack above
+	std::vector<GlobalAccess> access;		// of each word of the globals
+	std::map<std::string, std::uint32_t> globals;
+	std::map<std::string, std::size_t> funcId;
+	std::vector<Function> funcs;
+	std::chrono::steady_clock::time_point timerStart;
+	long long timerUs = 0;
+	bool evalStartup;
+	std::size_t evalSteps;					// left to the evaluation
+	std::vector<bool> evalCalled;
+
+	void Decode(FuncInfo *mir, Function &fn) {
+		std::map<std::string, std::int32_t> slotOf;
+		std::map<int, std::int32_t> constOf;
+		std::map<std::string, std::size_t> blockPc;
+		std::vector<std::pair<std::size_t, std::string*> > jumps;	// (&code[i].b or .c, target)
+		std::int32_t nSymbols = 0;
+
+		// Operands are numbered apart first: a symbol as is, a constant k as -1-k
+		auto constant = [&](int val) {
+			auto it = constOf.find(val);
+			if(it != constOf.end()) return it->second;
+			fn.consts.emplace_back(val);
+			return constOf[val] = -std::int32_t(fn.consts.size());
+		};
+		auto symbol = [&](const std::string &name) {
+			auto it = slotOf.find(name);
+			if(it != slotOf.end()) return it->second;
+			auto global = globals.find(name);
+			if(global != globals.end()) return constant(int(global->second));
+			return slotOf[name] = nSymbols ++;
+		};
+		auto value = [&](ValueInfo *val) {
+			if(val == nullptr || val->tag == VT_UNDEF) return constant(0);
+			if(val->tag == VT_INT) return constant(val->i32);
+			return symbol(*val->symbol);
+		};
+		auto emit = [&](Opcode op, std::int32_t a, std::int32_t b = 0, std::int32_t c = 0, std::int32_t d = 0) {
+			fn.code.push_back(Inst{op, a, b, c, d});
+		};
+
+		fn.decoded = true;
+		fn.name = mir->name;
+		for(auto param: mir->params) symbol(param->name);
+		fn.params = mir->params.size();
+		fn.frameWords = 0;
+		for(auto block: mir->block) {
+			blockPc[block->name] = fn.code.size();
+			if(profile != nullptr) {
+				emit(OC_PROFILE, fn.blocks.size());
+				fn.blocks.emplace_back(block->name);
+			}
+			for(auto stmt: block->stmt) {
+				switch(stmt->tag) {
+					case ST_SYMDEF: {
+						auto &sym = stmt->symdef;
+						switch(sym.tag) {
+							case SDT_EXPR: {
+								// unary operators are lowered by the frontend; 'and'/'or' are bitwise in MIR
+								static const Opcode OPS[] = {
+									OC_MUL, OC_DIV, OC_MOD, OC_ADD, OC_SUB,
+									OC_LE, OC_GE, OC_LT, OC_GT, OC_EQ, OC_NEQ, OC_AND, OC_OR };
+								if(sym.expr->op < OP_MUL) throw sysy_error("unexpected unary operator in MIR");
+								auto left = value(sym.expr->left), right = value(sym.expr->right);
+								emit(OPS[sym.expr->op - OP_MUL], symbol(*sym.name), left, right);
+								break;
+							}
+							case SDT_LOAD: {
+								auto src = symbol(*sym.load);
+								emit(OC_LOAD, symbol(*sym.name), src);
+								break;
+							}
+							case SDT_ALLOC:
+								fn.allocs.emplace_back(symbol(*sym.name), fn.frameWords);
+								fn.frameWords += WordsOf(sym.alloc);
+								break;
+							case SDT_FUNCALL: {
+								auto callee = GlobalFunc(*sym.func.fun);
+								std::int32_t first = fn.args.size(), n = sym.func.para->size();
+								for(auto p: *sym.func.para) fn.args.emplace_back(value(p));
+								std::int32_t dst = sym.name->empty() ? INT32_MAX : symbol(*sym.name);
+								emit(OC_CALL, dst, first, n, callee);
+								break;
+							}
+							case SDT_GETELEMPTR:
+							case SDT_GETPTR: {
+								auto src = symbol(*sym.ptr.src), idx = value(sym.ptr.index);
+								emit(OC_GEP, symbol(*sym.name), src, idx, WordsOf(sym.ptr.base));
+								break;
+							}
+						}
+						break;
+					}
+					case ST_RETURN:
+						emit(OC_RET, stmt->ret.val == nullptr ? INT32_MAX : value(stmt->ret.val));
+						break;
+					case ST_STORE: {
+						auto addr = symbol(*stmt->store.addr);
+						if(stmt->store.isValue) {
+							emit(OC_STORE, value(stmt->store.val), addr);
+							break;
+						}
+						ArrayInit init;
+						TypeInfo *type = nullptr;
+						for(auto block: mir->block)
+							for(auto s: block->stmt)
+								if(s->tag == ST_SYMDEF && s->symdef.tag == SDT_ALLOC && *s->symdef.name == *stmt->store.addr)
+									type = s->symdef.alloc;
+						if(type == nullptr) throw sysy_error("can't store an aggregate to " + *stmt->store.addr);
+						init.words = WordsOf(type);
+						CollectRuns(stmt->store.init, type, 0, init.runs);
+						emit(OC_FILL, addr, fn.inits.size());
+						fn.inits.emplace_back(std::move(init));
+						break;
+					}
+					case ST_BR: {
+						emit(OC_BR, value(stmt->jump.cond));
+						jumps.emplace_back(fn.code.size() * 2 - 2, stmt->jump.blkThen);
+						jumps.emplace_back(fn.code.size() * 2 - 1, stmt->jump.blkElse);
+						break;
+					}
+					case ST_JUMP:
+						emit(OC_JUMP, 0);
+						jumps.emplace_back(fn.code.size() * 2 - 2, stmt->jump.blkThen);
+						break;
+				}
+			}
+			if(!block->closed()) emit(OC_RET, INT32_MAX);		// falling off the end of a function
+		}
+		for(auto &[field, target]: jumps) {
+			auto &inst = fn.code[field / 2];
+			(field % 2 ? inst.c : inst.b) = blockPc.at(*target);
+		}
+
+		// Constants go first in the frame, then the symbols, parameters leading
+		std::int32_t nConsts = fn.consts.size();
+		auto remap = [&](std::int32_t &x) {
+			if(x == INT32_MAX) x = -1;
+			else x = x < 0 ? -1 - x : nConsts + x;
+		};
+		for(auto &inst: fn.code) {
+			switch(inst.op) {
+				case OC_LOAD: case OC_STORE: case OC_GEP:
+					remap(inst.a); remap(inst.b);
+					if(inst.op == OC_GEP) remap(inst.c);
+					break;
+				case OC_FILL: case OC_CALL: case OC_RET: case OC_BR:
+					remap(inst.a);
+					break;
+				case OC_JUMP: case OC_PROFILE: break;
+				default:
+					remap(inst.a); remap(inst.b); remap(inst.c);
+			}
+		}
+		for(auto &arg: fn.args) remap(arg);
+		for(auto &alloc: fn.allocs) remap(alloc.first);
+		fn.slots = nConsts + nSymbols;
+		fn.counts.assign(fn.blocks.size(), 0);
+	}
+
+	// A line "<function> <block> <executions>" for each block
+	void WriteProfile() {
+		std::fprintf(profile, "# block profile\n");
+		for(auto &fn: funcs)
+			for(std::size_t i = 0; i < fn.blocks.size(); ++ i)
+				std::fprintf(profile, "%s %s %llu\n", fn.name.c_str(), fn.blocks[i].c_str(), (unsigned long long)fn.counts[i]);
+		std::fflush(profile);
+	}
+
+	std::int32_t GlobalFunc(const std::string &koopaIdent) {
+		auto name = koopaIdent.substr(1);
+		auto it = funcId.find(name);
+		if(it != funcId.end()) return it->second;
+		auto native = NATIVES.find(name);
+		if(native == NATIVES.end()) throw sysy_error("call to undefined function " + koopaIdent);
+		return -1 - native->second;
+	}
+
+	std::int32_t &At(std::int64_t addr) {
+		if(addr <= 0 || std::uint64_t(addr) >= mem.size())
+			throw sysy_error("memory access out of bounds at word " + std::to_string(addr));
+		return mem[addr];
+	}
+
+	std::int32_t CallNative(Native id, const std::int32_t *args) {
+		switch(id) {
+			case NT_GETINT: {
+				int x = 0;
+				if(std::fscanf(in, "%d", &x) != 1) x = 0;
+				return x;
+			}
+			case NT_GETCH: return std::fgetc(in);
+			case NT_GETARRAY: {
+				int n = 0;
+				if(std::fscanf(in, "%d", &n) != 1) n = 0;
+				for(int i = 0; i < n; ++ i) {
+					int x = 0;
+					if(std::fscanf(in, "%d", &x) != 1) x = 0;
+					At(std::int64_t(args[0]) + i) = x;
+				}
+				return n;
+			}
+			case NT_PUTINT: std::fprintf(out, "%d", args[0]); return 0;
+			case NT_PUTCH: std::fputc(args[0], out); return 0;
+			case NT_PUTARRAY:
+				std::fprintf(out, "%d:", args[0]);
+				for(int i = 0; i < args[0]; ++ i) std::fprintf(out, " %d", At(std::int64_t(args[1]) + i));
+				std::fputc('\n', out);
+				return 0;
+			case NT_STARTTIME:
+				timerStart = std::chrono::steady_clock::now();
+				return 0;
+			case NT_STOPTIME:
+				timerUs += std::chrono::duration_cast<std::chrono::microseconds>(
+								std::chrono::steady_clock::now() - timerStart).count();
+				return 0;
+		}
+		__builtin_unreachable();
+	}
+
+	struct Frame {
+		const Function *fn;
+		std::size_t pc, base;
+		std::uint32_t sp;
+		std::int32_t ret;		// slot of the caller for the result, -1 if dropped
+	};
+
+	// Decodes fn if it wasn't, false if it can't be
+	bool Ready(Function &fn) {
+		if(!fn.decoded) {
+			try {
+				Decode(fn.mir, fn);
+			}
+			catch(const sysy_error &) {
+				fn.valid = false;
+			}
+		}
+		return fn.valid;
+	}
+
+	// Throws unless compile-time evaluation may read the word at addr
+	void CheckRead(std::int64_t addr) const {
+		if(addr <= 0 || addr >= globalEnd) return ;
+		if(access[addr] == GA_DYNAMIC || (access[addr] == GA_STATIC && !evalStartup))
+			throw sysy_error("reads a global whose value isn't known");
+	}
+
+	// Takes n steps off the evaluation, which pays for the words it sets up too
+	void Charge(std::size_t n) {
+		if(evalSteps < n) throw sysy_error("out of steps");
+		evalSteps -= n;
+	}
+
+	/*
+		With EVAL, the call is evaluated at compile time: it fails by
+		throwing sysy_error when it calls a library function, stores to a
+		global, reads one it may not (see GlobalAccess), runs out of steps
+		or needs more than EVAL_MEM_WORDS. Frames and fills cost a step per
+		word, so a large local array uses up the budget rather than memory.
+	*/
+	template <bool EVAL>
+	int Execute(std::size_t entry, const std::vector<std::int32_t> &args) {
+		std::vector<std::int32_t> regs;
+		std::vector<Frame> stack;
+		std::vector<std::int32_t> argv;
+		std::uint32_t sp = globalEnd;
+
+		// Sets up a frame of fn above the current one, taking the arguments from argv
+		auto enter = [&](Function &fn, const std::int32_t *argv, std::int32_t ret) {
+			if constexpr(EVAL) {
+				if(!Ready(fn)) throw sysy_error("can't evaluate " + fn.name);
+				evalCalled[&fn - funcs.data()] = true;
+			}
+			std::size_t base = stack.empty() ? 0 : stack.back().base + stack.back().fn->slots;
+			if(regs.size() < base + fn.slots) regs.resize(std::max(base + fn.slots, regs.size() * 2));
+			auto r = regs.data() + base;
+			std::copy(fn.consts.begin(), fn.consts.end(), r);
+			std::copy(argv, argv + fn.params, r + fn.consts.size());
+			constexpr std::size_t limit = EVAL ? EVAL_MEM_WORDS : MAX_MEM_WORDS;
+			if(std::size_t(sp) + fn.frameWords > limit) throw sysy_error("stack overflow");
+			if constexpr(EVAL) Charge(fn.frameWords);
+			if(mem.size() < sp + fn.frameWords)
+				mem.resize(std::min(limit, std::max<std::size_t>(sp + fn.frameWords, mem.size() * 2)));
+			for(auto &[slot, off]: fn.allocs) r[slot] = sp + off;
+			stack.push_back(Frame{&fn, 0, base, sp, ret});
+			sp += fn.frameWords;
+		};
+
+		enter(funcs[entry], args.data(), -1);
+		int result = 0;
+		while(!stack.empty()) {
+			auto &frame = stack.back();
+			const Function &fn = *frame.fn;
+			const Inst *code = fn.code.data();
+			std::int32_t *r = regs.data() + frame.base;
+			std::size_t pc = frame.pc;
+			for(bool running = true; running; ) {
+				const Inst &inst = code[pc ++];
+				if constexpr(EVAL) Charge(1);
+				switch(inst.op) {
+					case OC_MUL: r[inst.a] = std::int32_t(std::uint32_t(r[inst.b]) * std::uint32_t(r[inst.c])); break;
+					case OC_DIV: {
+						std::int32_t x = r[inst.b], y = r[inst.c];
+						r[inst.a] = y == 0 ? -1 : (x == INT32_MIN && y == -1) ? x : x / y;
+						break;
+					}
+					case OC_MOD: {
+						std::int32_t x = r[inst.b], y = r[inst.c];
+						r[inst.a] = y == 0 ? x : (x == INT32_MIN && y == -1) ? 0 : x % y;
+						break;
+					}
+					case OC_ADD: r[inst.a] = std::int32_t(std::uint32_t(r[inst.b]) + std::uint32_t(r[inst.c])); break;
+					case OC_SUB: r[inst.a] = std::int32_t(std::uint32_t(r[inst.b]) - std::uint32_t(r[inst.c])); break;
+					case OC_LE: r[inst.a] = r[inst.b] <= r[inst.c]; break;
+					case OC_GE: r[inst.a] = r[inst.b] >= r[inst.c]; break;
+					case OC_LT: r[inst.a] = r[inst.b] < r[inst.c]; break;
+					case OC_GT: r[inst.a] = r[inst.b] > r[inst.c]; break;
+					case OC_EQ: r[inst.a] = r[inst.b] == r[inst.c]; break;
+					case OC_NEQ: r[inst.a] = r[inst.b] != r[inst.c]; break;
+					case OC_AND: r[inst.a] = r[inst.b] & r[inst.c]; break;
+					case OC_OR: r[inst.a] = r[inst.b] | r[inst.c]; break;
+					case OC_LOAD:
+						if constexpr(EVAL) CheckRead(r[inst.b]);
+						r[inst.a] = At(r[inst.b]);
+						break;
+					case OC_STORE:
+						if constexpr(EVAL) if(r[inst.b] < std::int64_t(globalEnd)) throw sysy_error("stores to a global");
+						At(r[inst.b]) = r[inst.a];
+						break;
+					case OC_FILL: {
+						auto &init = fn.inits[inst.b];
+						std::int64_t addr = r[inst.a];
+						if constexpr(EVAL) Charge(init.words);
+						At(addr + init.words - 1);
+						std::fill(mem.begin() + addr, mem.begin() + addr + init.words, 0);
+						for(auto &[off, run]: init.runs) std::copy(run.begin(), run.end(), mem.begin() + addr + off);
+						break;
+					}
+					case OC_GEP:
+						r[inst.a] = std::int32_t(std::uint32_t(r[inst.b]) + std::uint32_t(r[inst.c]) * std::uint32_t(inst.d));
+						break;
+					case OC_CALL: {
+						argv.resize(inst.c);
+						for(std::int32_t i = 0; i < inst.c; ++ i) argv[i] = r[fn.args[inst.b + i]];
+						if(inst.d < 0) {
+							if constexpr(EVAL) throw sysy_error("calls a library function");
+							auto val = CallNative(Native(-1 - inst.d), argv.data());
+							if(inst.a >= 0) r[inst.a] = val;
+							break;
+						}
+						frame.pc = pc;
+						enter(funcs[inst.d], argv.data(), inst.a < 0 ? -1 : std::int32_t(frame.base + inst.a));
+						running = false;
+						break;
+					}
+					case OC_RET: {
+						std::int32_t val = inst.a < 0 ? 0 : r[inst.a];
+						std::int32_t ret = frame.ret;
+						sp = frame.sp;
+						stack.pop_back();
+						if(stack.empty()) result = val;
+						else if(ret >= 0) regs[ret] = val;
+						running = false;
+						break;
+					}
+					case OC_BR: pc = r[inst.a] ? inst.b : inst.c; break;
+					case OC_JUMP: pc = inst.b; break;
+					case OC_PROFILE: ++ fn.counts[inst.a]; break;
+				}
+			}
+		}
+		return result;
+	}
+};
+
+}
+
+// Runs the program with the given input and output, returning the result of main.
+// With a profile file, the executions of each block are written to it.
+int ProgramRun(ProgramInfo *mir, FILE *in, FILE *out, FILE *profile) {
+	Interpreter interp(mir, in, out, profile);
+	return interp.Run();
+}
+
+/*
+	Sets the freq of the blocks from a profile written by -fprofile-generate.
+	It has to come from the same MIR, that is the same source and options:
+	a function whose blocks don't match is left without one, with a warning.
+*/
+bool LoadProfile(ProgramInfo *mir, const std::string &text) {
+	std::map<std::string, std::map<std::string, std::uint64_t> > counts;
+	std::istringstream in(text);
+	for(std::string line; std::getline(in, line); ) {
+		if(line.empty() || line.front() == '#') continue;
+		std::istringstream fields(line);
+		std::string func, block;
+		unsigned long long count;
+		if(!(fields >> func >> block >> count)) return false;
+		counts[func][block] = count;
+	}
+	for(std::size_t i = 0; i < mir->funcs.len; ++ i) {
+		auto func = mir->funcs[i];
+		auto it = counts.find(func->name);
+		if(it == counts.end()) continue;
+		bool match = it->second.size() == func->block.size();
+		for(auto block: func->block) match = match && it->second.count(block->name);
+		if(!match) {
+			std::cerr << "warning: the profile of " << func->name << " doesn't match it, ignored\n";
+			continue;
+		}
+		for(auto block: func->block) block->freq = it->second.at(block->name);
+	}
+	return true;
+}
+
+namespace {
+
+constexpr std::size_t EVAL_STEPS = std::size_t(1) << 20;		// for one call
+constexpr std::size_t EVAL_TOTAL = std::size_t(1) << 24;		// for the whole compilation
+
+struct Evaluation {
+	std::optional<int> result;
+	std::vector<std::string> called;
+};
+
+Interpreter evaluator;
+std::map<std::tuple<std::string, std::vector<int>, bool>, Evaluation> evaluated;
+std::size_t evalLeft = EVAL_TOTAL;
+
+}
+
+// The frontend hands over each global and function as it lowers them, for EvalCall
+void EvalAddGlobal(VarInfo *var, bool constant, bool dynamic) {
+	evaluator.AddGlobal(var, constant ? GA_CONST : dynamic ? GA_DYNAMIC : GA_STATIC);
+}
+void EvalAddFunction(FuncInfo *func) {
+	evaluator.AddFunction(func);
+}
+
+/*
+	Evaluates func(args) at compile time, if func is pure: it does no I/O,
+	stores to no global and reads only those whose value is known, which at
+	start-up (before main) includes the initialized variables. Evaluations
+	are memoized, and bounded in steps each and in total. The functions
+	run, on which the result depends, are added to called, even on failure.
+*/
+std::optional<int> EvalCall(const std::string &func, const std::vector<int> &args, bool startup,
+							std::vector<std::string> &called) {
+	auto key = std::make_tuple(func, args, startup);
+	auto it = evaluated.find(key);
+	if(it == evaluated.end()) {
+		Evaluation eval;
+		std::size_t used = 0;
+		eval.result = evaluator.Evaluate(func, args, startup, std::min(EVAL_STEPS, evalLeft), used, eval.called);
+		evalLeft -= used;
+		if(used == 0) return std::nullopt;		// func isn't there yet, or can't be run
+		it = evaluated.emplace(key, std::move(eval)).first;
+	}
+	called.insert(called.end(), it->second.called.begin(), it->second.called.end());
+	return it->second.result;
+}
@@ -0,0 +1,1125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include "mir.hpp"
+
+/*
+	Whole-program optimization over the call graph, run on the MIR of the
+	entire program before it is emitted or run.
+
+	The runtime library only ever calls main, so every other function is
+	internal: all of its calls are in sight, and its signature may change
+	together with them. Three such changes are made:
+
+	- constant parameters: a parameter that every call passes the same
+	  constant, directly or by passing on a parameter that is itself that
+	  constant, is replaced by it in the body;
+	- dead parameters: a parameter whose value is never used, or only
+	  passed on to the same parameter of a recursive call, is removed from
+	  the function and from every call;
+	- dead results: a function whose result no call uses returns nothing.
+
+	The statements left unused in the functions changed are removed, so
+	that no argument is computed only to be dropped.
+
+	With -memo, pure recursive functions are also memoized (see Memoizer).
+	Then scalar globals are kept in locals where they are used often (see
+	GlobalPromoter), and last, short 'if's become straight-line code (see
+	IfConverter).
+*/
+
+namespace {
+
+// The value operands of a statement, which may be replaced
+template <typename F>
+void ForEachValue(StmtInfo *stmt, F &&visit) {
+	auto value = [&](ValueInfo *val) {
+		if(val != nullptr) visit(val);
+	};
+	switch(stmt->tag) {
+		case ST_SYMDEF:
+			switch(stmt->symdef.tag) {
+				case SDT_EXPR:
+					value(stmt->symdef.expr->left);
+					value(stmt->symdef.expr->right);
+					break;
+				case SDT_GETELEMPTR:
+				case SDT_GETPTR: value(stmt->symdef.ptr.index); break;
+				case SDT_FUNCALL:
+					for(auto p: *stmt->symdef.func.para) value(p);
+					break;
+				case SDT_LOAD:
+				case SDT_ALLOC: break;
+			}
+			break;
+		case ST_RETURN: value(stmt->ret.val); break;
+		case ST_STORE:
+			if(stmt->store.isValue) value(stmt->store.val);
+			break;
+		case ST_BR: value(stmt->jump.cond); break;
+		case ST_JUMP: break;
+	}
+}
+
+// Every name a statement uses, as a value or as an address
+template <typename F>
+void ForEachUse(StmtInfo *stmt, F &&use) {
+	ForEachValue(stmt, [&](ValueInfo *val) {
+		if(val->tag == VT_SYMBOL) use(*val->symbol);
+	});
+	if(stmt->tag == ST_STORE) use(*stmt->store.addr);
+	else if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD) use(*stmt->symdef.load);
+	else if(stmt->tag == ST_SYMDEF && (stmt->symdef.tag == SDT_GETELEMPTR || stmt->symdef.tag == SDT_GETPTR))
+		use(*stmt->symdef.ptr.src);
+}
+
+bool isCall(const StmtInfo *stmt) {
+	return stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_FUNCALL;
+}
+
+// How the names of a function are used
+struct Usage {
+	std::map<std::string, std::size_t> uses;
+	std::set<std::string> allocs;
+	std::map<std::string, std::vector<StmtInfo*> > stores;		// to each alloc
+	std::map<std::string, std::vector<StmtInfo*> > loads;		// of each alloc
+	std::map<std::string, std::string> storedTo;				// the alloc a value is stored to
+	std::map<std::string, std::vector<std::size_t> > selfArgs;	// positions passed to a recursive call
+
+	Usage(const FuncInfo *func) {
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				ForEachUse(stmt, [&](const std::string &name) { ++ uses[name]; });
+				if(stmt->tag == ST_STORE) {
+					stores[*stmt->store.addr].emplace_back(stmt);
+					if(stmt->store.isValue && stmt->store.val->tag == VT_SYMBOL)
+						storedTo[*stmt->store.val->symbol] = *stmt->store.addr;
+				}
+				if(stmt->tag != ST_SYMDEF) continue;
+				if(stmt->symdef.tag == SDT_ALLOC) allocs.emplace(*stmt->symdef.name);
+				if(stmt->symdef.tag == SDT_LOAD) loads[*stmt->symdef.load].emplace_back(stmt);
+				if(isCall(stmt) && *stmt->symdef.func.fun == "@" + func->name) {
+					auto &args = *stmt->symdef.func.para;
+					for(std::size_t i = 0; i < args.size(); ++ i)
+						if(args[i]->tag == VT_SYMBOL) selfArgs[*args[i]->symbol].emplace_back(i);
+				}
+			}
+	}
+
+	std::size_t count(const std::map<std::string, std::vector<StmtInfo*> > &of, const std::string &name) const {
+		auto it = of.find(name);
+		return it == of.end() ? 0 : it->second.size();
+	}
+
+	// The alloc the front end copies a parameter into, if it is only ever
+	// stored to and loaded from; empty if none
+	std::string CopyOf(const std::string &param) const {
+		auto it = storedTo.find(param);
+		if(it == storedTo.end() || uses.at(param) != 1 || !allocs.count(it->second)) return "";
+		auto &alloc = it->second;
+		if(uses.at(alloc) != count(stores, alloc) + count(loads, alloc)) return "";
+		return alloc;
+	}
+
+	// The names always holding the value of parameter i: the parameter itself,
+	// and the loads of its copy if nothing else is stored there
+	std::vector<std::string> Forwards(const FuncInfo *func, std::size_t i) const {
+		std::vector<std::string> ret(1, func->params[i]->name);
+		auto alloc = CopyOf(ret[0]);
+		if(alloc.empty() || count(stores, alloc) != 1) return ret;
+		if(loads.count(alloc))
+			for(auto load: loads.at(alloc)) ret.emplace_back(*load->symdef.name);
+		return ret;
+	}
+
+	// Whether parameter i is never used, except to pass it on as parameter i
+	bool isDead(const FuncInfo *func, std::size_t i) const {
+		auto &param = func->params[i]->name;
+		if(!uses.count(param)) return true;
+		auto alloc = CopyOf(param);
+		if(alloc.empty()) return false;
+		if(!loads.count(alloc)) return true;
+		for(auto load: loads.at(alloc)) {
+			auto &name = *load->symdef.name;
+			auto pos = selfArgs.find(name);
+			std::size_t n = pos == selfArgs.end() ? 0 : pos->second.size();
+			if(uses.count(name) && uses.at(name) != n) return false;
+			if(n && std::any_of(pos->second.begin(), pos->second.end(), [&](std::size_t p) { return p != i; }))
+				return false;
+		}
+		return true;
+	}
+};
+
+// What is known of a parameter over all calls: nothing yet, a constant, or that it varies
+struct ParamValue {
+	enum { PV_NONE, PV_CONST, PV_VARYING } state = PV_NONE;
+	int val = 0;
+
+	bool meet(const ParamValue &other) {
+		if(other.state == PV_NONE || state == PV_VARYING) return false;
+		if(state == PV_NONE) {
+			*this = other;
+			return true;
+		}
+		if(other.state == PV_CONST && other.val == val) return false;
+		state = PV_VARYING;
+		return true;
+	}
+};
+
+class Optimizer {
+public:
+	explicit Optimizer(ProgramInfo *mir): prog{mir} {
+		for(auto func: prog->funcs)
+			if(func->name != "main") funcs["@" + func->name] = func;
+		// leave alone what is called with the wrong number of arguments
+		for(auto func: prog->funcs)
+			for(auto block: func->block)
+				for(auto stmt: block->stmt) {
+					if(!isCall(stmt)) continue;
+					auto callee = funcs.find(*stmt->symdef.func.fun);
+					if(callee != funcs.end() && callee->second->params.size() != stmt->symdef.func.para->size())
+						funcs.erase(callee);
+				}
+	}
+
+	void Run() {
+		Analyze();
+		PropagateConstants();
+		Analyze();
+		RemoveDeadParams();
+		Analyze();
+		RemoveDeadResults();
+		for(auto func: touched) Clean(func);
+	}
+
+private:
+	ProgramInfo *prog;
+	std::map<std::string, FuncInfo*> funcs;		// the internal functions, by the name calls use
+	std::map<FuncInfo*, Usage> usage;
+	std::vector<std::pair<FuncInfo*, StmtInfo*> > calls;	// each call of an internal function, in its caller
+	std::set<FuncInfo*> touched;
+
+	void Analyze() {
+		usage.clear();
+		calls.clear();
+		for(auto func: prog->funcs) {
+			usage.emplace(func, Usage(func));
+			for(auto block: func->block)
+				for(auto stmt: block->stmt)
+					if(isCall(stmt) && funcs.count(*stmt->symdef.func.fun)) calls.emplace_back(func, stmt);
+		}
+	}
+
+	FuncInfo *Callee(StmtInfo *call) const {
+		return funcs.at(*call->symdef.func.fun);
+	}
+
+	void PropagateConstants() {
+		std::map<FuncInfo*, std::vector<ParamValue> > param;
+		std::map<FuncInfo*, std::map<std::string, std::size_t> > forwarded;
+		for(auto &[name, func]: funcs) {
+			param[func].resize(func->params.size());
+			for(std::size_t i = 0; i < func->params.size(); ++ i)
+				for(auto &fwd: usage.at(func).Forwards(func, i)) forwarded[func][fwd] = i;
+		}
+		for(bool changed = true; changed; ) {
+			changed = false;
+			for(auto &[caller, call]: calls) {
+				auto callee = Callee(call);
+				auto &args = *call->symdef.func.para;
+				for(std::size_t i = 0; i < callee->params.size(); ++ i) {
+					ParamValue in;
+					in.state = ParamValue::PV_VARYING;
+					if(args[i]->tag == VT_INT) in.state = ParamValue::PV_CONST, in.val = args[i]->i32;
+					else if(args[i]->tag == VT_SYMBOL && forwarded.count(caller)) {
+						auto fwd = forwarded[caller].find(*args[i]->symbol);
+						if(fwd != forwarded[caller].end()) in = param[caller][fwd->second];
+					}
+					changed = param[callee][i].meet(in) || changed;
+				}
+			}
+		}
+		for(auto &[func, values]: param) {
+			std::map<std::string, int> known;
+			for(std::size_t i = 0; i < values.size(); ++ i) {
+				if(values[i].state != ParamValue::PV_CONST) continue;
+				std::cerr << "ipo: " << func->params[i]->name << " of " << func->name << " is " << values[i].val << '\n';
+				for(auto &fwd: usage.at(func).Forwards(func, i)) known[fwd] = values[i].val;
+			}
+			if(known.empty()) continue;
+			touched.emplace(func);
+			for(auto block: func->block)
+				for(auto stmt: block->stmt)
+					ForEachValue(stmt, [&](ValueInfo *val) {
+						if(val->tag != VT_SYMBOL) return ;
+						auto it = known.find(*val->symbol);
+						if(it == known.end()) return ;
+						delete val->symbol;
+						val->tag = VT_INT;
+						val->i32 = it->second;
+					});
+		}
+	}
+
+	void RemoveDeadParams() {
+		std::map<FuncInfo*, std::vector<std::size_t> > dead;
+		for(auto &[name, func]: funcs) {
+			auto &use = usage.at(func);
+			std::set<StmtInfo*> doomed;
+			for(std::size_t i = 0; i < func->params.size(); ++ i) {
+				if(!use.isDead(func, i)) continue;
+				std::cerr << "ipo: " << func->params[i]->name << " of " << func->name << " is unused\n";
+				dead[func].emplace_back(i);
+				auto alloc = use.CopyOf(func->params[i]->name);
+				if(alloc.empty()) continue;
+				for(auto of: {&use.stores, &use.loads})
+					if(of->count(alloc)) doomed.insert(of->at(alloc).begin(), of->at(alloc).end());
+			}
+			if(!dead.count(func)) continue;
+			for(auto block: func->block)
+				for(auto stmt: block->stmt)
+					if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_ALLOC) {
+						for(auto i: dead[func])
+							if(use.CopyOf(func->params[i]->name) == *stmt->symdef.name) doomed.emplace(stmt);
+					}
+			Erase(func, doomed);
+			for(auto i = dead[func].rbegin(); i != dead[func].rend(); ++ i) {
+				delete func->params[*i];
+				func->params.erase(func->params.begin() + *i);
+			}
+			touched.emplace(func);
+		}
+		for(auto &[caller, call]: calls) {
+			auto it = dead.find(Callee(call));
+			if(it == dead.end()) continue;
+			auto &args = *call->symdef.func.para;
+			for(auto i = it->second.rbegin(); i != it->second.rend(); ++ i) {
+				delete args[*i];
+				args.erase(args.begin() + *i);
+			}
+			touched.emplace(caller);
+		}
+	}
+
+	void RemoveDeadResults() {
+		std::map<FuncInfo*, bool> used;
+		for(auto &[caller, call]: calls) {
+			auto &name = *call->symdef.name;
+			auto &use = usage.at(caller).uses;
+			used[Callee(call)] |= !name.empty() && use.count(name);
+		}
+		for(auto &[func, isUsed]: used) {
+			if(isUsed || func->ret == nullptr || func->ret->tag == TT_UNIT) continue;
+			std::cerr << "ipo: the result of " << func->name << " is unused\n";
+			func->ret->tag = TT_UNIT;
+			for(auto block: func->block)
+				for(auto stmt: block->stmt)
+					if(stmt->tag == ST_RETURN && stmt->ret.val != nullptr) {
+						delete stmt->ret.val;
+						stmt->ret.val = nullptr;
+					}
+			touched.emplace(func);
+		}
+		for(auto &[caller, call]: calls) {
+			if(used[Callee(call)]) continue;
+			call->symdef.name->clear();
+			touched.emplace(caller);
+		}
+	}
+
+	static void Erase(FuncInfo *func, const std::set<StmtInfo*> &doomed) {
+		for(auto block: func->block) {
+			auto &stmts = block->stmt;
+			stmts.erase(std::remove_if(stmts.begin(), stmts.end(), [&](StmtInfo *stmt) {
+				if(!doomed.count(stmt)) return false;
+				delete stmt;
+				return true;
+			}), stmts.end());
+		}
+	}
+
+	// Removes unused values, and allocs that are only stored to, until none is left
+	static void Clean(FuncInfo *func) {
+		while(true) {
+			Usage use(func);
+			std::set<StmtInfo*> doomed;
+			for(auto block: func->block)
+				for(auto stmt: block->stmt) {
+					if(stmt->tag != ST_SYMDEF) continue;
+					auto &name = *stmt->symdef.name;
+					switch(stmt->symdef.tag) {
+						case SDT_EXPR:
+						case SDT_LOAD:
+						case SDT_GETELEMPTR:
+						case SDT_GETPTR:
+							if(!name.empty() && !use.uses.count(name)) doomed.emplace(stmt);
+							break;
+						case SDT_ALLOC:
+							if(use.uses.count(name) && use.uses.at(name) != use.count(use.stores, name)) break;
+							doomed.emplace(stmt);
+							if(use.stores.count(name)) doomed.insert(use.stores.at(name).begin(), use.stores.at(name).end());
+							break;
+						case SDT_FUNCALL: break;
+					}
+				}
+			if(doomed.empty()) return ;
+			Erase(func, doomed);
+		}
+	}
+};
+
+// Building blocks for new statements
+ValueInfo *Copy(const ValueInfo *val) {
+	switch(val->tag) {
+		case VT_SYMBOL: return new ValueInfo(*val->symbol);
+		case VT_INT: return new ValueInfo(val->i32);
+		case VT_UNDEF: return new ValueInfo();
+	}
+	__builtin_unreachable();
+}
+
+StmtInfo *Symdef(SymbolDefTag tag, const std::string &name) {
+	auto stmt = new StmtInfo;
+	stmt->tag = ST_SYMDEF;
+	stmt->symdef.tag = tag;
+	stmt->symdef.name = new std::string(name);
+	return stmt;
+}
+
+StmtInfo *Expr(const std::string &name, Operator op, ValueInfo *left, ValueInfo *right) {
+	auto stmt = Symdef(SDT_EXPR, name);
+	stmt->symdef.expr = new ExprInfo(op, left, right);
+	return stmt;
+}
+
+StmtInfo *Load(const std::string &name, const std::string &src) {
+	auto stmt = Symdef(SDT_LOAD, name);
+	stmt->symdef.load = new std::string(src);
+	return stmt;
+}
+
+StmtInfo *ElemPtr(const std::string &name, const std::string &src, const std::string &index) {
+	auto stmt = Symdef(SDT_GETELEMPTR, name);
+	stmt->symdef.ptr.src = new std::string(src);
+	stmt->symdef.ptr.index = new ValueInfo(index);
+	stmt->symdef.ptr.base = new TypeInfo(TT_INT32);
+	return stmt;
+}
+
+StmtInfo *Store(ValueInfo *val, const std::string &addr) {
+	auto stmt = new StmtInfo;
+	stmt->tag = ST_STORE;
+	stmt->store.isValue = true;
+	stmt->store.val = val;
+	stmt->store.addr = new std::string(addr);
+	return stmt;
+}
+
+/*
+	Memoization of pure recursive functions, behind -memo.
+
+	A function is pure if its result only depends on its arguments: it
+	takes no arrays, stores only to its own allocs, loads only from them
+	and from globals that are never written, and calls only pure functions.
+	A pure recursive function of one to three ints gets a table of results
+	in .bss for the arguments in [0, limit), looked up on entry and filled
+	at every return. Arguments out of range are mapped to a spare entry,
+	which is never marked known, so storing the result needs no branch.
+*/
+constexpr std::size_t MEMO_ENTRIES = 1 << 12;		// per table, whatever the number of parameters
+
+class Memoizer {
+public:
+	explicit Memoizer(ProgramInfo *mir): prog{mir} {
+		for(auto func: prog->funcs) {
+			funcs["@" + func->name] = func;
+			names.emplace("@" + func->name);
+		}
+		for(auto var: prog->vars) {
+			globals.emplace(var->name);
+			names.emplace(var->name);
+		}
+	}
+
+	void Run() {
+		FindWrittenGlobals();
+		FindPure();
+		for(auto func: prog->funcs) {
+			bool intParams = !func->params.empty() && func->params.size() <= 3;
+			bool intResult = func->ret != nullptr && func->ret->tag == TT_INT32;
+			if(pure.count(func) && intParams && intResult && isRecursive(func)) Memoize(func);
+		}
+	}
+
+private:
+	ProgramInfo *prog;
+	std::map<std::string, FuncInfo*> funcs;
+	std::set<std::string> globals;
+	std::set<std::string> names;		// of every global and function, for picking fresh ones
+	std::set<std::string> written;		// globals stored to, or with their address passed on
+	std::set<FuncInfo*> pure;
+
+	// The alloc or global each pointer of a function points into
+	static std::map<std::string, std::string> Roots(FuncInfo *func) {
+		std::map<std::string, std::string> root;
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				if(stmt->tag != ST_SYMDEF || (stmt->symdef.tag != SDT_GETELEMPTR && stmt->symdef.tag != SDT_GETPTR)) continue;
+				auto src = root.find(*stmt->symdef.ptr.src);
+				root[*stmt->symdef.name] = src == root.end() ? *stmt->symdef.ptr.src : src->second;
+			}
+		return root;
+	}
+
+	static std::string RootOf(const std::map<std::string, std::string> &root, const std::string &name) {
+		auto it = root.find(name);
+		return it == root.end() ? name : it->second;
+	}
+
+	void FindWrittenGlobals() {
+		for(auto func: prog->funcs) {
+			auto root = Roots(func);
+			for(auto block: func->block)
+				for(auto stmt: block->stmt) {
+					bool isPtr = stmt->tag == ST_SYMDEF &&
+								 (stmt->symdef.tag == SDT_GETELEMPTR || stmt->symdef.tag == SDT_GETPTR);
+					ForEachUse(stmt, [&](const std::string &name) {
+						bool isRead = (stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD) ||
+									  (isPtr && name == *stmt->symdef.ptr.src);
+						auto target = RootOf(root, name);
+						if(!isRead && globals.count(target)) written.emplace(target);
+					});
+				}
+		}
+	}
+
+	bool isPure(FuncInfo *func) const {
+		std::set<std::string> allocs;
+		for(auto block: func->block)
+			for(auto stmt: block->stmt)
+				if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_ALLOC) allocs.emplace(*stmt->symdef.name);
+		auto root = Roots(func);
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				if(stmt->tag == ST_STORE && !allocs.count(RootOf(root, *stmt->store.addr))) return false;
+				if(stmt->tag != ST_SYMDEF) continue;
+				if(stmt->symdef.tag == SDT_LOAD) {
+					auto src = RootOf(root, *stmt->symdef.load);
+					if(!allocs.count(src) && (!globals.count(src) || written.count(src))) return false;
+				}
+				if(isCall(stmt)) {
+					auto callee = funcs.find(*stmt->symdef.func.fun);
+					if(callee == funcs.end() || !pure.count(callee->second)) return false;
+				}
+			}
+		return true;
+	}
+
+	// Assumes every function taking only ints is pure, until shown otherwise
+	void FindPure() {
+		for(auto func: prog->funcs)
+			if(std::all_of(func->params.begin(), func->params.end(), [](VarInfo *p) { return p->type->tag == TT_INT32; }))
+				pure.emplace(func);
+		for(bool changed = true; changed; ) {
+			changed = false;
+			for(auto func: prog->funcs)
+				if(pure.count(func) && !isPure(func)) {
+					pure.erase(func);
+					changed = true;
+				}
+		}
+	}
+
+	bool isRecursive(FuncInfo *func) const {
+		std::set<FuncInfo*> seen;
+		std::vector<FuncInfo*> work(1, func);
+		while(!work.empty()) {
+			auto crt = work.back();
+			work.pop_back();
+			for(auto block: crt->block)
+				for(auto stmt: block->stmt) {
+					if(!isCall(stmt)) continue;
+					auto callee = funcs.find(*stmt->symdef.func.fun);
+					if(callee == funcs.end()) continue;
+					if(callee->second == func) return true;
+					if(seen.insert(callee->second).second) work.emplace_back(callee->second);
+				}
+		}
+		return false;
+	}
+
+	// A zero-initialized global array of i32
+	std::string NewTable(const std::string &base, std::size_t words) {
+		auto name = "@" + base;
+		for(int i = 1; names.count(name); ++ i) name = "@" + base + "_" + std::to_string(i);
+		names.emplace(name);
+		auto var = new VarInfo;
+		var->name = name;
+		var->type = TypeInfo::Array(new TypeInfo(TT_INT32), words);
+		var->init = new InitializerInfo;
+		var->init->tag = IT_ZERO;
+		auto old = prog->vars;
+		prog->vars.init(old.len + 1);
+		std::copy(old.begin(), old.end(), prog->vars.begin());
+		prog->vars[old.len] = var;
+		if(old.len) delete[] old.data;
+		return name;
+	}
+
+	void Memoize(FuncInfo *func) {
+		std::size_t n = func->params.size(), limit = 1;
+		auto power = [n](std::size_t base) {
+			std::size_t ret = 1;
+			for(std::size_t i = 0; i < n; ++ i) ret *= base;
+			return ret;
+		};
+		while(power(limit * 2) <= MEMO_ENTRIES) limit *= 2;
+		std::size_t spare = power(limit);
+		std::cerr << "memo: " << func->name << " for arguments below " << limit << '\n';
+		auto values = NewTable(func->name + "_memo", spare + 1);
+		auto known = NewTable(func->name + "_known", spare + 1);
+
+		std::size_t lastBlock = 0, tmps = 0;
+		for(auto block: func->block)
+			if(block->name.compare(0, 6, "%block") == 0)
+				lastBlock = std::max<std::size_t>(lastBlock, std::strtoul(block->name.c_str() + 6, nullptr, 10));
+		auto entry = new BlockInfo, hit = new BlockInfo;
+		entry->name = "%block" + std::to_string(lastBlock + 1);
+		hit->name = "%block" + std::to_string(lastBlock + 2);
+		auto tmp = [&]() { return "%memo" + std::to_string(++ tmps); };
+		auto emit = [&](StmtInfo *stmt) {
+			entry->stmt.emplace_back(stmt);
+			return *stmt->symdef.name;
+		};
+
+		// index = ok ? the arguments as digits in base limit : spare
+		std::string ok, index;
+		for(std::size_t i = 0; i < n; ++ i) {
+			auto &param = func->params[i]->name;
+			auto lo = emit(Expr(tmp(), OP_GE, new ValueInfo(param), new ValueInfo(0)));
+			auto hi = emit(Expr(tmp(), OP_LT, new ValueInfo(param), new ValueInfo(int(limit))));
+			auto in = emit(Expr(tmp(), OP_LAND, new ValueInfo(lo), new ValueInfo(hi)));
+			ok = i == 0 ? in : emit(Expr(tmp(), OP_LAND, new ValueInfo(ok), new ValueInfo(in)));
+			if(i == 0) index = param;
+			else {
+				auto scaled = emit(Expr(tmp(), OP_MUL, new ValueInfo(index), new ValueInfo(int(limit))));
+				index = emit(Expr(tmp(), OP_ADD, new ValueInfo(scaled), new ValueInfo(param)));
+			}
+		}
+		auto offset = emit(Expr(tmp(), OP_SUB, new ValueInfo(index), new ValueInfo(int(spare))));
+		auto masked = emit(Expr(tmp(), OP_MUL, new ValueInfo(offset), new ValueInfo(ok)));
+		index = emit(Expr(tmp(), OP_ADD, new ValueInfo(masked), new ValueInfo(int(spare))));
+		auto valuePtr = emit(ElemPtr(tmp(), values, index));
+		auto knownPtr = emit(ElemPtr(tmp(), known, index));
+		auto isKnown = emit(Load(tmp(), knownPtr));
+		auto br = new StmtInfo;
+		br->tag = ST_BR;
+		br->jump.cond = new ValueInfo(isKnown);
+		br->jump.blkThen = new std::string(hit->name);
+		br->jump.blkElse = new std::string(func->block.front()->name);
+		entry->stmt.emplace_back(br);
+
+		auto result = tmp();
+		hit->stmt.emplace_back(Load(result, valuePtr));
+		auto ret = new StmtInfo;
+		ret->tag = ST_RETURN;
+		ret->ret.val = new ValueInfo(result);
+		hit->stmt.emplace_back(ret);
+
+		for(auto block: func->block)
+			for(auto it = block->stmt.begin(); it != block->stmt.end(); ++ it) {
+				if((*it)->tag != ST_RETURN || (*it)->ret.val == nullptr) continue;
+				it = block->stmt.insert(it, Store(Copy((*it)->ret.val), valuePtr)) + 1;
+				it = block->stmt.insert(it, Store(new ValueInfo(ok), knownPtr)) + 1;
+			}
+		func->block.insert(func->block.begin(), {entry, hit});
+	}
+};
+
+/*
+	Promotion of scalar globals to locals, function by function.
+
+	Which globals each function may read or write is found over the call
+	graph (the library touches none). Where a function accesses a global
+	often enough, it works on a local copy instead: loaded at entry,
+	written back before each call that may read the global and at each
+	return, and reloaded after each call that may write it. The write-backs
+	are only needed if the function stores to the global itself. The local
+	copy is an alloc like any other, so a leaf function keeps it in a
+	register. Accesses and copies are weighed by LOOP_WEIGHT inside loops.
+*/
+constexpr std::size_t LOOP_WEIGHT = 8;
+
+class GlobalPromoter {
+public:
+	explicit GlobalPromoter(ProgramInfo *mir): prog{mir} {
+		for(auto func: prog->funcs) funcs["@" + func->name] = func;
+		for(auto var: prog->vars)
+			if(var->type->tag == TT_INT32) scalars.emplace(var->name);
+	}
+
+	void Run() {
+		FindAccesses();
+		for(auto func: prog->funcs)
+			for(auto &global: scalars)
+				if(isWorthPromoting(func, global)) Promote(func, global);
+	}
+
+private:
+	ProgramInfo *prog;
+	std::map<std::string, FuncInfo*> funcs;
+	std::set<std::string> scalars;
+	std::map<FuncInfo*, std::set<std::string> > reads, writes;		// through calls too
+
+	FuncInfo *Callee(const StmtInfo *stmt) const {
+		if(!isCall(stmt)) return nullptr;
+		auto it = funcs.find(*stmt->symdef.func.fun);
+		return it == funcs.end() ? nullptr : it->second;
+	}
+
+	void FindAccesses() {
+		for(auto func: prog->funcs)
+			for(auto block: func->block)
+				for(auto stmt: block->stmt) {
+					if(stmt->tag == ST_STORE && scalars.count(*stmt->store.addr)) writes[func].emplace(*stmt->store.addr);
+					if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD && scalars.count(*stmt->symdef.load))
+						reads[func].emplace(*stmt->symdef.load);
+				}
+		for(bool changed = true; changed; ) {
+			changed = false;
+			for(auto func: prog->funcs)
+				for(auto block: func->block)
+					for(auto stmt: block->stmt) {
+						auto callee = Callee(stmt);
+						if(callee == nullptr || callee == func) continue;
+						for(auto of: {&reads, &writes}) {
+							auto &mine = (*of)[func];
+							std::size_t before = mine.size();
+							mine.insert((*of)[callee].begin(), (*of)[callee].end());
+							changed = changed || mine.size() != before;
+						}
+					}
+		}
+	}
+
+	// The weight of each block: LOOP_WEIGHT if it is in a loop, found by the
+	// backward jumps in the order of the blocks
+	static std::map<BlockInfo*, std::size_t> Weights(FuncInfo *func) {
+		std::map<std::string, std::size_t> pos;
+		for(std::size_t i = 0; i < func->block.size(); ++ i) pos[func->block[i]->name] = i;
+		std::vector<std::size_t> weight(func->block.size(), 1);
+		for(std::size_t i = 0; i < func->block.size(); ++ i) {
+			if(func->block[i]->stmt.empty()) continue;
+			auto last = func->block[i]->stmt.back();
+			std::vector<std::string*> succ;
+			if(last->tag == ST_JUMP || last->tag == ST_BR) succ.emplace_back(last->jump.blkThen);
+			if(last->tag == ST_BR) succ.emplace_back(last->jump.blkElse);
+			for(auto name: succ) {
+				auto head = pos.find(*name);
+				if(head == pos.end() || head->second > i) continue;
+				for(std::size_t j = head->second; j <= i; ++ j) weight[j] = LOOP_WEIGHT;
+			}
+		}
+		std::map<BlockInfo*, std::size_t> ret;
+		for(std::size_t i = 0; i < func->block.size(); ++ i) ret[func->block[i]] = weight[i];
+		return ret;
+	}
+
+	static bool isStored(FuncInfo *func, const std::string &global) {
+		for(auto block: func->block)
+			for(auto stmt: block->stmt)
+				if(stmt->tag == ST_STORE && *stmt->store.addr == global) return true;
+		return false;
+	}
+
+	// Each access saves an instruction (the 'lui' of the address), each copy costs about two
+	bool isWorthPromoting(FuncInfo *func, const std::string &global) {
+		if(!reads[func].count(global) && !writes[func].count(global)) return false;
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				bool access = (stmt->tag == ST_STORE && *stmt->store.addr == global) ||
+							  (stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD && *stmt->symdef.load == global);
+				std::size_t uses = 0;
+				ForEachUse(stmt, [&](const std::string &name) { uses += name == global; });
+				if(uses != std::size_t(access)) return false;		// not a plain load or store
+			}
+		bool stored = isStored(func, global);
+		std::size_t saved = 0, cost = 2;
+		for(auto &[block, weight]: Weights(func))
+			for(auto stmt: block->stmt) {
+				if(stmt->tag == ST_STORE && *stmt->store.addr == global) saved += weight;
+				else if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD && *stmt->symdef.load == global) saved += weight;
+				else if(stmt->tag == ST_RETURN && stored && func->name != "main") cost += 2 * weight;
+				else if(auto callee = Callee(stmt)) {
+					if(stored && (reads[callee].count(global) || writes[callee].count(global))) cost += 2 * weight;
+					if(writes[callee].count(global)) cost += 2 * weight;
+				}
+			}
+		return saved > cost;
+	}
+
+	void Promote(FuncInfo *func, const std::string &global) {
+		std::set<std::string> names;
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				if(stmt->tag == ST_SYMDEF) names.emplace(*stmt->symdef.name);
+				ForEachUse(stmt, [&](const std::string &name) { names.emplace(name); });
+			}
+		for(auto param: func->params) names.emplace(param->name);
+		for(auto var: prog->vars) names.emplace(var->name);
+		auto fresh = [&](const std::string &base) {
+			auto name = base;
+			for(int i = 1; names.count(name); ++ i) name = base + "_" + std::to_string(i);
+			names.emplace(name);
+			return name;
+		};
+		auto local = fresh(global + "_local");
+		std::cerr << "promote: " << global << " in " << func->name << '\n';
+
+		bool stored = isStored(func, global);
+		for(auto block: func->block) {
+			auto &stmts = block->stmt;
+			for(auto it = stmts.begin(); it != stmts.end(); ++ it) {
+				auto stmt = *it;
+				if(stmt->tag == ST_STORE && *stmt->store.addr == global) *stmt->store.addr = local;
+				else if(stmt->tag == ST_SYMDEF && stmt->symdef.tag == SDT_LOAD && *stmt->symdef.load == global)
+					*stmt->symdef.load = local;
+				bool writeBack = false, reload = false;
+				if(stmt->tag == ST_RETURN) writeBack = func->name != "main";
+				else if(auto callee = Callee(stmt)) {
+					writeBack = reads[callee].count(global) || writes[callee].count(global);
+					reload = writes[callee].count(global);
+				}
+				if(writeBack && stored) {
+					auto val = fresh("%" + global.substr(1) + "_out");
+					it = stmts.insert(it, Load(val, local)) + 1;
+					it = stmts.insert(it, Store(new ValueInfo(val), global)) + 1;
+				}
+				if(reload) {
+					auto val = fresh("%" + global.substr(1) + "_in");
+					it = stmts.insert(it + 1, Load(val, global));
+					it = stmts.insert(it + 1, Store(new ValueInfo(val), local));
+				}
+			}
+		}
+		auto &entry = func->block.front()->stmt;
+		auto alloc = Symdef(SDT_ALLOC, local);
+		alloc->symdef.alloc = new TypeInfo(TT_INT32);
+		auto val = fresh("%" + global.substr(1) + "_in");
+		entry.insert(entry.begin(), {alloc, Load(val, global), Store(new ValueInfo(val), local)});
+	}
+};
+
+/*
+	If-conversion: an 'if' whose branches only compute and assign scalar
+	locals becomes straight-line code. Both branches are computed, and
+	each local assigned gets the value of the branch taken through a mask
+	of the condition:
+
+		x = e + ((t - e) & -c)
+
+	with c as 0 or 1; see asmgen for its Zicond form. A branch may only
+	load what can't fault: scalars, and elements already accessed at the
+	same address before the 'if'. It can't call, divide or store elsewhere,
+	and is short, as it now always runs. Only functions that don't call are
+	converted: in the others, the values of the branches don't stay in
+	registers and the selects cost more than the jumps. The block after the
+	'if' is merged in when nothing else reaches it, so that a run of such
+	'if's becomes a single block.
+*/
+constexpr std::size_t SPECULATED = 8;		// statements of both branches at most
+
+class IfConverter {
+public:
+	explicit IfConverter(ProgramInfo *mir): prog{mir} {
+		for(auto var: prog->vars)
+			if(var->type->tag == TT_INT32) scalars.emplace(var->name);
+	}
+
+	void Run() {
+		for(auto func: prog->funcs) {
+			if(!isLeaf(func)) continue;
+			Prepare(func);
+			for(bool changed = true; changed; ) {
+				changed = false;
+				for(std::size_t i = 0; i < func->block.size() && !changed; ++ i)
+					changed = Convert(func, func->block[i]);
+			}
+		}
+	}
+
+private:
+	ProgramInfo *prog;
+	std::set<std::string> scalars;		// global
+	std::set<std::string> locals;		// scalar allocs of the current function
+	std::map<std::string, StmtInfo*> defs;
+	std::set<std::string> names;
+
+	static bool isLeaf(const FuncInfo *func) {
+		for(auto block: func->block)
+			for(auto stmt: block->stmt)
+				if(isCall(stmt)) return false;
+		return true;
+	}
+
+	void Prepare(FuncInfo *func) {
+		locals.clear();
+		defs.clear();
+		names.clear();
+		for(auto block: func->block)
+			for(auto stmt: block->stmt) {
+				ForEachUse(stmt, [&](const std::string &name) { names.emplace(name); });
+				if(stmt->tag != ST_SYMDEF) continue;
+				names.emplace(*stmt->symdef.name);
+				defs[*stmt->symdef.name] = stmt;
+				if(stmt->symdef.tag == SDT_ALLOC && stmt->symdef.alloc->tag != TT_ARRAY) locals.emplace(*stmt->symdef.name);
+			}
+		for(auto param: func->params) names.emplace(param->name);
+		for(auto var: prog->vars) names.emplace(var->name);
+	}
+
+	std::string Fresh(const std::string &base) {
+		auto name = base;
+		for(int i = 1; names.count(name); ++ i) name = base + "_" + std::to_string(i);
+		names.emplace(name);
+		return name;
+	}
+
+	static bool isBoolean(const StmtInfo *def) {
+		if(def == nullptr || def->tag != ST_SYMDEF || def->symdef.tag != SDT_EXPR) return false;
+		auto op = def->symdef.expr->op;
+		return op == OP_LE || op == OP_GE || op == OP_LT || op == OP_GT || op == OP_EQ || op == OP_NEQ;
+	}
+
+	/*
+		Keys naming the value a temporary holds, equal for equal values: loads
+		of the same scalar with no store or call in between, and the same
+		operation on equal values. Anything else is its own name.
+	*/
+	struct Keys {
+		std::map<std::string, std::string> key;
+		std::map<std::string, std::size_t> version;		// of each scalar, bumped by stores
+		std::size_t epoch = 0;							// bumped by calls
+		std::set<std::string> accessed;					// addresses loaded or stored
+
+		std::string of(const ValueInfo *val) const {
+			if(val->tag == VT_INT) return std::to_string(val->i32);
+			if(val->tag == VT_UNDEF) return "?";
+			return of(*val->symbol);
+		}
+		std::string of(const std::string &name) const {
+			auto it = key.find(name);
+			return it == key.end() ? name : it->second;
+		}
+		void visit(const StmtInfo *stmt) {
+			if(stmt->tag == ST_STORE) {
+				auto &addr = *stmt->store.addr;
+				++ version[addr];
+				if(addr.front() == '%') accessed.emplace(of(addr));
+				return ;
+			}
+			if(stmt->tag != ST_SYMDEF) return ;
+			auto &sym = stmt->symdef;
+			switch(sym.tag) {
+				case SDT_LOAD:
+					if(sym.load->front() == '%') accessed.emplace(of(*sym.load));
+					else key[*sym.name] = *sym.load + "#" + std::to_string(version[*sym.load]) + "." + std::to_string(epoch);
+					break;
+				case SDT_EXPR:
+					key[*sym.name] = "(" + std::to_string(sym.expr->op) + " " + of(sym.expr->left) + " " + of(sym.expr->right) + ")";
+					break;
+				case SDT_GETELEMPTR:
+				case SDT_GETPTR:
+					key[*sym.name] = std::string(sym.tag == SDT_GETPTR ? "[" : "{") + of(*sym.ptr.src) + " " + of(sym.ptr.index) + "]";
+					break;
+				case SDT_FUNCALL: ++ epoch; break;
+				case SDT_ALLOC: break;
+			}
+		}
+	};
+
+	// What a branch assigns, if it can run whatever the condition
+	struct Branch {
+		std::vector<StmtInfo*> code;						// all but the stores and the jump
+		std::vector<std::pair<std::string, ValueInfo*> > stores;	// the last value stored to each local
+	};
+
+	bool Speculate(BlockInfo *block, Keys &keys, Branch &branch) {
+		std::set<std::string> stored;
+		for(std::size_t i = 0; i + 1 < block->stmt.size(); ++ i) {
+			auto stmt = block->stmt[i];
+			if(stmt->tag == ST_STORE) {
+				auto &addr = *stmt->store.addr;
+				if(!stmt->store.isValue || !locals.count(addr)) return false;
+				stored.emplace(addr);
+				auto last = std::find_if(branch.stores.begin(), branch.stores.end(), [&](auto &s) { return s.first == addr; });
+				if(last == branch.stores.end()) branch.stores.emplace_back(addr, stmt->store.val);
+				else last->second = stmt->store.val;
+				continue;
+			}
+			if(stmt->tag != ST_SYMDEF) return false;
+			auto &sym = stmt->symdef;
+			switch(sym.tag) {
+				case SDT_EXPR:
+					if(sym.expr->op == OP_DIV || sym.expr->op == OP_MOD) return false;
+					break;
+				case SDT_LOAD: {
+					auto &src = *sym.load;
+					if(stored.count(src)) return false;
+					if(src.front() == '%') {
+						if(!keys.accessed.count(keys.of(src))) return false;
+					}
+					else if(!locals.count(src) && !scalars.count(src)) return false;
+					break;
+				}
+				case SDT_GETELEMPTR:
+				case SDT_GETPTR: break;
+				case SDT_ALLOC:
+				case SDT_FUNCALL: return false;
+			}
+			keys.visit(stmt);
+			branch.code.emplace_back(stmt);
+		}
+		return branch.code.size() <= SPECULATED;
+	}
+
+	bool Convert(FuncInfo *func, BlockInfo *head) {
+		if(head->stmt.empty() || head->stmt.back()->tag != ST_BR) return false;
+		auto br = head->stmt.back();
+		if(br->jump.cond->tag != VT_SYMBOL || *br->jump.blkThen == *br->jump.blkElse) return false;
+		std::map<std::string, BlockInfo*> blocks;
+		std::map<std::string, std::size_t> preds;
+		for(auto block: func->block) {
+			blocks[block->name] = block;
+			if(block->stmt.empty()) continue;
+			auto last = block->stmt.back();
+			if(last->tag == ST_JUMP || last->tag == ST_BR) ++ preds[*last->jump.blkThen];
+			if(last->tag == ST_BR) ++ preds[*last->jump.blkElse];
+		}
+		// An arm jumps on to the other target (a triangle), or both to a third (a diamond)
+		auto jumpsTo = [&](const std::string &name) -> std::string {
+			auto block = blocks.at(name);
+			if(preds[name] != 1 || block == func->block.front() || block->stmt.empty() || block->stmt.back()->tag != ST_JUMP)
+				return "";
+			return *block->stmt.back()->jump.blkThen;
+		};
+		auto &thenName = *br->jump.blkThen, &elseName = *br->jump.blkElse;
+		std::string join;
+		BlockInfo *arm[2] = {nullptr, nullptr};		// then, else
+		if(jumpsTo(thenName) == elseName) join = elseName, arm[0] = blocks.at(thenName);
+		else if(jumpsTo(elseName) == thenName) join = thenName, arm[1] = blocks.at(elseName);
+		else if(!jumpsTo(thenName).empty() && jumpsTo(thenName) == jumpsTo(elseName)) {
+			join = jumpsTo(thenName);
+			arm[0] = blocks.at(thenName), arm[1] = blocks.at(elseName);
+		}
+		else return false;
+		if(join == head->name || arm[0] == head || arm[1] == head) return false;
+
+		Keys keys;
+		for(auto stmt: head->stmt) keys.visit(stmt);
+		Branch branch[2];
+		for(int i = 0; i < 2; ++ i)
+			if(arm[i] != nullptr) {
+				Keys mine = keys;
+				if(!Speculate(arm[i], mine, branch[i])) return false;
+			}
+		if(branch[0].code.size() + branch[1].code.size() > SPECULATED) return false;
+		std::cerr << "if-convert: " << head->name << " in " << func->name << '\n';
+
+		// both branches, then the selects, then on to the join
+		auto &stmts = head->stmt;
+		stmts.pop_back();
+		for(auto &b: branch) stmts.insert(stmts.end(), b.code.begin(), b.code.end());
+		std::vector<std::string> assigned;
+		for(auto &b: branch)
+			for(auto &[local, val]: b.stores)
+				if(std::find(assigned.begin(), assigned.end(), local) == assigned.end()) assigned.emplace_back(local);
+		std::string mask;
+		if(!assigned.empty()) {
+			auto cond = *br->jump.cond->symbol;
+			if(!isBoolean(defs[cond])) {
+				auto boolean = Fresh("%if_cond");
+				stmts.emplace_back(Expr(boolean, OP_NEQ, new ValueInfo(cond), new ValueInfo(0)));
+				defs[boolean] = stmts.back();
+				cond = boolean;
+			}
+			mask = Fresh("%if_mask");
+			stmts.emplace_back(Expr(mask, OP_SUB, new ValueInfo(0), new ValueInfo(cond)));
+			defs[mask] = stmts.back();
+		}
+		for(auto &local: assigned) {
+			ValueInfo *val[2] = {nullptr, nullptr};
+			for(int i = 0; i < 2; ++ i)
+				for(auto &[to, v]: branch[i].stores)
+					if(to == local) val[i] = Copy(v);
+			for(auto &v: val)
+				if(v == nullptr) {
+					auto old = Fresh("%" + local.substr(1) + "_old");
+					stmts.emplace_back(Load(old, local));
+					v = new ValueInfo(old);
+				}
+			auto diff = Fresh("%if_diff"), picked = Fresh("%if_pick"), result = Fresh("%if_val");
+			stmts.emplace_back(Expr(diff, OP_SUB, val[0], val[1]));
+			stmts.emplace_back(Expr(picked, OP_LAND, new ValueInfo(diff), new ValueInfo(mask)));
+			stmts.emplace_back(Expr(result, OP_ADD, Copy(val[1]), new ValueInfo(picked)));
+			stmts.emplace_back(Store(new ValueInfo(result), local));
+		}
+		delete br;
+
+		// the arms are gone, and so is the join if only the head reaches it now
+		std::set<BlockInfo*> doomed;
+		for(auto block: arm)
+			if(block != nullptr) {
+				auto &code = block->stmt;
+				code.erase(std::remove_if(code.begin(), code.end(), [&](StmtInfo *stmt) {
+					return std::find(stmts.begin(), stmts.end(), stmt) != stmts.end();
+				}), code.end());
+				doomed.emplace(block);
+			}
+		auto joined = blocks.at(join);
+		if(preds[join] == 2 && joined != func->block.front()) {		// both edges were from the 'if'
+			stmts.insert(stmts.end(), joined->stmt.begin(), joined->stmt.end());
+			joined->stmt.clear();
+			doomed.emplace(joined);
+		}
+		else {
+			auto jump = new StmtInfo;
+			jump->tag = ST_JUMP;
+			jump->jump.blkThen = new std::string(join);
+			stmts.emplace_back(jump);
+		}
+		auto &order = func->block;
+		order.erase(std::remove_if(order.begin(), order.end(), [&](BlockInfo *block) {
+			if(!doomed.count(block)) return false;
+			delete block;
+			return true;
+		}), order.end());
+		return true;
+	}
+};
+
+}
+
+void InterproceduralOptimize(ProgramInfo *mir) {
+	Optimizer(mir).Run();
+}
+
+void MemoizeRecursion(ProgramInfo *mir) {
+	Memoizer(mir).Run();
+}
+
+void PromoteGlobals(ProgramInfo *mir) {
+	GlobalPromoter(mir).Run();
+}
+
+void IfConvert(ProgramInfo *mir) {
+	IfConverter(mir).Run();
+}
@@ -5,10 +5,14 @@
 #include <sstream>
 #include <memory>
 #include <string>
+#include <vector>
+#include <functional>
 #include <cassert>
 
 #include "mir.hpp"
 
+extern void ParallelFor(std::size_t n, const std::function<void(std::size_t)> &work);
+
 static std::string OperatorIR(Operator op) {
 	static std::string IR[] = {
 		"??", "??", "??", "mul", "div", "mod", "add", "sub",
@@ -46,6 +50,32 @@ void ValueToIR(std::ostream &out, ValueInfo *mir) {
 	else if(mir->tag == VT_SYMBOL) out << *(mir->symbol);
 }
 
+/*
+	Prints the sub-array of dims[d..] at word `pos` of a run-length
+	initializer; one without any run is zeroinit. `run` is the first run
+	not ending before `pos`.
+*/
+static void RunsToIR(std::ostream &out, const InitializerInfo *mir, std::size_t d, std::size_t pos,
+					 std::size_t size, std::size_t &run) {
+	auto &runs = mir->runs;
+	while(run < runs.size() && runs[run].first + runs[run].second.size() <= pos) ++ run;
+	if(run == runs.size() || runs[run].first >= pos + size) {
+		out << (d == mir->dims.size() ? "0" : "zeroinit");
+		return ;
+	}
+	if(d == mir->dims.size()) {
+		out << runs[run].second[pos - runs[run].first];
+		return ;
+	}
+	std::size_t sub = size / mir->dims[d];
+	out << "{";
+	for(std::size_t i = 0; i < mir->dims[d]; ++ i) {
+		if(i > 0) out << ", ";
+		RunsToIR(out, mir, d + 1, pos + i * sub, sub, run);
+	}
+	out << "}";
+}
+
 void InitializerToIR(std::ostream &out, InitializerInfo *mir) {
 	switch(mir->tag) {
 		case IT_UNDEF: 
@@ -65,6 +95,11 @@ void InitializerToIR(std::ostream &out, InitializerInfo *mir) {
 			}
 			out << "}";
 			break;
+		case IT_RUNS: {
+			std::size_t run = 0;
+			RunsToIR(out, mir, 0, 0, mir->words(), run);
+			break;
+		}
 	}
 }
 
@@ -101,6 +136,13 @@ void StmtToIR(std::ostream &out, StmtInfo *mir) {
 					out << ")\n";
 					break;
 				}
+				case SDT_GETELEMPTR:
+				case SDT_GETPTR:
+					out << (mir->symdef.tag == SDT_GETELEMPTR ? "getelemptr " : "getptr ")
+						<< *mir->symdef.ptr.src << ", ";
+					ValueToIR(out, mir->symdef.ptr.index);
+					out << '\n';
+					break;
 			}
 			break;
 		case ST_RETURN:
@@ -111,7 +153,7 @@ void StmtToIR(std::ostream &out, StmtInfo *mir) {
 		case ST_STORE:
 			out << "  " << "store ";
 			if(mir->store.isValue) ValueToIR(out, mir->store.val);
-			else assert(0);
+			else InitializerToIR(out, mir->store.init);
 			out << ", " << *mir->store.addr << '\n';
 			break;
 		case ST_BR:
@@ -143,7 +185,6 @@ void FuncToIR(std::ostream &out, FuncInfo *mir) {
 		out << ": " << IRType(mir->ret);
 	}
 	out << " {\n";
-	std::cerr << "block size = " << mir->block.size() << '\n';
 	for(auto block: mir->block) {
 		BlockToIR(out, block);
 	}
@@ -166,7 +207,11 @@ void ProgramToIR(std::ostream &out, ProgramInfo *mir) {
 		out << '\n';
 	}
 
-	for(auto func: mir -> funcs) {
-		FuncToIR(out, func);
-	}
+	std::vector<std::string> text(mir->funcs.len);
+	ParallelFor(mir->funcs.len, [&](std::size_t i) {
+		std::ostringstream buf;
+		FuncToIR(buf, mir->funcs[i]);
+		text[i] = buf.str();
+	});
+	for(auto &func: text) out << func;
 }
\ No newline at end of file
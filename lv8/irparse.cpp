@@ -0,0 +1,506 @@
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <cassert>
+
+#include "mir.hpp"
+#include "sysy_exceptions.hpp"
+
+/*
+	Reads Koopa IR text (see koopa.ebnf) back into MIR, the inverse of
+	irgen.cpp. The lexer works on the text in place, and the parser is
+	recursive descent. Names are normalized to what the backend expects
+	from the SysY front end: blocks become %blockN, values %-symbols, and
+	only allocs and parameters keep an @-name inside a function.
+
+	Not supported, as MIR has no counterpart: block arguments, and the
+	operators xor/shl/shr/sar.
+*/
+
+namespace {
+
+enum TokenTag { TK_END, TK_SYMBOL, TK_INT, TK_WORD, TK_PUNCT };
+
+struct Token {
+	TokenTag tag;
+	std::string_view text;
+	long long num;
+	int line;
+};
+
+class Lexer {
+public:
+	explicit Lexer(std::string_view src): src{src} {}
+
+	Token Next() {
+		SkipSpace();
+		Token ret{TK_END, {}, 0, line};
+		if(pos >= src.size()) return ret;
+		std::size_t begin = pos;
+		char c = src[pos];
+		if(c == '@' || c == '%') {
+			++ pos;
+			while(pos < src.size() && isIdent(src[pos])) ++ pos;
+			if(pos == begin + 1) throw syntax_error(Where() + "empty symbol name");
+			ret.tag = TK_SYMBOL;
+		}
+		else if(std::isdigit(c) || (c == '-' && pos + 1 < src.size() && std::isdigit(src[pos + 1]))) {
+			++ pos;
+			while(pos < src.size() && std::isdigit(src[pos])) ++ pos;
+			ret.tag = TK_INT;
+			ret.num = std::stoll(std::string(src.substr(begin, pos - begin)));
+		}
+		else if(std::isalpha(c) || c == '_') {
+			while(pos < src.size() && isIdent(src[pos])) ++ pos;
+			ret.tag = TK_WORD;
+		}
+		else if(std::strchr("(){}[],:=*", c) != nullptr) {
+			++ pos;
+			ret.tag = TK_PUNCT;
+		}
+		else throw syntax_error(Where() + "unexpected character '" + std::string(1, c) + "'");
+		ret.text = src.substr(begin, pos - begin);
+		return ret;
+	}
+
+	std::string Where() const {
+		return "line " + std::to_string(line) + ": ";
+	}
+
+private:
+	std::string_view src;
+	std::size_t pos = 0;
+	int line = 1;
+
+	static bool isIdent(char c) {
+		return std::isalnum(c) || c == '_';
+	}
+
+	void SkipSpace() {
+		while(pos < src.size()) {
+			if(src[pos] == '\n') ++ line, ++ pos;
+			else if(std::isspace(src[pos])) ++ pos;
+			else if(src.compare(pos, 2, "//") == 0) {
+				while(pos < src.size() && src[pos] != '\n') ++ pos;
+			}
+			else if(src.compare(pos, 2, "/*") == 0) {
+				auto end = src.find("*/", pos + 2);
+				if(end == std::string_view::npos) throw syntax_error(Where() + "unterminated comment");
+				for(; pos < end + 2; ++ pos) line += src[pos] == '\n';
+			}
+			else break;
+		}
+	}
+};
+
+const std::map<std::string_view, Operator> BINARY_OPS = {
+	{"mul", OP_MUL}, {"div", OP_DIV}, {"mod", OP_MOD}, {"add", OP_ADD}, {"sub", OP_SUB},
+	{"le", OP_LE}, {"ge", OP_GE}, {"lt", OP_LT}, {"gt", OP_GT}, {"eq", OP_EQ}, {"ne", OP_NEQ},
+	{"and", OP_LAND}, {"or", OP_LOR}
+};
+
+class Parser {
+public:
+	explicit Parser(std::string_view src): lex{src} {
+		tok = lex.Next();
+	}
+
+	ProgramInfo *Program() {
+		std::vector<VarInfo*> vars;
+		std::vector<FuncInfo*> funcs;
+		while(tok.tag != TK_END) {
+			if(isWord("global")) vars.emplace_back(GlobalDef());
+			else if(isWord("fun")) funcs.emplace_back(FunDef());
+			else if(isWord("decl")) FunDecl();
+			else Fail("expected 'global', 'fun' or 'decl'");
+		}
+		auto ret = new ProgramInfo;
+		ret->vars.init(vars.size());
+		for(std::size_t i = 0; i < vars.size(); ++ i) ret->vars[i] = vars[i];
+		ret->funcs.init(funcs.size());
+		for(std::size_t i = 0; i < funcs.size(); ++ i) ret->funcs[i] = funcs[i];
+		return ret;
+	}
+
+	~Parser() {
+		for(auto &[name, type]: globalTypes) delete type;
+		for(auto &[name, type]: localTypes) delete type;
+		for(auto type: declTypes) delete type;
+	}
+
+private:
+	Lexer lex;
+	Token tok;
+	std::map<std::string, TypeInfo*> globalTypes;		// pointers to the globals
+	std::map<std::string, TypeInfo*> funcRet;			// nullptr for unit
+	std::vector<TypeInfo*> declTypes;
+	std::size_t blockCount = 0;
+
+	// State of the current function
+	std::map<std::string, std::string> rename;
+	std::set<std::string> localNames;
+	std::map<std::string, TypeInfo*> localTypes;
+
+	[[noreturn]] void Fail(const std::string &msg) {
+		throw syntax_error("line " + std::to_string(tok.line) + ": " + msg +
+						   (tok.tag == TK_END ? " at the end" : ", got '" + std::string(tok.text) + "'"));
+	}
+	bool isWord(std::string_view word) const {
+		return tok.tag == TK_WORD && tok.text == word;
+	}
+	bool isPunct(char c) const {
+		return tok.tag == TK_PUNCT && tok.text[0] == c;
+	}
+	void Expect(char c) {
+		if(!isPunct(c)) Fail(std::string("expected '") + c + "'");
+		tok = lex.Next();
+	}
+	void ExpectWord(std::string_view word) {
+		if(!isWord(word)) Fail("expected '" + std::string(word) + "'");
+		tok = lex.Next();
+	}
+	std::string Symbol() {
+		if(tok.tag != TK_SYMBOL) Fail("expected a symbol");
+		std::string ret(tok.text);
+		tok = lex.Next();
+		return ret;
+	}
+	long long Int() {
+		if(tok.tag != TK_INT) Fail("expected an integer");
+		auto ret = tok.num;
+		tok = lex.Next();
+		return ret;
+	}
+
+	TypeInfo *Type() {
+		if(isWord("i32")) {
+			tok = lex.Next();
+			return new TypeInfo(TT_INT32);
+		}
+		if(isPunct('*')) {
+			tok = lex.Next();
+			return TypeInfo::Pointer(Type());
+		}
+		if(isPunct('[')) {
+			tok = lex.Next();
+			auto base = Type();
+			Expect(',');
+			auto len = Int();
+			Expect(']');
+			if(len <= 0) Fail("array length must be positive");
+			return TypeInfo::Array(base, len);
+		}
+		Fail("expected a type");
+	}
+
+	// Flattens an initializer of `type`, appending its non-zero words at `pos`
+	void Initializer(const TypeInfo *type, std::size_t pos, InitializerInfo *runs) {
+		if(tok.tag == TK_INT) {
+			if(type->tag != TT_INT32) Fail("an integer can't initialize an aggregate");
+			int val = Int();
+			if(val == 0) return ;
+			auto &r = runs->runs;
+			if(r.empty() || r.back().first + r.back().second.size() != pos)
+				r.emplace_back(pos, std::vector<int>());
+			r.back().second.emplace_back(val);
+		}
+		else if(isWord("zeroinit") || isWord("undef")) tok = lex.Next();
+		else if(isPunct('{')) {
+			if(type->tag != TT_ARRAY) Fail("an aggregate can only initialize an array");
+			tok = lex.Next();
+			std::size_t sub = type->array.base->size() / 4u;
+			for(std::size_t i = 0; i < type->array.len; ++ i) {
+				if(i > 0) Expect(',');
+				Initializer(type->array.base, pos + i * sub, runs);
+			}
+			Expect('}');
+		}
+		else Fail("expected an initializer");
+	}
+	InitializerInfo *Initializer(const TypeInfo *type) {
+		auto ret = new InitializerInfo;
+		ret->tag = IT_ZERO;
+		if(isWord("undef")) ret->tag = IT_UNDEF;
+		else if(tok.tag == TK_INT && type->tag == TT_INT32) {
+			ret->tag = IT_NUM;
+			ret->num = tok.num;
+		}
+		if(ret->tag != IT_ZERO) {
+			tok = lex.Next();
+			return ret;
+		}
+		Initializer(type, 0, ret);
+		if(!ret->runs.empty()) {
+			ret->tag = IT_RUNS;
+			for(auto t = type; t->tag == TT_ARRAY; t = t->array.base) ret->dims.emplace_back(t->array.len);
+		}
+		return ret;
+	}
+
+	VarInfo *GlobalDef() {
+		ExpectWord("global");
+		auto var = new VarInfo;
+		var->name = Symbol();
+		if(var->name[0] != '@') Fail("a global must be named by '@'");
+		Expect('=');
+		ExpectWord("alloc");
+		var->type = Type();
+		Expect(',');
+		var->init = Initializer(var->type);
+		globalTypes[var->name] = TypeInfo::Pointer(var->type->clone());
+		return var;
+	}
+
+	void FunDecl() {
+		ExpectWord("decl");
+		auto name = Symbol();
+		Expect('(');
+		while(!isPunct(')')) {
+			delete Type();
+			if(!isPunct(')')) Expect(',');
+		}
+		Expect(')');
+		TypeInfo *ret = nullptr;
+		if(isPunct(':')) {
+			tok = lex.Next();
+			ret = Type();
+			declTypes.emplace_back(ret);
+		}
+		funcRet[name] = ret;
+	}
+
+	// Local names are renamed: values to %-symbols, blocks to %blockN
+	std::string Local(const std::string &name) {
+		auto it = rename.find(name);
+		if(it == rename.end()) Fail("undefined symbol " + name);
+		return it->second;
+	}
+	std::string DefineLocal(const std::string &name, bool isValue, const std::string &prefix = "") {
+		if(rename.count(name) || globalTypes.count(name)) Fail("redefinition of " + name);
+		std::string res = prefix.empty() ? std::string(1, isValue ? '%' : '@') + name.substr(1) : prefix;
+		while(localNames.count(res)) res += "_";
+		localNames.emplace(res);
+		return rename[name] = res;
+	}
+	std::string Block(const std::string &name) {
+		auto it = rename.find(name);
+		if(it != rename.end()) return it->second;
+		return DefineLocal(name, true, "%block" + std::to_string(++ blockCount));
+	}
+	TypeInfo *TypeOf(const std::string &local) {
+		auto it = localTypes.find(local);
+		if(it != localTypes.end()) return it->second;
+		auto global = globalTypes.find(local);
+		if(global != globalTypes.end()) return global->second;
+		Fail("unknown type of " + local);
+	}
+	std::string Use(const std::string &name) {
+		return globalTypes.count(name) ? name : Local(name);
+	}
+
+	ValueInfo *Value() {
+		if(tok.tag == TK_INT) return new ValueInfo(int(Int()));
+		if(isWord("undef")) {
+			tok = lex.Next();
+			return new ValueInfo();
+		}
+		return new ValueInfo(Use(Symbol()));
+	}
+
+	FuncInfo *FunDef() {
+		ExpectWord("fun");
+		auto func = new FuncInfo;
+		func->ret = nullptr;
+		rename.clear();
+		localNames.clear();
+		for(auto &[name, type]: localTypes) delete type;
+		localTypes.clear();
+		auto name = Symbol();
+		if(name[0] != '@') Fail("a function must be named by '@'");
+		func->name = name.substr(1);
+		Expect('(');
+		while(!isPunct(')')) {
+			auto param = new VarInfo;
+			param->init = nullptr;
+			param->name = DefineLocal(Symbol(), false);
+			Expect(':');
+			param->type = Type();
+			func->params.emplace_back(param);
+			localTypes[param->name] = param->type->clone();
+			if(!isPunct(')')) Expect(',');
+		}
+		Expect(')');
+		if(isPunct(':')) {
+			tok = lex.Next();
+			func->ret = Type();
+		}
+		funcRet[name] = func->ret;
+		Expect('{');
+		while(!isPunct('}')) func->block.emplace_back(BlockDef());
+		Expect('}');
+		if(func->block.empty()) Fail("function " + name + " has no blocks");
+		return func;
+	}
+
+	BlockInfo *BlockDef() {
+		auto block = new BlockInfo;
+		block->name = Block(Symbol());
+		if(isPunct('(')) Fail("block arguments are not supported");
+		Expect(':');
+		while(!block->closed()) block->stmt.emplace_back(Statement());
+		return block;
+	}
+
+	// Skips an initializer, whose type is only known from the address after it
+	void SkipInitializer() {
+		int depth = 0;
+		do {
+			if(tok.tag == TK_END) Fail("unterminated aggregate");
+			if(isPunct('{')) ++ depth;
+			else if(isPunct('}')) -- depth;
+			tok = lex.Next();
+		} while(depth > 0);
+	}
+
+	StmtInfo *Statement() {
+		auto stmt = new StmtInfo;
+		if(tok.tag == TK_SYMBOL) SymbolDef(stmt);
+		else if(isWord("store")) {
+			tok = lex.Next();
+			stmt->tag = ST_STORE;
+			stmt->store.isValue = tok.tag == TK_SYMBOL || tok.tag == TK_INT || isWord("undef");
+			Lexer initLex = lex;
+			Token initTok = tok;
+			if(stmt->store.isValue) stmt->store.val = Value();
+			else SkipInitializer();
+			Expect(',');
+			auto addr = Use(Symbol());
+			stmt->store.addr = new std::string(addr);
+			if(!stmt->store.isValue) {
+				auto type = TypeOf(addr);
+				if(type->tag != TT_POINTER) Fail("store to a non-pointer " + addr);
+				std::swap(lex, initLex);
+				std::swap(tok, initTok);
+				stmt->store.init = Initializer(type->pointer.base);
+				std::swap(lex, initLex);
+				std::swap(tok, initTok);
+			}
+		}
+		else if(isWord("call")) {
+			stmt->tag = ST_SYMDEF;
+			stmt->symdef.tag = SDT_FUNCALL;
+			stmt->symdef.name = new std::string();
+			Call(stmt);
+		}
+		else if(isWord("ret")) {
+			int line = tok.line;
+			tok = lex.Next();
+			stmt->tag = ST_RETURN;
+			stmt->ret.val = nullptr;
+			// a value follows on the same line; a symbol on the next is a label
+			if(tok.line == line && (tok.tag == TK_SYMBOL || tok.tag == TK_INT || isWord("undef"))) stmt->ret.val = Value();
+		}
+		else if(isWord("jump")) {
+			tok = lex.Next();
+			stmt->tag = ST_JUMP;
+			stmt->jump.blkThen = new std::string(Block(Symbol()));
+			if(isPunct('(')) Fail("block arguments are not supported");
+		}
+		else if(isWord("br")) {
+			tok = lex.Next();
+			stmt->tag = ST_BR;
+			stmt->jump.cond = Value();
+			Expect(',');
+			stmt->jump.blkThen = new std::string(Block(Symbol()));
+			Expect(',');
+			stmt->jump.blkElse = new std::string(Block(Symbol()));
+			if(isPunct('(')) Fail("block arguments are not supported");
+		}
+		else Fail("expected a statement");
+		return stmt;
+	}
+
+	void Call(StmtInfo *stmt) {
+		ExpectWord("call");
+		auto fun = Symbol();
+		if(!funcRet.count(fun)) Fail("call to undeclared function " + fun);
+		stmt->symdef.func.fun = new std::string(fun);
+		stmt->symdef.func.para = new std::vector<ValueInfo*>;
+		Expect('(');
+		while(!isPunct(')')) {
+			stmt->symdef.func.para->emplace_back(Value());
+			if(!isPunct(')')) Expect(',');
+		}
+		Expect(')');
+	}
+
+	void SymbolDef(StmtInfo *stmt) {
+		auto name = Symbol();
+		Expect('=');
+		if(tok.tag != TK_WORD) Fail("expected an instruction");
+		stmt->tag = ST_SYMDEF;
+		stmt->symdef.name = nullptr;
+		TypeInfo *type = nullptr;
+		if(isWord("alloc")) {
+			tok = lex.Next();
+			stmt->symdef.tag = SDT_ALLOC;
+			stmt->symdef.alloc = Type();
+			stmt->symdef.name = new std::string(DefineLocal(name, false));
+			type = TypeInfo::Pointer(stmt->symdef.alloc->clone());
+		}
+		else if(isWord("load")) {
+			tok = lex.Next();
+			stmt->symdef.tag = SDT_LOAD;
+			stmt->symdef.load = new std::string(Use(Symbol()));
+			auto src = TypeOf(*stmt->symdef.load);
+			if(src->tag != TT_POINTER) Fail("load from a non-pointer " + *stmt->symdef.load);
+			type = src->pointer.base->clone();
+		}
+		else if(isWord("getelemptr") || isWord("getptr")) {
+			bool elem = isWord("getelemptr");
+			tok = lex.Next();
+			stmt->symdef.tag = elem ? SDT_GETELEMPTR : SDT_GETPTR;
+			stmt->symdef.ptr.src = new std::string(Use(Symbol()));
+			Expect(',');
+			stmt->symdef.ptr.index = Value();
+			auto src = TypeOf(*stmt->symdef.ptr.src);
+			if(src->tag != TT_POINTER || (elem && src->pointer.base->tag != TT_ARRAY))
+				Fail("bad pointer operand " + *stmt->symdef.ptr.src);
+			stmt->symdef.ptr.base = (elem ? src->pointer.base->array.base : src->pointer.base)->clone();
+			type = TypeInfo::Pointer(stmt->symdef.ptr.base->clone());
+		}
+		else if(isWord("call")) {
+			stmt->symdef.tag = SDT_FUNCALL;
+			Call(stmt);
+			auto ret = funcRet[*stmt->symdef.func.fun];
+			if(ret == nullptr) Fail("the result of " + *stmt->symdef.func.fun + " is unit");
+			type = ret->clone();
+		}
+		else {
+			auto op = BINARY_OPS.find(tok.text);
+			if(op == BINARY_OPS.end()) Fail("unsupported instruction");
+			tok = lex.Next();
+			stmt->symdef.tag = SDT_EXPR;
+			auto left = Value();
+			Expect(',');
+			stmt->symdef.expr = new ExprInfo(op->second, left, Value());
+			type = new TypeInfo(TT_INT32);
+		}
+		if(stmt->symdef.name == nullptr) stmt->symdef.name = new std::string(DefineLocal(name, true));
+		localTypes[*stmt->symdef.name] = type;
+	}
+};
+
+}
+
+// Parses Koopa IR text into MIR; throws syntax_error on malformed input
+ProgramInfo *ParseIR(const std::string &text) {
+	Parser parser(text);
+	return parser.Program();
+}
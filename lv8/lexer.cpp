@@ -0,0 +1,193 @@
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "sysy.tab.hpp"
+#include "sysy_exceptions.hpp"
+
+/*
+	Hand-written scanner, linked instead of the Flex one (sysy.l) when
+	building with LEXER=hand. It runs over the whole source in memory and
+	produces tokens as views into it; only yylex turns them into values,
+	an interned name for an identifier and the value of a number.
+	Characters are classified by a table, keywords found by a perfect hash
+	and comments skipped with memchr, so no input makes it backtrack.
+
+	The token stream is that of sysy.l: only "==" and "!=" are single
+	tokens, the grammar takes "<=", "&&" and the like as two characters.
+*/
+
+namespace {
+
+struct Token {
+	int kind;		// a Bison token, a character, or 0 at the end of the input
+	std::uint32_t offset, length;
+};
+
+enum CharClass: std::uint8_t { CC_OTHER, CC_SPACE, CC_ALPHA, CC_DIGIT };
+
+constexpr auto CLASSES = []() {
+	std::array<std::uint8_t, 256> cls{};
+	for(int c: {' ', '\t', '\r', '\n'}) cls[c] = CC_SPACE;
+	for(int c = 'a'; c <= 'z'; ++ c) cls[c] = cls[c - 'a' + 'A'] = CC_ALPHA;
+	cls['_'] = CC_ALPHA;
+	for(int c = '0'; c <= '9'; ++ c) cls[c] = CC_DIGIT;
+	return cls;
+}();
+
+inline CharClass ClassOf(char c) {
+	return CharClass(CLASSES[static_cast<unsigned char>(c)]);
+}
+
+// Unique over the keywords: an identifier is a keyword iff it equals the one in its slot
+constexpr unsigned KeywordHash(const char *str, std::size_t len) {
+	return (5u * static_cast<unsigned char>(str[0]) + static_cast<unsigned char>(str[len - 1]) + len) & 15u;
+}
+
+struct Keyword {
+	const char *text;
+	std::size_t length;
+	int kind;
+};
+
+constexpr Keyword KEYWORD_LIST[] = {
+	{"int", 3, INT}, {"void", 4, VOID}, {"return", 6, RETURN}, {"const", 5, CONST}, {"if", 2, IF},
+	{"else", 4, ELSE}, {"while", 5, WHILE}, {"break", 5, BREAK}, {"continue", 8, CONTINUE}
+};
+
+constexpr auto KEYWORDS = []() {
+	std::array<Keyword, 16> table{};
+	for(auto &kw: KEYWORD_LIST) table[KeywordHash(kw.text, kw.length)] = kw;
+	return table;
+}();
+
+static_assert([]() {
+	std::size_t used = 0;
+	for(auto &kw: KEYWORDS) used += kw.text != nullptr;
+	return used == std::size(KEYWORD_LIST);
+}(), "the keyword hash isn't perfect");
+
+int IdentKind(const char *str, std::size_t len) {
+	auto &kw = KEYWORDS[KeywordHash(str, len)];
+	return kw.length == len && std::memcmp(kw.text, str, len) == 0 ? kw.kind : IDENT;
+}
+
+// The value strtol(text, nullptr, 0) would give: saturated at LONG_MAX, then truncated to int
+int NumberValue(const char *str, std::size_t len) {
+	unsigned base = 10;
+	if(len > 1 && str[0] == '0') {
+		base = 8, ++ str, -- len;
+		if(*str == 'x' || *str == 'X') base = 16, ++ str, -- len;
+	}
+	constexpr unsigned long MAX = LONG_MAX;
+	unsigned long val = 0;
+	for(std::size_t i = 0; i < len; ++ i) {
+		char c = str[i];
+		unsigned digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+		if(val > (MAX - digit) / base) return int(long(MAX));
+		val = val * base + digit;
+	}
+	return int(long(val));
+}
+
+class Scanner {
+public:
+	const char *begin = nullptr, *pos = nullptr, *end = nullptr;
+
+	void reset(const char *data, std::size_t size) {
+		if(size > UINT32_MAX) throw sysy_error("source file too large");
+		begin = pos = data;
+		end = data + size;
+	}
+
+	Token next() {
+		SkipBlank();
+		const char *start = pos;
+		if(pos == end) return Token{0, Offset(start), 0};
+		int kind;
+		switch(ClassOf(*pos)) {
+			case CC_ALPHA:
+				while(++ pos < end && ClassOf(*pos) >= CC_ALPHA) ;
+				kind = IdentKind(start, pos - start);
+				break;
+			case CC_DIGIT:
+				ScanNumber();
+				kind = INT_CONST;
+				break;
+			default:
+				kind = *pos ++;
+				if((kind == '=' || kind == '!') && pos < end && *pos == '=') {
+					kind = kind == '=' ? SYM_EQ : SYM_NEQ;
+					++ pos;
+				}
+		}
+		return Token{kind, Offset(start), std::uint32_t(pos - start)};
+	}
+
+private:
+	std::uint32_t Offset(const char *ptr) const {
+		return std::uint32_t(ptr - begin);
+	}
+
+	void SkipBlank() {
+		while(true) {
+			while(pos < end && ClassOf(*pos) == CC_SPACE) ++ pos;
+			if(end - pos < 2 || pos[0] != '/') return ;
+			if(pos[1] == '/') {
+				auto eol = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+				pos = eol == nullptr ? end : eol;
+			}
+			else if(pos[1] == '*') {
+				auto close = CommentEnd(pos + 2);
+				if(close == nullptr) return ;	// unterminated, so '/' and '*' are tokens
+				pos = close;
+			}
+			else return ;
+		}
+	}
+
+	// Just past the "*/" closing a block comment whose body starts at ptr, nullptr if none
+	const char *CommentEnd(const char *ptr) const {
+		while(ptr < end) {
+			auto star = static_cast<const char*>(std::memchr(ptr, '*', end - ptr));
+			if(star == nullptr || star + 1 == end) return nullptr;
+			if(star[1] == '/') return star + 2;
+			ptr = star + 1;
+		}
+		return nullptr;
+	}
+
+	// The longest of [1-9][0-9]*, 0[0-7]* and 0[xX][0-9A-Fa-f]+, as sysy.l
+	void ScanNumber() {
+		auto isHex = [](char c) {
+			return ClassOf(c) == CC_DIGIT || ('a' <= (c | 0x20) && (c | 0x20) <= 'f');
+		};
+		if(*pos != '0') {
+			while(++ pos < end && ClassOf(*pos) == CC_DIGIT) ;
+		}
+		else if(end - pos > 2 && (pos[1] == 'x' || pos[1] == 'X') && isHex(pos[2])) {
+			pos += 2;
+			while(++ pos < end && isHex(*pos)) ;
+		}
+		else {
+			while(++ pos < end && '0' <= *pos && *pos <= '7') ;
+		}
+	}
+} scanner;
+
+}
+
+// The source to scan, which must stay in place while parsing
+void LexerInput(const char *data, std::size_t size) {
+	scanner.reset(data, size);
+}
+
+int yylex() {
+	auto tok = scanner.next();
+	const char *text = scanner.begin + tok.offset;
+	if(tok.kind == IDENT) yylval.str_val = InternIdent(text, tok.length);
+	else if(tok.kind == INT_CONST) yylval.int_val = NumberValue(text, tok.length);
+	return tok.kind;
+}
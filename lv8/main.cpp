@@ -6,22 +6,104 @@
 #include <memory>
 #include <string>
 #include <cassert>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "ast.hpp"
 
+#ifdef HAND_LEXER
+extern void LexerInput(const char *data, std::size_t size);
+#else
 extern FILE *yyin;
+#endif
 extern int yyparse (ASTree &ast);
 extern void ProgramToIR(std::ostream &out, ProgramInfo *mir);
 extern void ProgramToASM(std::ostream &out, ProgramInfo *mir);
+extern int ProgramRun(ProgramInfo *mir, FILE *in, FILE *out, FILE *profile);
+extern bool LoadProfile(ProgramInfo *mir, const std::string &text);
+extern ProgramInfo *ParseIR(const std::string &text);
+extern std::string ProgramToBinary(ProgramInfo *mir);
+extern void InterproceduralOptimize(ProgramInfo *mir);
+extern void MemoizeRecursion(ProgramInfo *mir);
+extern void PromoteGlobals(ProgramInfo *mir);
+extern void IfConvert(ProgramInfo *mir);
+extern ProgramInfo *BinaryToProgram(const char *data, std::size_t size);
+extern std::string CacheKey(const std::string &source, const std::string &mode, const std::vector<std::string> &flags);
+extern bool CacheLoad(const std::string &dir, const std::string &key, const std::string &ext, std::string &data);
+extern void CacheStore(const std::string &dir, const std::string &key, const std::string &ext, const std::string &data);
+extern std::string cacheDir;
+extern std::size_t codegenThreads;
+extern bool SelectCore(const std::string &name);
+extern bool zicond;
+extern bool rvv;
+
+static bool HasSuffix(const std::string &str, const std::string &suffix) {
+	return str.size() > suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
+// A whole file mapped in, read-only
+struct MappedFile {
+	const char *data = nullptr;
+	std::size_t size = 0;
+	bool open(const char *path) {
+		int fd = ::open(path, O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		bool ok = fstat(fd, &st) == 0;
+		if(ok && st.st_size > 0) {
+			void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			ok = map != MAP_FAILED;
+			if(ok) data = static_cast<const char*>(map), size = st.st_size;
+		}
+		close(fd);
+		return ok;
+	}
+	~MappedFile() {
+		if(size) munmap(const_cast<char*>(data), size);
+	}
+};
+
+// Maps the file in and decodes it as binary MIR
+static ProgramInfo *LoadBinary(const char *path) {
+	MappedFile file;
+	if(!file.open(path) || file.size == 0) return nullptr;
+	return BinaryToProgram(file.data, file.size);
+}
+
+#ifndef HAND_PARSER
 extern int yydebug;
+#endif
 
 int main(int argc, char *argv[]) {
-	if( argc != 5 || std::strcmp(argv[3], "-o") ) {
+	if( argc < 5 || std::strcmp(argv[3], "-o") ) {
 		fprintf(stderr, 
 			"  SysY Compiler - Compile SysY code to Koopa IR\n"
 			"\n"
-			"  Usage: %s <Mode> <Source File Path> -o <Output Path>\n",
+			"  Usage: %s <Mode> <Source File Path> -o <Output Path> [Options]\n"
+			"  Modes: -koopa, -riscv, -mir for binary MIR, or -run to interpret the program,\n"
+			"         with its output to <Output Path> ('-' for stdout) and its result as the exit code\n"
+			"  A source file ending in .koopa is read as Koopa IR, and one ending in .mir as\n"
+			"  binary MIR, instead of SysY.\n"
+			"  Options:\n"
+			"    -cache <Dir>  reuse outputs of identical compilations from <Dir>\n"
+			"                  (default: $SYSY_CACHE_DIR, no cache if unset)\n"
+			"    -fprofile-generate <File>\n"
+			"                  with -run, write the executions of each block to <File>\n"
+			"    -fprofile-use <File>\n"
+			"                  lay out blocks and weigh spills by a profile of the same\n"
+			"                  source and options from -fprofile-generate\n"
+			"    -j <N>        emit functions on N threads (default: one per hardware thread)\n"
+			"    -memo         memoize pure recursive functions of small integer arguments\n"
+			"    -mrvv         vectorize simple loops over int arrays with the V extension\n"
+			"    -mtune <Core> schedule instructions and lay out blocks for <Core>:\n"
+			"                  rvsim (default), rocket-rv32, or none\n"
+			"    -mzicond      use the Zicond extension (czero.eqz/czero.nez) for selects\n",
 			argv[0]
 		);
 		return 1;
@@ -31,51 +113,206 @@ int main(int argc, char *argv[]) {
 	const char *input  = argv[2];
 	const char *output = argv[4];
 
-	yyin = fopen(input, "r");
-	
-	if(yyin == NULL) {
-		fprintf(stderr, "Could not open source file: %s\n", input);
+	if(strcmp(mode, "-koopa") && strcmp(mode, "-riscv") && strcmp(mode, "-run") && strcmp(mode, "-mir")) {
+		fprintf(stderr, "Unknown mode \"%s\"\n", mode);
 		return 1;
 	}
-	
-	ASTree ast;
-
-	#ifndef NDEBUG
-	yydebug = 1;
-	#endif
 
-	int ret = yyparse(ast);
-	if(ret) {
-		fprintf(stderr, "Parse failed. Returned %d.\n", ret);
+	// every option but -cache and -j can change the output, so they all go into the cache key
+	std::vector<std::string> flags;
+	bool memoize = false;
+	const char *profileOut = nullptr;
+	std::string profile;
+	if(auto env = std::getenv("SYSY_CACHE_DIR")) cacheDir = env;
+	for(int i = 5; i < argc; ++ i) {
+		if(!strcmp(argv[i], "-cache") && i + 1 < argc) cacheDir = argv[++ i];
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc && std::atoi(argv[i + 1]) > 0) codegenThreads = std::atoi(argv[++ i]);
+		else if(!strcmp(argv[i], "-memo")) {
+			memoize = true;
+			flags.emplace_back(argv[i]);
+		}
+		else if(!strcmp(argv[i], "-mzicond")) {
+			zicond = true;
+			flags.emplace_back(argv[i]);
+		}
+		else if(!strcmp(argv[i], "-fprofile-generate") && i + 1 < argc) profileOut = argv[++ i];
+		else if(!strcmp(argv[i], "-fprofile-use") && i + 1 < argc) {
+			std::ifstream fin(argv[++ i]);
+			if(!fin) {
+				fprintf(stderr, "Could not open profile: %s\n", argv[i]);
+				return 1;
+			}
+			std::stringstream buf;
+			buf << fin.rdbuf();
+			profile = buf.str();
+			flags.emplace_back(argv[i - 1]);
+			flags.emplace_back(profile);		// by its contents, which may change under the same name
+		}
+		else if(!strcmp(argv[i], "-mrvv")) {
+			rvv = true;
+			flags.emplace_back(argv[i]);
+		}
+		else if(!strcmp(argv[i], "-mtune") && i + 1 < argc) {
+			if(!SelectCore(argv[i + 1])) {
+				fprintf(stderr, "Unknown core \"%s\"\n", argv[i + 1]);
+				return 1;
+			}
+			flags.emplace_back(argv[i]);
+			flags.emplace_back(argv[++ i]);
+		}
+		else {
+			fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
+			return 1;
+		}
+	}
+	if(profileOut != nullptr && strcmp(mode, "-run")) {
+		fprintf(stderr, "-fprofile-generate needs -run\n");
 		return 1;
 	}
+	// -run depends on stdin, so only translations are cached
+	if(!strcmp(mode, "-run")) cacheDir.clear();
+	bool cached = !cacheDir.empty();
 
-	std::cerr << *ast << std::endl;
+	ProgramInfo *prog = nullptr;
+	int ret = 0;
+	std::string inputPath(input);
+	std::string source, outKey, mirKey, ext;
+	if(cached) {
+		std::ifstream fin(input, std::ios::binary);
+		if(!fin) {
+			fprintf(stderr, "Could not open source file: %s\n", input);
+			return 1;
+		}
+		std::stringstream buf;
+		buf << fin.rdbuf();
+		source = buf.str();
 
-	// return 0;
+		ext = !strcmp(mode, "-koopa") ? "koopa" : !strcmp(mode, "-riscv") ? "S" : "mir";
+		outKey = CacheKey(source, mode, flags);
+		std::string text;
+		if(CacheLoad(cacheDir, outKey, ext, text)) {
+			std::ofstream fout(output, std::ios::out | std::ios::binary);
+			fout.write(text.data(), text.size());
+			std::cerr << "Cache hit!\n";
+			return 0;
+		}
+		// the MIR doesn't depend on the mode, so another mode may have left it behind
+		mirKey = CacheKey(source, "MIR", flags);
+		if(CacheLoad(cacheDir, mirKey, "mir", text)) prog = BinaryToProgram(text.data(), text.size());
+	}
 
-	std::ofstream fout(output, std::ios::out);
-	
-	if(strcmp(mode, "-koopa") && strcmp(mode, "-riscv")) {
-		fprintf(stderr, "Unknown mode \"%s\"\n", mode);
+	if(prog != nullptr) std::cerr << "MIR cache hit!\n";
+	else if(HasSuffix(inputPath, ".mir")) {
+		prog = cached ? BinaryToProgram(source.data(), source.size()) : LoadBinary(input);
+		if(prog == nullptr) {
+			fprintf(stderr, "Could not open source file: %s\n", input);
+			return 1;
+		}
+		std::cerr << "MIR loaded!\n";
+	}
+	else if(HasSuffix(inputPath, ".koopa")) {
+		if(!cached) {
+			std::ifstream fin(input);
+			if(!fin) {
+				fprintf(stderr, "Could not open source file: %s\n", input);
+				return 1;
+			}
+			std::stringstream text;
+			text << fin.rdbuf();
+			source = text.str();
+		}
+		prog = ParseIR(source);
+		std::cerr << "IR parsed!\n";
+	}
+	else {
+		// parse the very bytes that were hashed
+		#ifdef HAND_LEXER
+		MappedFile file;
+		if(!cached && !file.open(input)) {
+			fprintf(stderr, "Could not open source file: %s\n", input);
+			return 1;
+		}
+		if(cached) LexerInput(source.data(), source.size());
+		else LexerInput(file.data, file.size);
+		#else
+		yyin = cached ? fmemopen(source.data(), source.size(), "r") : fopen(input, "r");
+		
+		if(yyin == NULL) {
+			fprintf(stderr, "Could not open source file: %s\n", input);
+			return 1;
+		}
+		#endif
+		
+		ASTree ast;
+
+		#if !defined(NDEBUG) && !defined(HAND_PARSER)
+		yydebug = 1;
+		#endif
+
+		auto parseStart = std::chrono::steady_clock::now();
+		ret = yyparse(ast);
+		if(ret) {
+			fprintf(stderr, "Parse failed. Returned %d.\n", ret);
+			return 1;
+		}
+		auto parseTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - parseStart);
+		std::cerr << "Parsed in " << parseTime.count() << " us\n";
+
+		std::cerr << *ast << std::endl;
+
+		prog = dynamic_cast<ProgramInfo*> (ast -> DumpMIR(nullptr).mir);
+		std::cerr << "MIR generated!\n";
+		if(cached) CacheStore(cacheDir, mirKey, "mir", ProgramToBinary(prog));
+	}
+	InterproceduralOptimize(prog);
+	if(memoize) MemoizeRecursion(prog);
+	PromoteGlobals(prog);
+	IfConvert(prog);
+	std::cerr << "MIR optimized!\n";
+	// the profile is of the optimized MIR, whose blocks are those it names
+	if(!profile.empty() && !LoadProfile(prog, profile)) {
+		fprintf(stderr, "Malformed profile\n");
 		return 1;
 	}
 	
-	auto prog = dynamic_cast<ProgramInfo*> (ast -> DumpMIR(nullptr).mir);
-	std::cerr << "MIR generated!\n";
-	// return 0;
-	
-	if(!strcmp(mode, "-koopa")) {
-		ProgramToIR(fout, prog);
+	if(!strcmp(mode, "-run")) {
+		FILE *fout = strcmp(output, "-") ? fopen(output, "w") : stdout;
+		if(fout == NULL) {
+			fprintf(stderr, "Could not open output file: %s\n", output);
+			return 1;
+		}
+		FILE *fprofile = nullptr;
+		if(profileOut != nullptr && (fprofile = fopen(profileOut, "w")) == NULL) {
+			fprintf(stderr, "Could not open profile: %s\n", profileOut);
+			return 1;
+		}
+		ret = ProgramRun(prog, stdin, fout, fprofile) & 0xff;
+		if(fout != stdout) fclose(fout);
+		if(fprofile != nullptr) fclose(fprofile);
+		delete prog;
+		return ret;
+	}
+
+	std::ostringstream text;
+	if(!strcmp(mode, "-mir")) {
+		text << ProgramToBinary(prog);
+		std::cerr << "MIR written!\n";
+	}
+	else if(!strcmp(mode, "-koopa")) {
+		ProgramToIR(text, prog);
 		std::cerr << "IR generated!\n";
 	}
 	else if(!strcmp(mode, "-riscv")) {
-		ProgramToASM(fout, prog);
+		ProgramToASM(text, prog);
 		std::cerr << "ASM generated!\n";
 	}
 	delete prog;
 	std::cerr << "prog deleted\n";
+
+	std::ofstream fout(output, std::ios::out | std::ios::binary);
+	fout << text.str();
+	if(cached) CacheStore(cacheDir, outKey, ext, text.str());
 	
 	// clean ast
 	return 0;
-}
\ No newline at end of file
+}
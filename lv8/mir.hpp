@@ -7,6 +7,7 @@
 */
 
 #include <cstdio>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <cassert>
@@ -24,8 +25,8 @@ enum Operator {
 enum TypeTag { TT_INT32, TT_UNIT, TT_ARRAY, TT_POINTER, TT_FUNCTION };
 enum ValueTag { VT_SYMBOL, VT_INT, VT_UNDEF };
 enum StmtTag { ST_SYMDEF, ST_RETURN, ST_STORE, ST_BR, ST_JUMP };
-enum SymbolDefTag { SDT_EXPR, SDT_LOAD, SDT_ALLOC, SDT_FUNCALL };
-enum InitializerTag { IT_UNDEF, IT_NUM, IT_ZERO, IT_AGGR };
+enum SymbolDefTag { SDT_EXPR, SDT_LOAD, SDT_ALLOC, SDT_FUNCALL, SDT_GETELEMPTR, SDT_GETPTR };
+enum InitializerTag { IT_UNDEF, IT_NUM, IT_ZERO, IT_AGGR, IT_RUNS };
 
 template <typename T>
 struct List {	// This is similar to std::span in C++20
@@ -85,6 +86,34 @@ struct TypeInfo: public MIRInfo {
 	}
 	TypeInfo(){}
 	TypeInfo(TypeTag tag): tag{tag} {}
+	static TypeInfo *Array(TypeInfo *base, std::size_t len) {
+		auto ret = new TypeInfo(TT_ARRAY);
+		ret->array.base = base;
+		ret->array.len = len;
+		return ret;
+	}
+	static TypeInfo *Pointer(TypeInfo *base) {
+		auto ret = new TypeInfo(TT_POINTER);
+		ret->pointer.base = base;
+		return ret;
+	}
+	TypeInfo *clone() const {
+		switch(tag) {
+			case TT_INT32:
+			case TT_UNIT: return new TypeInfo(tag);
+			case TT_ARRAY: return Array(array.base->clone(), array.len);
+			case TT_POINTER: return Pointer(pointer.base->clone());
+			case TT_FUNCTION: {
+				auto ret = new TypeInfo(TT_FUNCTION);
+				ret->function.params.init(function.params.len);
+				for(std::size_t i = 0; i < function.params.len; ++ i)
+					ret->function.params[i] = function.params[i]->clone();
+				ret->function.ret = function.ret == nullptr ? nullptr : function.ret->clone();
+				return ret;
+			}
+		}
+		__builtin_unreachable();
+	}
 	~TypeInfo() override {
 		switch(tag) {
 			case TT_INT32:
@@ -105,9 +134,22 @@ struct TypeInfo: public MIRInfo {
 };
 
 struct InitializerInfo: public MIRInfo {
+	using Run = std::pair<std::size_t, std::vector<int> >;	// words from an offset
 	InitializerTag tag;
 	int num;
 	std::vector<InitializerInfo*> aggr;
+	// IT_RUNS: an array of i32 with the given dimensions, zero except for the
+	// runs, which are sorted by offset and don't overlap
+	std::vector<std::size_t> dims;
+	std::vector<Run> runs;
+	std::size_t words() const {
+		std::size_t ret = 1;
+		for(auto d: dims) ret *= d;
+		return ret;
+	}
+	~InitializerInfo() override {
+		for(auto i: aggr) delete i;
+	}
 };
 
 struct VarInfo: public MIRInfo {
@@ -161,6 +203,11 @@ struct StmtInfo: public MIRInfo {
 					std::string *fun;
 					std::vector<ValueInfo*> *para;
 				} func;
+				struct {	// getelemptr / getptr
+					std::string *src;
+					ValueInfo *index;
+					TypeInfo *base;		// type pointed to by the result
+				} ptr;
 			};
 		} symdef;
 		struct {
@@ -198,6 +245,12 @@ struct StmtInfo: public MIRInfo {
 						for(auto p: *symdef.func.para) delete p;
 						delete symdef.func.para;
 						break;
+					case SDT_GETELEMPTR:
+					case SDT_GETPTR:
+						delete symdef.ptr.src;
+						delete symdef.ptr.index;
+						delete symdef.ptr.base;
+						break;
 				}
 				break;
 			case ST_RETURN:
@@ -223,6 +276,7 @@ struct StmtInfo: public MIRInfo {
 struct BlockInfo: public MIRInfo {
 	std::string name;
 	std::vector<StmtInfo*> stmt;
+	std::uint64_t freq = 0;		// executions in the profile of -fprofile-use, 0 without one
 	bool closed() const {
 		if(stmt.empty()) return false;
 		auto tag = stmt.back() -> tag;
@@ -0,0 +1,434 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cassert>
+
+#include "mir.hpp"
+#include "sysy_exceptions.hpp"
+
+/*
+	Binary MIR, for caching the output of the front end.
+
+	  file     ::= "MIR\x01" strings vars funcs
+	  strings  ::= n { len bytes }          every name, referred to by index
+	  vars     ::= n { name type init }
+	  funcs    ::= n { name ret params blocks }
+	  blocks   ::= n size { offset } { name n { stmt } }
+
+	Integers are LEB128 varints, signed ones zigzag-encoded first. A
+	function records the byte size of its blocks and the offset of each
+	block, so a reader may skip functions or seek to a block. The reader
+	decodes from a plain byte range, so the file can be mapped in as is,
+	and checks every read against its end.
+*/
+
+namespace {
+
+constexpr char MAGIC[4] = {'M', 'I', 'R', 1};
+
+class Writer {
+public:
+	std::string Program(ProgramInfo *mir) {
+		std::string body;
+		Varint(body, mir->vars.len);
+		for(auto var: mir->vars) {
+			String(body, var->name);
+			Type(body, var->type);
+			Init(body, var->init);
+		}
+		Varint(body, mir->funcs.len);
+		for(auto func: mir->funcs) Func(body, func);
+
+		std::string out(MAGIC, sizeof(MAGIC));
+		Varint(out, strings.size());
+		for(auto &str: strings) {
+			Varint(out, str.size());
+			out += str;
+		}
+		return out + body;
+	}
+
+private:
+	std::vector<std::string> strings;
+	std::unordered_map<std::string, std::uint64_t> stringId;
+
+	static void Varint(std::string &out, std::uint64_t val) {
+		while(val >= 0x80) {
+			out += char(val | 0x80);
+			val >>= 7;
+		}
+		out += char(val);
+	}
+	static void Signed(std::string &out, std::int64_t val) {
+		Varint(out, (std::uint64_t(val) << 1) ^ std::uint64_t(val >> 63));
+	}
+	void String(std::string &out, const std::string &str) {
+		auto it = stringId.find(str);
+		if(it == stringId.end()) {
+			it = stringId.emplace(str, strings.size()).first;
+			strings.emplace_back(str);
+		}
+		Varint(out, it->second);
+	}
+
+	void Type(std::string &out, const TypeInfo *type) {
+		if(type == nullptr) {
+			out += char(0xff);
+			return ;
+		}
+		out += char(type->tag);
+		switch(type->tag) {
+			case TT_INT32:
+			case TT_UNIT: break;
+			case TT_ARRAY:
+				Varint(out, type->array.len);
+				Type(out, type->array.base);
+				break;
+			case TT_POINTER: Type(out, type->pointer.base); break;
+			case TT_FUNCTION:
+				Varint(out, type->function.params.len);
+				for(std::size_t i = 0; i < type->function.params.len; ++ i) Type(out, type->function.params[i]);
+				Type(out, type->function.ret);
+				break;
+		}
+	}
+
+	void Init(std::string &out, const InitializerInfo *init) {
+		if(init == nullptr) {
+			out += char(0xff);
+			return ;
+		}
+		out += char(init->tag);
+		switch(init->tag) {
+			case IT_UNDEF:
+			case IT_ZERO: break;
+			case IT_NUM: Signed(out, init->num); break;
+			case IT_AGGR:
+				Varint(out, init->aggr.size());
+				for(auto sub: init->aggr) Init(out, sub);
+				break;
+			case IT_RUNS:
+				Varint(out, init->dims.size());
+				for(auto d: init->dims) Varint(out, d);
+				Varint(out, init->runs.size());
+				for(auto &[off, run]: init->runs) {
+					Varint(out, off);
+					Varint(out, run.size());
+					for(auto val: run) Signed(out, val);
+				}
+				break;
+		}
+	}
+
+	void Value(std::string &out, const ValueInfo *val) {
+		if(val == nullptr) {
+			out += char(0xff);
+			return ;
+		}
+		out += char(val->tag);
+		if(val->tag == VT_SYMBOL) String(out, *val->symbol);
+		else if(val->tag == VT_INT) Signed(out, val->i32);
+	}
+
+	void Stmt(std::string &out, const StmtInfo *stmt) {
+		out += char(stmt->tag);
+		switch(stmt->tag) {
+			case ST_SYMDEF: {
+				auto &sym = stmt->symdef;
+				out += char(sym.tag);
+				String(out, *sym.name);
+				switch(sym.tag) {
+					case SDT_EXPR:
+						out += char(sym.expr->op);
+						Value(out, sym.expr->left);
+						Value(out, sym.expr->right);
+						break;
+					case SDT_LOAD: String(out, *sym.load); break;
+					case SDT_ALLOC: Type(out, sym.alloc); break;
+					case SDT_FUNCALL:
+						String(out, *sym.func.fun);
+						Varint(out, sym.func.para->size());
+						for(auto p: *sym.func.para) Value(out, p);
+						break;
+					case SDT_GETELEMPTR:
+					case SDT_GETPTR:
+						String(out, *sym.ptr.src);
+						Value(out, sym.ptr.index);
+						Type(out, sym.ptr.base);
+						break;
+				}
+				break;
+			}
+			case ST_RETURN: Value(out, stmt->ret.val); break;
+			case ST_STORE:
+				out += char(stmt->store.isValue);
+				if(stmt->store.isValue) Value(out, stmt->store.val);
+				else Init(out, stmt->store.init);
+				String(out, *stmt->store.addr);
+				break;
+			case ST_BR:
+				Value(out, stmt->jump.cond);
+				String(out, *stmt->jump.blkThen);
+				String(out, *stmt->jump.blkElse);
+				break;
+			case ST_JUMP: String(out, *stmt->jump.blkThen); break;
+		}
+	}
+
+	void Func(std::string &out, const FuncInfo *func) {
+		String(out, func->name);
+		Type(out, func->ret);
+		Varint(out, func->params.size());
+		for(auto param: func->params) {
+			String(out, param->name);
+			Type(out, param->type);
+		}
+		std::string blocks;
+		std::vector<std::size_t> offsets;
+		for(auto block: func->block) {
+			offsets.emplace_back(blocks.size());
+			String(blocks, block->name);
+			Varint(blocks, block->stmt.size());
+			for(auto stmt: block->stmt) Stmt(blocks, stmt);
+		}
+		Varint(out, func->block.size());
+		Varint(out, blocks.size());
+		for(auto off: offsets) Varint(out, off);
+		out += blocks;
+	}
+};
+
+class Reader {
+public:
+	Reader(const char *data, std::size_t size): crt{data}, end{data + size} {}
+
+	ProgramInfo *Program() {
+		if(std::size_t(end - crt) < sizeof(MAGIC) || std::memcmp(crt, MAGIC, sizeof(MAGIC)))
+			Fail("bad magic");
+		crt += sizeof(MAGIC);
+		strings.resize(Count());
+		for(auto &str: strings) {
+			auto len = Count();
+			str = std::string_view(crt, len);
+			crt += len;
+		}
+		auto ret = new ProgramInfo;
+		ret->vars.init(Count());
+		for(auto &var: ret->vars) {
+			var = new VarInfo;
+			var->name = String();
+			var->type = Type();
+			var->init = Init();
+		}
+		ret->funcs.init(Count());
+		for(auto &func: ret->funcs) func = Func();
+		if(crt != end) Fail("trailing bytes");
+		return ret;
+	}
+
+private:
+	const char *crt, *end;
+	std::vector<std::string_view> strings;
+
+	[[noreturn]] void Fail(const std::string &msg) {
+		throw sysy_error("malformed MIR binary: " + msg);
+	}
+	std::uint8_t Byte() {
+		if(crt == end) Fail("unexpected end");
+		return std::uint8_t(*crt ++);
+	}
+	std::uint64_t Varint() {
+		std::uint64_t ret = 0;
+		for(int shift = 0; shift < 64; shift += 7) {
+			auto byte = Byte();
+			ret |= std::uint64_t(byte & 0x7f) << shift;
+			if(!(byte & 0x80)) return ret;
+		}
+		Fail("varint too long");
+	}
+	std::int64_t Signed() {
+		auto val = Varint();
+		return std::int64_t(val >> 1) ^ -std::int64_t(val & 1);
+	}
+	// A count of items, each taking at least a byte
+	std::size_t Count() {
+		auto ret = Varint();
+		if(ret > std::uint64_t(end - crt)) Fail("count out of range");
+		return ret;
+	}
+	std::string String() {
+		auto id = Varint();
+		if(id >= strings.size()) Fail("string index out of range");
+		return std::string(strings[id]);
+	}
+	std::string *NewString() {
+		return new std::string(String());
+	}
+
+	TypeInfo *Type() {
+		auto tag = Byte();
+		if(tag == 0xff) return nullptr;
+		switch(tag) {
+			case TT_INT32:
+			case TT_UNIT: return new TypeInfo(TypeTag(tag));
+			case TT_ARRAY: {
+				auto len = Varint();
+				auto base = Type();
+				if(base == nullptr) Fail("array of nothing");
+				return TypeInfo::Array(base, len);
+			}
+			case TT_POINTER: {
+				auto base = Type();
+				if(base == nullptr) Fail("pointer to nothing");
+				return TypeInfo::Pointer(base);
+			}
+			case TT_FUNCTION: {
+				auto ret = new TypeInfo(TT_FUNCTION);
+				ret->function.params.init(Count());
+				for(auto &p: ret->function.params) p = Type();
+				ret->function.ret = Type();
+				return ret;
+			}
+		}
+		Fail("bad type tag");
+	}
+
+	InitializerInfo *Init() {
+		auto tag = Byte();
+		if(tag == 0xff) return nullptr;
+		if(tag > IT_RUNS) Fail("bad initializer tag");
+		auto ret = new InitializerInfo;
+		ret->tag = InitializerTag(tag);
+		switch(ret->tag) {
+			case IT_UNDEF:
+			case IT_ZERO: break;
+			case IT_NUM: ret->num = Signed(); break;
+			case IT_AGGR:
+				ret->aggr.resize(Count());
+				for(auto &sub: ret->aggr) sub = Init();
+				break;
+			case IT_RUNS:
+				ret->dims.resize(Count());
+				for(auto &d: ret->dims) d = Varint();
+				ret->runs.resize(Count());
+				for(auto &[off, run]: ret->runs) {
+					off = Varint();
+					run.resize(Count());
+					for(auto &val: run) val = Signed();
+				}
+				break;
+		}
+		return ret;
+	}
+
+	ValueInfo *Value() {
+		auto tag = Byte();
+		switch(tag) {
+			case 0xff: return nullptr;
+			case VT_SYMBOL: return new ValueInfo(String());
+			case VT_INT: return new ValueInfo(int(Signed()));
+			case VT_UNDEF: return new ValueInfo();
+		}
+		Fail("bad value tag");
+	}
+
+	StmtInfo *Stmt() {
+		auto stmt = new StmtInfo;
+		auto tag = Byte();
+		if(tag > ST_JUMP) Fail("bad statement tag");
+		stmt->tag = StmtTag(tag);
+		switch(stmt->tag) {
+			case ST_SYMDEF: {
+				auto &sym = stmt->symdef;
+				auto symTag = Byte();
+				if(symTag > SDT_GETPTR) Fail("bad symbol definition tag");
+				sym.tag = SymbolDefTag(symTag);
+				sym.name = NewString();
+				switch(sym.tag) {
+					case SDT_EXPR: {
+						auto op = Byte();
+						if(op > OP_LOR) Fail("bad operator");
+						auto left = Value();
+						sym.expr = new ExprInfo(Operator(op), left, Value());
+						break;
+					}
+					case SDT_LOAD: sym.load = NewString(); break;
+					case SDT_ALLOC: sym.alloc = Type(); break;
+					case SDT_FUNCALL:
+						sym.func.fun = NewString();
+						sym.func.para = new std::vector<ValueInfo*>(Count());
+						for(auto &p: *sym.func.para) p = Value();
+						break;
+					case SDT_GETELEMPTR:
+					case SDT_GETPTR:
+						sym.ptr.src = NewString();
+						sym.ptr.index = Value();
+						sym.ptr.base = Type();
+						break;
+				}
+				break;
+			}
+			case ST_RETURN: stmt->ret.val = Value(); break;
+			case ST_STORE:
+				stmt->store.isValue = Byte();
+				if(stmt->store.isValue) stmt->store.val = Value();
+				else stmt->store.init = Init();
+				stmt->store.addr = NewString();
+				break;
+			case ST_BR:
+				stmt->jump.cond = Value();
+				stmt->jump.blkThen = NewString();
+				stmt->jump.blkElse = NewString();
+				break;
+			case ST_JUMP: stmt->jump.blkThen = NewString(); break;
+		}
+		return stmt;
+	}
+
+	FuncInfo *Func() {
+		auto func = new FuncInfo;
+		func->name = String();
+		func->ret = Type();
+		func->params.resize(Count());
+		for(auto &param: func->params) {
+			param = new VarInfo;
+			param->name = String();
+			param->type = Type();
+			param->init = nullptr;
+		}
+		func->block.resize(Count());
+		auto size = Varint();
+		std::vector<std::uint64_t> offsets(func->block.size());
+		for(auto &off: offsets) off = Varint();
+		if(size > std::uint64_t(end - crt)) Fail("function body out of range");
+		auto begin = crt;
+		for(std::size_t i = 0; i < func->block.size(); ++ i) {
+			if(std::uint64_t(crt - begin) != offsets[i]) Fail("bad block offset");
+			auto block = func->block[i] = new BlockInfo;
+			block->name = String();
+			block->stmt.resize(Count());
+			for(auto &stmt: block->stmt) stmt = Stmt();
+		}
+		if(std::uint64_t(crt - begin) != size) Fail("bad function size");
+		return func;
+	}
+};
+
+}
+
+// Serializes the program into the binary MIR format
+std::string ProgramToBinary(ProgramInfo *mir) {
+	Writer writer;
+	return writer.Program(mir);
+}
+
+// Decodes binary MIR from [data, data + size), e.g. a mapped file; throws sysy_error if malformed
+ProgramInfo *BinaryToProgram(const char *data, std::size_t size) {
+	Reader reader(data, size);
+	return reader.Program();
+}
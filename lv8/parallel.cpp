@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::size_t codegenThreads = 0;		// 0 for one per hardware thread
+
+/*
+	Runs work(0), ..., work(n - 1) on a pool of threads. The items are
+	independent and handed out one at a time from a shared counter, so an
+	idle thread always takes the next one and a few large functions don't
+	hold up the rest. The first exception thrown is rethrown here once
+	every thread is done.
+*/
+void ParallelFor(std::size_t n, const std::function<void(std::size_t)> &work) {
+	std::size_t threads = codegenThreads ? codegenThreads : std::thread::hardware_concurrency();
+	threads = std::min(threads, n);
+	if(threads <= 1) {
+		for(std::size_t i = 0; i < n; ++ i) work(i);
+		return ;
+	}
+
+	std::atomic<std::size_t> next{0};
+	std::exception_ptr error;
+	std::mutex errorLock;
+	auto worker = [&]() {
+		for(std::size_t i; (i = next.fetch_add(1)) < n; ) {
+			try {
+				work(i);
+			}
+			catch(...) {
+				std::lock_guard<std::mutex> lock(errorLock);
+				if(!error) error = std::current_exception();
+				next = n;
+			}
+		}
+	};
+	std::vector<std::thread> pool;
+	for(std::size_t i = 1; i < threads; ++ i) pool.emplace_back(worker);
+	worker();
+	for(auto &t: pool) t.join();
+	if(error) std::rethrow_exception(error);
+}
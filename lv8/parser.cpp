@@ -0,0 +1,374 @@
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "ast.hpp"
+#include "sysy.tab.hpp"
+
+/*
+	Hand-written parser, linked instead of the Bison one (sysy.y) when
+	building with PARSER=hand. It reads the same tokens from yylex and
+	builds the same tree: statements by recursive descent, expressions by
+	precedence climbing. Every node is created as what it is, so no
+	dynamic_cast is needed, and an 'else' binds to the innermost open 'if'
+	while parsing, rather than afterwards by StmtIf::tryMatch.
+*/
+
+int yylex();
+YYSTYPE yylval;
+
+namespace {
+
+class Parser {
+public:
+	CompUnit *Program() {
+		Next();
+		auto unit = new CompUnit;
+		while(tok != 0) {
+			if(tok == CONST) {
+				unit->glob_def.emplace_back(AST_GT_CONST, PtrAST(ConstDecl()));
+				continue;
+			}
+			auto type = Type();
+			auto name = Ident();
+			if(tok == '(') unit->glob_def.emplace_back(AST_GT_FUNC, PtrAST(FunctionDef(type, name)));
+			else unit->glob_def.emplace_back(AST_GT_VAR, PtrAST(VarDecl(type, name)));
+		}
+		return unit;
+	}
+
+private:
+	int tok;			// the current token
+	YYSTYPE val;		// and its value
+	BaseAST *lval;		// the last bare LVal parsed, which may be assigned to
+
+	void Next() {
+		tok = yylex();
+		val = yylval;
+	}
+
+	static std::string TokenName(int kind) {
+		switch(kind) {
+			case 0: return "end of file";
+			case INT: return "'int'";
+			case VOID: return "'void'";
+			case CONST: return "'const'";
+			case RETURN: return "'return'";
+			case IF: return "'if'";
+			case ELSE: return "'else'";
+			case WHILE: return "'while'";
+			case BREAK: return "'break'";
+			case CONTINUE: return "'continue'";
+			case SYM_EQ: return "'=='";
+			case SYM_NEQ: return "'!='";
+			case IDENT: return "identifier";
+			case INT_CONST: return "number";
+			default: return "'"s + char(kind) + "'";
+		}
+	}
+
+	[[noreturn]] void Unexpected(const std::string &expected) {
+		throw syntax_error("syntax error, unexpected " + TokenName(tok) + ", expecting " + expected);
+	}
+
+	void Expect(int kind) {
+		if(tok != kind) Unexpected(TokenName(kind));
+		Next();
+	}
+
+	std::string Ident() {
+		if(tok != IDENT) Unexpected("identifier");
+		std::string name = *val.str_val;
+		Next();
+		return name;
+	}
+
+	BType *Type() {
+		if(tok != INT && tok != VOID) Unexpected("type");
+		auto type = new BType(tok == INT ? "int" : "void");
+		Next();
+		return type;
+	}
+
+	FuncDef *FunctionDef(BType *type, const std::string &name) {
+		auto func = new FuncDef;
+		func->func_type = PtrAST(type);
+		func->ident = name;
+		Expect('(');
+		while(tok != ')') {
+			if(!func->params.empty()) Expect(',');
+			auto param = new FuncParam;
+			param->type = PtrAST(Type());
+			param->name = Ident();
+			param->isArray = tok == '[';
+			if(param->isArray) {
+				Next();
+				Expect(']');
+				param->dims = ArrayDims();
+			}
+			func->params.emplace_back(param);
+		}
+		Next();
+		if(tok == ';') Next();
+		else func->block = PtrAST(BlockBody());
+		return func;
+	}
+
+	std::vector<PtrAST> ArrayDims() {
+		std::vector<PtrAST> dims;
+		while(tok == '[') {
+			Next();
+			dims.emplace_back(Exp());
+			Expect(']');
+		}
+		return dims;
+	}
+
+	Block *BlockBody() {
+		Expect('{');
+		auto block = new Block;
+		while(tok != '}') block->stmt.emplace_back(Statement());
+		Next();
+		return block;
+	}
+
+	// The declarations after the type and the first name
+	Stmt *VarDecl(BType *type, std::string name) {
+		auto shared = SharedAST(type);
+		StmtVarDef *first = nullptr, *last = nullptr;
+		while(true) {
+			auto def = new StmtVarDef;
+			def->name = std::move(name);
+			def->type = shared;
+			def->dims = ArrayDims();
+			if(tok == '=') {
+				Next();
+				def->expr = PtrAST(InitVal());
+			}
+			if(last == nullptr) first = def;
+			else last->next = PtrAST(def);
+			last = def;
+			if(tok != ',') break;
+			Next();
+			name = Ident();
+		}
+		Expect(';');
+		auto stmt = new Stmt;
+		stmt->tag = AST_ST_VARDEF;
+		stmt->detail = PtrAST(first);
+		return stmt;
+	}
+
+	Stmt *ConstDecl() {
+		Expect(CONST);
+		auto shared = SharedAST(Type());
+		StmtConstDef *first = nullptr, *last = nullptr;
+		do {
+			if(last != nullptr) Next();
+			auto def = new StmtConstDef;
+			def->name = Ident();
+			def->type = shared;
+			def->dims = ArrayDims();
+			Expect('=');
+			def->expr = PtrAST(InitVal());
+			if(last == nullptr) first = def;
+			else last->next = PtrAST(def);
+			last = def;
+		} while(tok == ',');
+		Expect(';');
+		auto stmt = new Stmt;
+		stmt->tag = AST_ST_CONSTDEF;
+		stmt->detail = PtrAST(first);
+		return stmt;
+	}
+
+	BaseAST *InitVal() {
+		if(tok != '{') return Exp();
+		Next();
+		auto list = new InitList;
+		while(tok != '}') {
+			if(!list->items.empty()) Expect(',');
+			list->items.emplace_back(InitVal());
+		}
+		Next();
+		return list;
+	}
+
+	static Stmt *MakeStmt(ASTStmtTag tag, BaseAST *detail) {
+		auto stmt = new Stmt;
+		stmt->tag = tag;
+		stmt->detail = PtrAST(detail);
+		return stmt;
+	}
+
+	Stmt *Statement() {
+		switch(tok) {
+			case CONST: return ConstDecl();
+			case INT:
+			case VOID: {
+				auto type = Type();
+				return VarDecl(type, Ident());
+			}
+			case ';':
+				Next();
+				return MakeStmt(AST_ST_EXPR, nullptr);
+			case '{': return MakeStmt(AST_ST_BLOCK, BlockBody());
+			case IF:
+			case WHILE: {
+				auto tag = tok == IF ? AST_ST_IF : AST_ST_WHILE;
+				Next();
+				auto det = new StmtIf;
+				Expect('(');
+				det->expr = PtrAST(Exp());
+				Expect(')');
+				det->stmt = PtrAST(Statement());
+				if(tag == AST_ST_IF && tok == ELSE) {
+					Next();
+					det->match = PtrAST(MakeStmt(AST_ST_ELSE, Statement()));
+				}
+				return MakeStmt(tag, det);
+			}
+			case BREAK:
+			case CONTINUE: {
+				auto tag = tok == BREAK ? AST_ST_BREAK : AST_ST_CONTINUE;
+				Next();
+				Expect(';');
+				return MakeStmt(tag, nullptr);
+			}
+			case RETURN: {
+				Next();
+				auto det = new StmtReturn;
+				if(tok != ';') det->expr = PtrAST(Exp());
+				Expect(';');
+				return MakeStmt(AST_ST_RETURN, det);
+			}
+			default: {
+				lval = nullptr;
+				auto exp = Exp();
+				if(tok != '=') {
+					Expect(';');
+					return MakeStmt(AST_ST_EXPR, exp);
+				}
+				if(exp != lval) Unexpected("';'");
+				Next();
+				auto det = new StmtAssign;
+				det->lval = PtrAST(exp);
+				det->expr = PtrAST(Exp());
+				Expect(';');
+				return MakeStmt(AST_ST_ASSIGN, det);
+			}
+		}
+	}
+
+	BaseAST *Exp() {
+		return Binary(1);
+	}
+
+	// Binding strength of the binary operator starting at the current token, 0 if none.
+	// '<=', '>=', '&&' and '||' come as two tokens, of which this sees the first.
+	static int Precedence(int kind) {
+		switch(kind) {
+			case '|': return 1;
+			case '&': return 2;
+			case SYM_EQ: case SYM_NEQ: return 3;
+			case '<': case '>': return 4;
+			case '+': case '-': return 5;
+			case '*': case '/': case '%': return 6;
+			default: return 0;
+		}
+	}
+
+	Operator TakeOperator() {
+		int first = tok;
+		Next();
+		switch(first) {
+			case '|': Expect('|'); return OP_LOR;
+			case '&': Expect('&'); return OP_LAND;
+			case SYM_EQ: return OP_EQ;
+			case SYM_NEQ: return OP_NEQ;
+			case '<':
+			case '>':
+				if(tok != '=') return first == '<' ? OP_LT : OP_GT;
+				Next();
+				return first == '<' ? OP_LE : OP_GE;
+			case '+': return OP_ADD;
+			case '-': return OP_SUB;
+			case '*': return OP_MUL;
+			case '/': return OP_DIV;
+			default: return OP_MOD;
+		}
+	}
+
+	// All binary operators associate to the left
+	BaseAST *Binary(int minPrec) {
+		BaseAST *lhs = Unary();
+		for(int prec; (prec = Precedence(tok)) >= minPrec; ) {
+			Operator op = TakeOperator();
+			BaseAST *rhs = Binary(prec + 1);
+			lhs = new Expr(op, std::move(lhs), std::move(rhs));
+		}
+		return lhs;
+	}
+
+	BaseAST *Unary() {
+		switch(tok) {
+			case '+':
+			case '-':
+			case '!': {
+				Operator op = tok == '+' ? OP_POS : tok == '-' ? OP_NEG : OP_LNOT;
+				Next();
+				return new Expr(op, Unary(), nullptr);
+			}
+			case '(': {
+				Next();
+				auto exp = Exp();
+				Expect(')');
+				lval = nullptr;
+				return exp;
+			}
+			case INT_CONST: {
+				auto num = new Number;
+				num->val = val.int_val;
+				Next();
+				return num;
+			}
+			case IDENT: {
+				auto name = Ident();
+				if(tok == '(') {
+					Next();
+					auto call = new FunCall;
+					call->func = std::move(name);
+					while(tok != ')') {
+						if(!call->params.empty()) Expect(',');
+						call->params.emplace_back(Exp());
+					}
+					Next();
+					return call;
+				}
+				auto ref = new LVal;
+				ref->ident = std::move(name);
+				while(tok == '[') {
+					Next();
+					ref->index.emplace_back(Exp());
+					Expect(']');
+				}
+				return lval = ref;
+			}
+			default: Unexpected("expression");
+		}
+	}
+};
+
+}
+
+int yyparse(ASTree &ast) {
+	Parser parser;
+	try {
+		ast = ASTree(parser.Program());
+	}
+	catch(const syntax_error &err) {
+		std::cerr << "error: " << err.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,796 @@
+/*
+	rvsim - a small RV32IM instruction-set simulator.
+
+	It assembles the subset of RISC-V assembly that asmgen.cpp emits (plus the
+	rest of RV32IM, the usual pseudo instructions, and the few RVV 1.0 ones
+	of 32-bit elements that -mrvv uses, on a VLEN of 128), links it against the
+	SysY runtime library (provided as host callbacks), runs `main`, and
+	reports dynamic instruction counts together with a simple in-order
+	pipeline / data cache cost model.
+
+	Usage: rvsim [-q] <file.S> [< input]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t TEXT_BASE = 0x00010000u;
+constexpr uint32_t DATA_BASE = 0x00100000u;
+constexpr uint32_t MEM_SIZE = 64u << 20;		// 64 MiB of flat memory
+constexpr uint32_t STACK_TOP = MEM_SIZE - 16u;
+constexpr uint32_t EXIT_ADDR = 0xfffffff0u;		// `ret` from main lands here
+constexpr uint32_t GP_OFFSET = 0x800u;			// gp = start of .sdata + 0x800
+
+enum Op {
+	OP_LUI, OP_AUIPC, OP_JAL, OP_JALR,
+	OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+	OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU, OP_SB, OP_SH, OP_SW,
+	OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+	OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+	OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+	OP_CZERO_EQZ, OP_CZERO_NEZ,
+	OP_VSETVLI, OP_VLE32, OP_VSE32,
+	OP_VADD_VV, OP_VSUB_VV, OP_VMUL_VV, OP_VADD_VX, OP_VSUB_VX, OP_VRSUB_VX, OP_VMUL_VX, OP_VMV_VX,
+	OP_RUNTIME		// call into the host-side SysY runtime
+};
+
+enum OpClass { OC_ALU, OC_MUL, OC_DIV, OC_LOAD, OC_STORE, OC_BRANCH, OC_JUMP, OC_CALL, OC_VECTOR, OC_COUNT };
+const char *OP_CLASS_NAME[] = { "alu", "mul", "div", "load", "store", "branch", "jump", "call", "vector" };
+
+// Vector registers are numbered after the integer ones in Inst
+constexpr int VREG_BASE = 32;
+constexpr uint32_t VLEN = 128, VWORDS = VLEN / 32;		// words per vector register
+
+struct Inst {
+	Op op;
+	uint8_t rd, rs1, rs2;
+	int32_t imm;
+	std::string sym;		// unresolved symbol for imm
+	int symKind;			// 0: absolute, 1: %hi, 2: %lo, 3: pc-relative target
+	int line;
+};
+
+struct Symbol {
+	bool text;
+	uint32_t addr;
+};
+
+[[noreturn]] void Fatal(int line, const std::string &msg) {
+	if(line > 0) std::cerr << "rvsim: line " << line << ": " << msg << '\n';
+	else std::cerr << "rvsim: " << msg << '\n';
+	std::exit(2);
+}
+
+int RegId(const std::string &name, int line) {
+	static const std::map<std::string, int> ABI = {
+		{"zero", 0}, {"ra", 1}, {"sp", 2}, {"gp", 3}, {"tp", 4},
+		{"t0", 5}, {"t1", 6}, {"t2", 7}, {"s0", 8}, {"fp", 8}, {"s1", 9},
+		{"a0", 10}, {"a1", 11}, {"a2", 12}, {"a3", 13}, {"a4", 14}, {"a5", 15}, {"a6", 16}, {"a7", 17},
+		{"s2", 18}, {"s3", 19}, {"s4", 20}, {"s5", 21}, {"s6", 22}, {"s7", 23}, {"s8", 24}, {"s9", 25},
+		{"s10", 26}, {"s11", 27}, {"t3", 28}, {"t4", 29}, {"t5", 30}, {"t6", 31}
+	};
+	auto it = ABI.find(name);
+	if(it != ABI.end()) return it->second;
+	if(name.size() >= 2 && name[0] == 'x') {
+		int id = std::atoi(name.c_str() + 1);
+		if(0 <= id && id < 32) return id;
+	}
+	Fatal(line, "unknown register '" + name + "'");
+}
+
+int VRegId(const std::string &name, int line) {
+	if(name.size() >= 2 && name[0] == 'v') {
+		int id = std::atoi(name.c_str() + 1);
+		if(0 <= id && id < 32 && name.find_first_not_of("0123456789", 1) == std::string::npos) return VREG_BASE + id;
+	}
+	Fatal(line, "unknown vector register '" + name + "'");
+}
+
+std::string Trim(const std::string &s) {
+	std::size_t b = s.find_first_not_of(" \t\r");
+	if(b == std::string::npos) return "";
+	std::size_t e = s.find_last_not_of(" \t\r");
+	return s.substr(b, e - b + 1);
+}
+
+std::vector<std::string> SplitOperands(const std::string &s) {
+	std::vector<std::string> ret;
+	std::string crt;
+	int depth = 0;
+	for(char c: s) {
+		if(c == '(') ++ depth;
+		if(c == ')') -- depth;
+		if(c == ',' && depth == 0) {
+			ret.emplace_back(Trim(crt));
+			crt.clear();
+		}
+		else crt += c;
+	}
+	if(!Trim(crt).empty()) ret.emplace_back(Trim(crt));
+	return ret;
+}
+
+bool ParseInt(const std::string &s, int64_t &val) {
+	if(s.empty()) return false;
+	char *end = nullptr;
+	val = std::strtoll(s.c_str(), &end, 0);
+	return *end == '\0';
+}
+
+class Assembler {
+public:
+	std::vector<Inst> text;
+	std::vector<uint8_t> data;		// .data, .rodata and .sdata, followed by .bss
+	std::map<std::string, Symbol> symbols;
+	uint32_t sdataStart = 0;
+	bool hasSdata = false;
+	std::vector<std::pair<int, std::string> > dataWords;	// symbolic .word fixups
+
+	void Assemble(std::istream &in) {
+		std::string raw;
+		int line = 0;
+		enum { SEC_TEXT, SEC_DATA, SEC_BSS } section = SEC_TEXT;
+		std::vector<std::pair<std::string, uint32_t> > bssItems;	// (label, offset in .bss)
+		std::vector<uint8_t> bss;
+		std::vector<std::pair<std::string, uint32_t> > pendingBss;
+		while(std::getline(in, raw)) {
+			++ line;
+			auto hash = raw.find('#');
+			if(hash != std::string::npos) raw = raw.substr(0, hash);
+			std::string s = Trim(raw);
+			while(!s.empty()) {
+				auto colon = s.find(':');
+				if(colon == std::string::npos || s.find_first_of(" \t(,") < colon) break;
+				std::string label = s.substr(0, colon);
+				if(section == SEC_TEXT) symbols[label] = {true, uint32_t(text.size())};
+				else if(section == SEC_DATA) symbols[label] = {false, uint32_t(data.size())};
+				else pendingBss.emplace_back(label, uint32_t(bss.size()));
+				s = Trim(s.substr(colon + 1));
+			}
+			if(s.empty()) continue;
+			std::string mnem = s.substr(0, s.find_first_of(" \t"));
+			std::string rest = mnem.size() < s.size() ? Trim(s.substr(mnem.size())) : "";
+			auto ops = SplitOperands(rest);
+			if(mnem[0] == '.') {
+				if(mnem == ".text") section = SEC_TEXT;
+				else if(mnem == ".data" || mnem == ".rodata") section = SEC_DATA;
+				else if(mnem == ".sdata" || mnem == ".srodata") {
+					section = SEC_DATA;
+					if(!hasSdata) hasSdata = true, sdataStart = data.size();
+				}
+				else if(mnem == ".bss" || mnem == ".sbss") section = SEC_BSS;
+				else if(mnem == ".section") {
+					std::string name = ops.empty() ? "" : ops[0];
+					if(name.rfind(".text", 0) == 0) section = SEC_TEXT;
+					else if(name.rfind(".bss", 0) == 0 || name.rfind(".sbss", 0) == 0) section = SEC_BSS;
+					else {
+						section = SEC_DATA;
+						if(name.rfind(".sdata", 0) == 0 || name.rfind(".srodata", 0) == 0) {
+							if(!hasSdata) hasSdata = true, sdataStart = data.size();
+						}
+					}
+				}
+				else if(mnem == ".word") {
+					for(auto &op: ops) {
+						int64_t v;
+						auto &buf = section == SEC_BSS ? bss : data;
+						if(!ParseInt(op, v)) {
+							if(section == SEC_BSS) Fatal(line, "symbolic .word in .bss");
+							dataWords.emplace_back(int(data.size()), op);
+							v = 0;
+						}
+						for(int k = 0; k < 4; ++ k) buf.push_back(uint8_t(uint32_t(v) >> (8 * k)));
+					}
+				}
+				else if(mnem == ".zero" || mnem == ".space") {
+					int64_t v;
+					if(ops.empty() || !ParseInt(ops[0], v) || v < 0) Fatal(line, "bad " + mnem);
+					auto &buf = section == SEC_BSS ? bss : data;
+					buf.resize(buf.size() + v, 0);
+				}
+				else if(mnem == ".align" || mnem == ".p2align" || mnem == ".balign") {
+					int64_t v;
+					if(ops.empty() || !ParseInt(ops[0], v)) Fatal(line, "bad " + mnem);
+					uint32_t align = mnem == ".balign" ? uint32_t(v) : (1u << v);
+					auto &buf = section == SEC_BSS ? bss : data;
+					if(section != SEC_TEXT) while(buf.size() % align) buf.push_back(0);
+				}
+				// .globl, .type, .size, .file ... carry no meaning here
+				if(section == SEC_BSS) {
+					for(auto &p: pendingBss) bssItems.emplace_back(p);
+					pendingBss.clear();
+				}
+				continue;
+			}
+			ParseInst(mnem, ops, line);
+		}
+		for(auto &p: pendingBss) bssItems.emplace_back(p);
+		while(data.size() % 16) data.push_back(0);
+		uint32_t bssBase = data.size();
+		for(auto &p: bssItems) symbols[p.first] = {false, bssBase + p.second};
+		data.insert(data.end(), bss.begin(), bss.end());
+	}
+
+	// Resolve symbols; undefined text symbols are bound to the runtime library
+	void Link(const std::vector<std::string> &runtime) {
+		for(auto &name: runtime) {
+			if(symbols.count(name)) continue;
+			symbols[name] = {true, uint32_t(text.size())};
+			text.push_back({OP_RUNTIME, 0, 0, 0, 0, name, 0, 0});
+		}
+		for(auto &w: dataWords) {
+			uint32_t v = Resolve(w.second, 0, 0, 0);
+			for(int k = 0; k < 4; ++ k) data[w.first + k] = uint8_t(v >> (8 * k));
+		}
+		for(std::size_t i = 0; i < text.size(); ++ i) {
+			auto &inst = text[i];
+			if(inst.sym.empty() || inst.op == OP_RUNTIME) continue;
+			inst.imm += Resolve(inst.sym, inst.symKind, uint32_t(i), inst.line);
+			// a branch is B-type, reaching ±4 KiB ('call' stands for auipc and jalr, so isn't checked)
+			if(inst.op >= OP_BEQ && inst.op <= OP_BGEU && (inst.imm < -4096 || inst.imm >= 4096))
+				Fatal(inst.line, "branch to '" + inst.sym + "' out of range");
+		}
+	}
+
+	uint32_t Address(const Symbol &sym) const {
+		return sym.text ? TEXT_BASE + sym.addr * 4u : DATA_BASE + sym.addr;
+	}
+	uint32_t GlobalPointer() const {
+		return DATA_BASE + (hasSdata ? sdataStart : 0u) + GP_OFFSET;
+	}
+
+private:
+	// name is 'sym', 'sym+off' or 'sym-off'
+	uint32_t Resolve(const std::string &name, int kind, uint32_t index, int line) {
+		std::string base = name;
+		int64_t addend = 0;
+		auto sign = name.find_last_of("+-");
+		if(sign != std::string::npos && sign > 0) {
+			if(!ParseInt(Trim(name.substr(sign + 1)), addend)) Fatal(line, "bad addend in '" + name + "'");
+			if(name[sign] == '-') addend = -addend;
+			base = Trim(name.substr(0, sign));
+		}
+		auto it = symbols.find(base);
+		if(it == symbols.end()) Fatal(line, "undefined symbol '" + base + "'");
+		uint32_t addr = Address(it->second) + uint32_t(addend);
+		switch(kind) {
+			case 1: return (addr + 0x800u) >> 12;
+			case 2: return uint32_t(int32_t(addr << 20) >> 20);
+			case 3: return addr - (TEXT_BASE + index * 4u);
+			case 4: return addr - GlobalPointer();
+		}
+		return addr;
+	}
+
+	void Emit(Op op, int rd, int rs1, int rs2, int32_t imm, int line, const std::string &sym = "", int kind = 0) {
+		text.push_back({op, uint8_t(rd), uint8_t(rs1), uint8_t(rs2), imm, sym, kind, line});
+	}
+
+	// imm operand: number, symbol, %hi(sym), %lo(sym) or %gprel(sym)
+	void Imm(const std::string &s, int32_t &imm, std::string &sym, int &kind, int line) {
+		int64_t v;
+		if(ParseInt(s, v)) { imm = int32_t(v); return; }
+		imm = 0;
+		if(s.rfind("%hi(", 0) == 0) kind = 1;
+		else if(s.rfind("%lo(", 0) == 0) kind = 2;
+		else if(s.rfind("%gprel(", 0) == 0) kind = 4;
+		else { sym = s; kind = 0; return; }
+		auto l = s.find('('), r = s.rfind(')');
+		if(r == std::string::npos) Fatal(line, "bad operand '" + s + "'");
+		sym = s.substr(l + 1, r - l - 1);
+	}
+
+	// memory operand: imm(reg)
+	void Mem(const std::string &s, int32_t &imm, std::string &sym, int &kind, int &reg, int line) {
+		auto r = s.rfind('(');
+		if(r == std::string::npos || s.back() != ')') Fatal(line, "bad memory operand '" + s + "'");
+		std::string off = Trim(s.substr(0, r));
+		reg = RegId(s.substr(r + 1, s.size() - r - 2), line);
+		if(off.empty()) imm = 0;
+		else Imm(off, imm, sym, kind, line);
+	}
+
+	void LoadImm(int rd, int64_t v, int line) {
+		int32_t val = int32_t(v);
+		if(-2048 <= val && val <= 2047) Emit(OP_ADDI, rd, 0, 0, val, line);
+		else {
+			int32_t lo = int32_t(uint32_t(val) << 20) >> 20;
+			int32_t hi = int32_t(uint32_t(val - lo) >> 12);
+			Emit(OP_LUI, rd, 0, 0, hi, line);
+			if(lo) Emit(OP_ADDI, rd, rd, 0, lo, line);
+		}
+	}
+
+	void ParseInst(const std::string &m, const std::vector<std::string> &ops, int line) {
+		static const std::map<std::string, Op> R = {
+			{"add", OP_ADD}, {"sub", OP_SUB}, {"sll", OP_SLL}, {"slt", OP_SLT}, {"sltu", OP_SLTU},
+			{"xor", OP_XOR}, {"srl", OP_SRL}, {"sra", OP_SRA}, {"or", OP_OR}, {"and", OP_AND},
+			{"mul", OP_MUL}, {"mulh", OP_MULH}, {"mulhsu", OP_MULHSU}, {"mulhu", OP_MULHU},
+			{"div", OP_DIV}, {"divu", OP_DIVU}, {"rem", OP_REM}, {"remu", OP_REMU},
+			{"czero.eqz", OP_CZERO_EQZ}, {"czero.nez", OP_CZERO_NEZ}
+		};
+		static const std::map<std::string, Op> I = {
+			{"addi", OP_ADDI}, {"slti", OP_SLTI}, {"sltiu", OP_SLTIU}, {"xori", OP_XORI},
+			{"ori", OP_ORI}, {"andi", OP_ANDI}, {"slli", OP_SLLI}, {"srli", OP_SRLI}, {"srai", OP_SRAI}
+		};
+		static const std::map<std::string, Op> LOAD = {
+			{"lb", OP_LB}, {"lh", OP_LH}, {"lw", OP_LW}, {"lbu", OP_LBU}, {"lhu", OP_LHU}
+		};
+		static const std::map<std::string, Op> STORE = { {"sb", OP_SB}, {"sh", OP_SH}, {"sw", OP_SW} };
+		static const std::map<std::string, Op> B = {
+			{"beq", OP_BEQ}, {"bne", OP_BNE}, {"blt", OP_BLT}, {"bge", OP_BGE}, {"bltu", OP_BLTU}, {"bgeu", OP_BGEU}
+		};
+		auto need = [&](std::size_t n) {
+			if(ops.size() != n) Fatal(line, "'" + m + "' expects " + std::to_string(n) + " operands");
+		};
+		auto reg = [&](std::size_t i) { return RegId(ops[i], line); };
+		int32_t imm = 0;
+		std::string sym;
+		int kind = 0;
+
+		if(auto it = R.find(m); it != R.end()) {
+			need(3);
+			Emit(it->second, reg(0), reg(1), reg(2), 0, line);
+		}
+		else if(auto it = I.find(m); it != I.end()) {
+			need(3);
+			Imm(ops[2], imm, sym, kind, line);
+			Emit(it->second, reg(0), reg(1), 0, imm, line, sym, kind);
+		}
+		else if(auto it = LOAD.find(m); it != LOAD.end()) {
+			need(2);
+			int base;
+			Mem(ops[1], imm, sym, kind, base, line);
+			Emit(it->second, reg(0), base, 0, imm, line, sym, kind);
+		}
+		else if(auto it = STORE.find(m); it != STORE.end()) {
+			need(2);
+			int base;
+			Mem(ops[1], imm, sym, kind, base, line);
+			Emit(it->second, 0, base, reg(0), imm, line, sym, kind);
+		}
+		else if(auto it = B.find(m); it != B.end()) {
+			need(3);
+			Emit(it->second, 0, reg(0), reg(1), 0, line, ops[2], 3);
+		}
+		else if(m == "bgt" || m == "ble" || m == "bgtu" || m == "bleu") {
+			need(3);
+			Op op = m == "bgt" ? OP_BLT : m == "ble" ? OP_BGE : m == "bgtu" ? OP_BLTU : OP_BGEU;
+			Emit(op, 0, reg(1), reg(0), 0, line, ops[2], 3);
+		}
+		else if(m == "beqz" || m == "bnez" || m == "bltz" || m == "bgez") {
+			need(2);
+			Op op = m == "beqz" ? OP_BEQ : m == "bnez" ? OP_BNE : m == "bltz" ? OP_BLT : OP_BGE;
+			Emit(op, 0, reg(0), 0, 0, line, ops[1], 3);
+		}
+		else if(m == "blez" || m == "bgtz") {
+			need(2);
+			Emit(m == "blez" ? OP_BGE : OP_BLT, 0, 0, reg(0), 0, line, ops[1], 3);
+		}
+		else if(m == "lui" || m == "auipc") {
+			need(2);
+			Imm(ops[1], imm, sym, kind, line);
+			Emit(m == "lui" ? OP_LUI : OP_AUIPC, reg(0), 0, 0, imm, line, sym, kind);
+		}
+		else if(m == "li") {
+			need(2);
+			int64_t v;
+			if(!ParseInt(ops[1], v)) Fatal(line, "bad immediate '" + ops[1] + "'");
+			LoadImm(reg(0), v, line);
+		}
+		else if(m == "la") {
+			need(2);
+			Emit(OP_LUI, reg(0), 0, 0, 0, line, ops[1], 1);
+			Emit(OP_ADDI, reg(0), reg(0), 0, 0, line, ops[1], 2);
+		}
+		else if(m == "mv") { need(2); Emit(OP_ADDI, reg(0), reg(1), 0, 0, line); }
+		else if(m == "not") { need(2); Emit(OP_XORI, reg(0), reg(1), 0, -1, line); }
+		else if(m == "neg") { need(2); Emit(OP_SUB, reg(0), 0, reg(1), 0, line); }
+		else if(m == "seqz") { need(2); Emit(OP_SLTIU, reg(0), reg(1), 0, 1, line); }
+		else if(m == "snez") { need(2); Emit(OP_SLTU, reg(0), 0, reg(1), 0, line); }
+		else if(m == "sltz") { need(2); Emit(OP_SLT, reg(0), reg(1), 0, 0, line); }
+		else if(m == "sgtz") { need(2); Emit(OP_SLT, reg(0), 0, reg(1), 0, line); }
+		else if(m == "sgt") { need(3); Emit(OP_SLT, reg(0), reg(2), reg(1), 0, line); }
+		else if(m == "sgtu") { need(3); Emit(OP_SLTU, reg(0), reg(2), reg(1), 0, line); }
+		else if(m == "nop") { need(0); Emit(OP_ADDI, 0, 0, 0, 0, line); }
+		else if(m == "j") { need(1); Emit(OP_JAL, 0, 0, 0, 0, line, ops[0], 3); }
+		else if(m == "jal") {
+			if(ops.size() == 1) Emit(OP_JAL, 1, 0, 0, 0, line, ops[0], 3);
+			else { need(2); Emit(OP_JAL, reg(0), 0, 0, 0, line, ops[1], 3); }
+		}
+		else if(m == "jr") { need(1); Emit(OP_JALR, 0, reg(0), 0, 0, line); }
+		else if(m == "jalr") {
+			if(ops.size() == 1) Emit(OP_JALR, 1, reg(0), 0, 0, line);
+			else { need(2); int base; Mem(ops[1], imm, sym, kind, base, line); Emit(OP_JALR, reg(0), base, 0, imm, line); }
+		}
+		else if(m == "ret") { need(0); Emit(OP_JALR, 0, 1, 0, 0, line); }
+		else if(m == "call" || m == "tail") {
+			need(1);
+			Emit(OP_JAL, m == "call" ? 1 : 0, 0, 0, 0, line, ops[0], 3);
+		}
+		else if(m[0] == 'v') ParseVectorInst(m, ops, line);
+		else Fatal(line, "unsupported instruction '" + m + "'");
+	}
+
+	// RVV: vsetvli of e32 only, whole-register-group unit-stride loads and
+	// stores, and unmasked integer arithmetic
+	void ParseVectorInst(const std::string &m, const std::vector<std::string> &ops, int line) {
+		static const std::map<std::string, Op> VV = {
+			{"vadd.vv", OP_VADD_VV}, {"vsub.vv", OP_VSUB_VV}, {"vmul.vv", OP_VMUL_VV}
+		};
+		static const std::map<std::string, Op> VX = {
+			{"vadd.vx", OP_VADD_VX}, {"vsub.vx", OP_VSUB_VX}, {"vrsub.vx", OP_VRSUB_VX}, {"vmul.vx", OP_VMUL_VX}
+		};
+		auto need = [&](std::size_t n) {
+			if(ops.size() != n) Fatal(line, "'" + m + "' expects " + std::to_string(n) + " operands");
+		};
+		auto vreg = [&](std::size_t i) { return VRegId(ops[i], line); };
+		auto reg = [&](std::size_t i) { return RegId(ops[i], line); };
+		if(m == "vsetvli") {
+			if(ops.size() < 4 || ops[2] != "e32") Fatal(line, "'vsetvli' expects rd, rs1, e32, m<LMUL>[, ta, ma]");
+			int lmul = ops[3] == "m1" ? 1 : ops[3] == "m2" ? 2 : ops[3] == "m4" ? 4 : ops[3] == "m8" ? 8 : 0;
+			if(lmul == 0) Fatal(line, "unsupported LMUL '" + ops[3] + "'");
+			Emit(OP_VSETVLI, reg(0), reg(1), 0, lmul, line);
+		}
+		else if(m == "vle32.v" || m == "vse32.v") {
+			need(2);
+			int32_t imm = 0;
+			std::string sym;
+			int kind = 0, base;
+			Mem(ops[1], imm, sym, kind, base, line);
+			if(imm != 0 || !sym.empty()) Fatal(line, "'" + m + "' takes no offset");
+			if(m == "vle32.v") Emit(OP_VLE32, vreg(0), base, 0, 0, line);
+			else Emit(OP_VSE32, 0, base, vreg(0), 0, line);
+		}
+		else if(auto it = VV.find(m); it != VV.end()) {
+			need(3);
+			Emit(it->second, vreg(0), vreg(1), vreg(2), 0, line);
+		}
+		else if(auto it = VX.find(m); it != VX.end()) {
+			need(3);
+			Emit(it->second, vreg(0), vreg(1), reg(2), 0, line);
+		}
+		else if(m == "vmv.v.x") {
+			need(2);
+			Emit(OP_VMV_VX, vreg(0), reg(1), 0, 0, line);
+		}
+		else Fatal(line, "unsupported instruction '" + m + "'");
+	}
+
+};
+
+class Machine {
+public:
+	// counters
+	uint64_t instCount = 0;
+	uint64_t classCount[OC_COUNT] = {};
+	uint64_t branchTaken = 0;
+	uint64_t cycles = 0;
+	uint64_t loadUseStalls = 0;
+	uint64_t cacheAccess = 0, cacheMiss = 0;
+
+	Machine(const Assembler &as): as{as}, mem(MEM_SIZE, 0) {
+		std::copy(as.data.begin(), as.data.end(), mem.begin() + DATA_BASE);
+		reg[2] = STACK_TOP;
+		reg[3] = as.GlobalPointer();
+		for(auto &t: cacheTag) t = UINT32_MAX;
+	}
+
+	int Run(const std::string &entry) {
+		auto it = as.symbols.find(entry);
+		if(it == as.symbols.end() || !it->second.text) Fatal(0, "no entry point '" + entry + "'");
+		reg[1] = EXIT_ADDR;
+		uint32_t pc = as.Address(it->second);
+		while(pc != EXIT_ADDR) {
+			uint32_t index = (pc - TEXT_BASE) / 4u;
+			if(pc < TEXT_BASE || (pc - TEXT_BASE) % 4u || index >= as.text.size())
+				Fatal(0, "pc out of range: " + std::to_string(pc));
+			pc = Step(as.text[index], pc);
+			reg[0] = 0;
+		}
+		return int(reg[10]);
+	}
+
+private:
+	const Assembler &as;
+	std::vector<uint8_t> mem;
+	uint32_t reg[32] = {};
+	uint32_t vreg[32 * VWORDS] = {};	// a group of registers is a run of elements
+	uint32_t vl = 0, lmul = 1;
+	int lastLoadRd = -1;		// destination of the previous instruction if it was a load
+	uint64_t busyUntil[VREG_BASE + 32] = {};	// cycle at which a register's value becomes available
+
+	// 16 KiB direct-mapped data cache, 32-byte lines
+	static constexpr uint32_t LINE = 32, LINES = 512;
+	static constexpr uint64_t MISS_PENALTY = 20;
+	uint32_t cacheTag[LINES];
+
+	// latency table of the modelled in-order core
+	static constexpr uint64_t LAT_LOAD = 2, LAT_MUL = 3, LAT_DIV = 20, BRANCH_PENALTY = 2;
+	// the vector unit handles a register (VWORDS elements) per cycle
+	static constexpr uint32_t LANES = VWORDS;
+
+	uint8_t *At(uint32_t addr, uint32_t size) {
+		if(addr >= MEM_SIZE || addr + size > MEM_SIZE || addr < DATA_BASE)
+			Fatal(0, "memory access out of range: " + std::to_string(addr));
+		if(addr % size) Fatal(0, "misaligned access: " + std::to_string(addr));
+		return &mem[addr];
+	}
+	uint32_t Load(uint32_t addr, uint32_t size, bool sign) {
+		Cache(addr);
+		uint32_t v = 0;
+		std::memcpy(&v, At(addr, size), size);
+		if(sign && size < 4u) {
+			uint32_t shift = 32u - size * 8u;
+			v = uint32_t(int32_t(v << shift) >> shift);
+		}
+		return v;
+	}
+	void Store(uint32_t addr, uint32_t size, uint32_t v) {
+		Cache(addr);
+		std::memcpy(At(addr, size), &v, size);
+	}
+	void Cache(uint32_t addr) {
+		++ cacheAccess;
+		uint32_t line = addr / LINE, set = line % LINES;
+		if(cacheTag[set] != line) {
+			cacheTag[set] = line;
+			++ cacheMiss;
+			cycles += MISS_PENALTY;
+		}
+	}
+
+	void Issue(const Inst &inst, OpClass cls, uint64_t latency) {
+		++ instCount;
+		++ classCount[cls];
+		uint64_t ready = cycles + 1;
+		int srcs[2] = {inst.rs1, inst.rs2};
+		for(int r: srcs) if(r && busyUntil[r] > ready) ready = busyUntil[r];
+		if(lastLoadRd > 0 && (inst.rs1 == lastLoadRd || inst.rs2 == lastLoadRd)) ++ loadUseStalls;
+		cycles = ready;
+		if(inst.rd) busyUntil[inst.rd] = cycles + latency - 1;
+		lastLoadRd = cls == OC_LOAD ? inst.rd : -1;
+	}
+
+	uint32_t *Elems(int id) {
+		return &vreg[(id - VREG_BASE) * VWORDS];
+	}
+
+	// An instruction over vl elements, taking a cycle per LANES of them
+	void IssueVector(const Inst &i, OpClass cls, uint64_t latency) {
+		Issue(i, cls, latency);
+		uint64_t beats = std::max<uint32_t>(1u, (vl + LANES - 1) / LANES);
+		cycles += beats - 1;
+		if(i.rd) busyUntil[i.rd] += beats - 1;
+	}
+
+	void VectorArith(const Inst &i, uint32_t (*f)(uint32_t, uint32_t)) {
+		IssueVector(i, f == Mul ? OC_MUL : OC_VECTOR, f == Mul ? LAT_MUL : 1);
+		uint32_t *d = Elems(i.rd), *x = Elems(i.rs1);
+		bool scalar = i.rs2 < VREG_BASE;
+		uint32_t *y = scalar ? nullptr : Elems(i.rs2);
+		for(uint32_t k = 0; k < vl; ++ k) d[k] = f(x[k], scalar ? reg[i.rs2] : y[k]);
+	}
+	static uint32_t Add(uint32_t x, uint32_t y) { return x + y; }
+	static uint32_t Sub(uint32_t x, uint32_t y) { return x - y; }
+	static uint32_t RSub(uint32_t x, uint32_t y) { return y - x; }
+	static uint32_t Mul(uint32_t x, uint32_t y) { return x * y; }
+
+	uint32_t Step(const Inst &i, uint32_t pc) {
+		uint32_t a = reg[i.rs1 % 32], b = reg[i.rs2 % 32];
+		int32_t sa = int32_t(a), sb = int32_t(b);
+		uint32_t next = pc + 4u;
+		auto branch = [&](bool cond) {
+			Issue(i, OC_BRANCH, 1);
+			if(cond) {
+				++ branchTaken;
+				cycles += BRANCH_PENALTY;
+				next = pc + uint32_t(i.imm);
+			}
+		};
+		switch(i.op) {
+			case OP_LUI: Issue(i, OC_ALU, 1); reg[i.rd] = uint32_t(i.imm) << 12; break;
+			case OP_AUIPC: Issue(i, OC_ALU, 1); reg[i.rd] = pc + (uint32_t(i.imm) << 12); break;
+			case OP_JAL:
+				Issue(i, i.rd == 1 ? OC_CALL : OC_JUMP, 1);
+				cycles += BRANCH_PENALTY;
+				reg[i.rd] = next;
+				next = pc + uint32_t(i.imm);
+				break;
+			case OP_JALR:
+				Issue(i, i.rd == 1 ? OC_CALL : OC_JUMP, 1);
+				cycles += BRANCH_PENALTY;
+				reg[i.rd] = next;
+				next = (a + uint32_t(i.imm)) & ~1u;
+				break;
+			case OP_BEQ: branch(a == b); break;
+			case OP_BNE: branch(a != b); break;
+			case OP_BLT: branch(sa < sb); break;
+			case OP_BGE: branch(sa >= sb); break;
+			case OP_BLTU: branch(a < b); break;
+			case OP_BGEU: branch(a >= b); break;
+			case OP_LB: Issue(i, OC_LOAD, LAT_LOAD); reg[i.rd] = Load(a + i.imm, 1, true); break;
+			case OP_LH: Issue(i, OC_LOAD, LAT_LOAD); reg[i.rd] = Load(a + i.imm, 2, true); break;
+			case OP_LW: Issue(i, OC_LOAD, LAT_LOAD); reg[i.rd] = Load(a + i.imm, 4, false); break;
+			case OP_LBU: Issue(i, OC_LOAD, LAT_LOAD); reg[i.rd] = Load(a + i.imm, 1, false); break;
+			case OP_LHU: Issue(i, OC_LOAD, LAT_LOAD); reg[i.rd] = Load(a + i.imm, 2, false); break;
+			case OP_SB: Issue(i, OC_STORE, 1); Store(a + i.imm, 1, b); break;
+			case OP_SH: Issue(i, OC_STORE, 1); Store(a + i.imm, 2, b); break;
+			case OP_SW: Issue(i, OC_STORE, 1); Store(a + i.imm, 4, b); break;
+			case OP_ADDI: Issue(i, OC_ALU, 1); reg[i.rd] = a + uint32_t(i.imm); break;
+			case OP_SLTI: Issue(i, OC_ALU, 1); reg[i.rd] = sa < i.imm; break;
+			case OP_SLTIU: Issue(i, OC_ALU, 1); reg[i.rd] = a < uint32_t(i.imm); break;
+			case OP_XORI: Issue(i, OC_ALU, 1); reg[i.rd] = a ^ uint32_t(i.imm); break;
+			case OP_ORI: Issue(i, OC_ALU, 1); reg[i.rd] = a | uint32_t(i.imm); break;
+			case OP_ANDI: Issue(i, OC_ALU, 1); reg[i.rd] = a & uint32_t(i.imm); break;
+			case OP_SLLI: Issue(i, OC_ALU, 1); reg[i.rd] = a << (i.imm & 31); break;
+			case OP_SRLI: Issue(i, OC_ALU, 1); reg[i.rd] = a >> (i.imm & 31); break;
+			case OP_SRAI: Issue(i, OC_ALU, 1); reg[i.rd] = uint32_t(sa >> (i.imm & 31)); break;
+			case OP_ADD: Issue(i, OC_ALU, 1); reg[i.rd] = a + b; break;
+			case OP_SUB: Issue(i, OC_ALU, 1); reg[i.rd] = a - b; break;
+			case OP_SLL: Issue(i, OC_ALU, 1); reg[i.rd] = a << (b & 31); break;
+			case OP_SLT: Issue(i, OC_ALU, 1); reg[i.rd] = sa < sb; break;
+			case OP_SLTU: Issue(i, OC_ALU, 1); reg[i.rd] = a < b; break;
+			case OP_XOR: Issue(i, OC_ALU, 1); reg[i.rd] = a ^ b; break;
+			case OP_SRL: Issue(i, OC_ALU, 1); reg[i.rd] = a >> (b & 31); break;
+			case OP_SRA: Issue(i, OC_ALU, 1); reg[i.rd] = uint32_t(sa >> (b & 31)); break;
+			case OP_OR: Issue(i, OC_ALU, 1); reg[i.rd] = a | b; break;
+			case OP_AND: Issue(i, OC_ALU, 1); reg[i.rd] = a & b; break;
+			case OP_MUL: Issue(i, OC_MUL, LAT_MUL); reg[i.rd] = a * b; break;
+			case OP_MULH: Issue(i, OC_MUL, LAT_MUL); reg[i.rd] = uint32_t((int64_t(sa) * int64_t(sb)) >> 32); break;
+			case OP_MULHSU: Issue(i, OC_MUL, LAT_MUL); reg[i.rd] = uint32_t((int64_t(sa) * int64_t(uint64_t(b))) >> 32); break;
+			case OP_MULHU: Issue(i, OC_MUL, LAT_MUL); reg[i.rd] = uint32_t((uint64_t(a) * uint64_t(b)) >> 32); break;
+			case OP_DIV:
+				Issue(i, OC_DIV, LAT_DIV);
+				reg[i.rd] = b == 0 ? UINT32_MAX : (sa == INT32_MIN && sb == -1) ? a : uint32_t(sa / sb);
+				break;
+			case OP_DIVU: Issue(i, OC_DIV, LAT_DIV); reg[i.rd] = b == 0 ? UINT32_MAX : a / b; break;
+			case OP_REM:
+				Issue(i, OC_DIV, LAT_DIV);
+				reg[i.rd] = b == 0 ? a : (sa == INT32_MIN && sb == -1) ? 0 : uint32_t(sa % sb);
+				break;
+			case OP_REMU: Issue(i, OC_DIV, LAT_DIV); reg[i.rd] = b == 0 ? a : a % b; break;
+			case OP_CZERO_EQZ: Issue(i, OC_ALU, 1); reg[i.rd] = b == 0 ? 0 : a; break;
+			case OP_CZERO_NEZ: Issue(i, OC_ALU, 1); reg[i.rd] = b != 0 ? 0 : a; break;
+			case OP_VSETVLI: {
+				Issue(i, OC_ALU, 1);
+				lmul = uint32_t(i.imm);
+				uint32_t vlmax = VWORDS * lmul;
+				vl = i.rs1 == 0 ? vlmax : std::min(a, vlmax);
+				reg[i.rd] = vl;
+				break;
+			}
+			case OP_VLE32:
+				IssueVector(i, OC_LOAD, LAT_LOAD);
+				for(uint32_t k = 0; k < vl; ++ k) Elems(i.rd)[k] = Load(a + 4u * k, 4, false);
+				break;
+			case OP_VSE32:
+				IssueVector(i, OC_STORE, 1);
+				for(uint32_t k = 0; k < vl; ++ k) Store(a + 4u * k, 4, Elems(i.rs2)[k]);
+				break;
+			case OP_VADD_VV: case OP_VADD_VX: VectorArith(i, Add); break;
+			case OP_VSUB_VV: case OP_VSUB_VX: VectorArith(i, Sub); break;
+			case OP_VRSUB_VX: VectorArith(i, RSub); break;
+			case OP_VMUL_VV: case OP_VMUL_VX: VectorArith(i, Mul); break;
+			case OP_VMV_VX:
+				IssueVector(i, OC_VECTOR, 1);
+				for(uint32_t k = 0; k < vl; ++ k) Elems(i.rd)[k] = a;
+				break;
+			case OP_RUNTIME:
+				next = reg[1];
+				Clobber(Runtime(i.sym));
+				break;
+		}
+		return next;
+	}
+
+	// A real callee may leave anything in the caller-saved registers, so code
+	// that keeps a value in one across a runtime call must fail here too
+	void Clobber(bool result) {
+		static const int CALLER_SAVED[] = {1, 5, 6, 7, 11, 12, 13, 14, 15, 16, 17, 28, 29, 30, 31};
+		for(int r : CALLER_SAVED) reg[r] = POISON;
+		if(!result) reg[10] = POISON;
+		std::fill(std::begin(vreg), std::end(vreg), POISON);
+	}
+	static constexpr uint32_t POISON = 0xdeadbeef;
+
+	// SysY runtime library, see libsysy; returns whether a0 holds a result
+	bool Runtime(const std::string &name) {
+		uint32_t &a0 = reg[10];
+		uint32_t a1 = reg[11];
+		if(name == "getint") {
+			int v = 0;
+			if(std::scanf("%d", &v) != 1) v = 0;
+			a0 = uint32_t(v);
+		}
+		else if(name == "getch") {
+			a0 = uint32_t(std::getchar());
+		}
+		else if(name == "getarray") {
+			int n = 0;
+			if(std::scanf("%d", &n) != 1) n = 0;
+			for(int k = 0; k < n; ++ k) {
+				int v = 0;
+				if(std::scanf("%d", &v) != 1) v = 0;
+				Store(a0 + 4u * k, 4, uint32_t(v));
+			}
+			a0 = uint32_t(n);
+		}
+		else if(name == "putint") std::printf("%d", int(a0));
+		else if(name == "putch") std::putchar(int(a0));
+		else if(name == "putarray") {
+			std::printf("%d:", int(a0));
+			for(int k = 0; k < int(a0); ++ k) std::printf(" %d", int(Load(a1 + 4u * k, 4, false)));
+			std::putchar('\n');
+		}
+		else if(name == "starttime" || name == "_sysy_starttime") timerStart = cycles;
+		else if(name == "stoptime" || name == "_sysy_stoptime")
+			std::fprintf(stderr, "Timer: %llu cycles\n", (unsigned long long)(cycles - timerStart));
+		else Fatal(0, "call to undefined function '" + name + "'");
+		return name == "getint" || name == "getch" || name == "getarray";
+	}
+	uint64_t timerStart = 0;
+};
+
+}
+
+int main(int argc, char *argv[]) {
+	bool quiet = false;
+	const char *input = nullptr;
+	for(int i = 1; i < argc; ++ i) {
+		if(!std::strcmp(argv[i], "-q")) quiet = true;
+		else input = argv[i];
+	}
+	if(input == nullptr) {
+		std::fprintf(stderr,
+			"  rvsim - RV32IM simulator for SysY programs\n"
+			"\n"
+			"  Usage: %s [-q] <Assembly File Path>\n", argv[0]);
+		return 1;
+	}
+	std::ifstream fin(input);
+	if(!fin) {
+		std::fprintf(stderr, "Could not open assembly file: %s\n", input);
+		return 1;
+	}
+
+	Assembler as;
+	as.Assemble(fin);
+	as.Link({"getint", "getch", "getarray", "putint", "putch", "putarray",
+				   "starttime", "stoptime", "_sysy_starttime", "_sysy_stoptime"});
+
+	Machine machine(as);
+	auto begin = std::chrono::steady_clock::now();
+	int ret = machine.Run("main");
+	auto end = std::chrono::steady_clock::now();
+	std::fflush(stdout);
+
+	if(!quiet) {
+		auto &m = machine;
+		std::fprintf(stderr, "\n---- rvsim ----\n");
+		std::fprintf(stderr, "exit code        %d\n", ret & 0xff);
+		std::fprintf(stderr, "instructions     %llu\n", (unsigned long long)m.instCount);
+		for(int c = 0; c < OC_COUNT; ++ c)
+			std::fprintf(stderr, "  %-14s %llu\n", OP_CLASS_NAME[c], (unsigned long long)m.classCount[c]);
+		std::fprintf(stderr, "branches taken   %llu\n", (unsigned long long)m.branchTaken);
+		std::fprintf(stderr, "load-use hazards %llu\n", (unsigned long long)m.loadUseStalls);
+		std::fprintf(stderr, "d-cache          %llu accesses, %llu misses\n",
+			(unsigned long long)m.cacheAccess, (unsigned long long)m.cacheMiss);
+		std::fprintf(stderr, "cycles (model)   %llu\n", (unsigned long long)m.cycles);
+		std::fprintf(stderr, "host time        %.3f ms\n",
+			std::chrono::duration<double, std::milli>(end - begin).count());
+	}
+	return ret & 0xff;
+}
@@ -0,0 +1,274 @@
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+	List scheduling of the emitted assembly of a function, for in-order
+	cores. Each stretch of straight-line code between labels, branches,
+	calls and directives is reordered so that a value is ready when it is
+	used: loads, multiplications and divisions are hoisted away from their
+	users by the latencies of the core tuned for.
+
+	Dependences are those of registers (read after write, write after read
+	and write after write) and of memory. A store is kept in order with
+	every load and store it may alias. Two word accesses don't alias if
+	they are off the same value of a register at different offsets, or off
+	different globals, or one off sp and the other off a global. The
+	comments in front of an instruction move with it.
+*/
+
+namespace {
+
+struct CoreModel {
+	const char *name;
+	int load, mul, div;		// result latencies in cycles; everything else takes one
+	int branch;				// cycles lost to a taken (or mispredicted) branch or jump
+};
+
+/*
+	The core rvsim models first, as the default. Rocket's numbers are
+	those of its scheduling model in LLVM (RISCVSchedRocket.td), for
+	RV32: loads take 3 cycles, multiplications 4 and divisions up to 33,
+	and a mispredicted branch costs 3.
+*/
+constexpr CoreModel CORES[] = {
+	{"rvsim", 2, 3, 20, 2},
+	{"rocket-rv32", 3, 4, 33, 3},
+};
+
+const CoreModel *core = &CORES[0];
+
+constexpr std::size_t WINDOW = 256;		// longer stretches are scheduled in pieces
+
+int RegId(std::string_view name) {
+	static const std::map<std::string_view, int> ABI = {
+		{"zero", 0}, {"ra", 1}, {"sp", 2}, {"gp", 3}, {"tp", 4},
+		{"t0", 5}, {"t1", 6}, {"t2", 7}, {"s0", 8}, {"fp", 8}, {"s1", 9},
+		{"a0", 10}, {"a1", 11}, {"a2", 12}, {"a3", 13}, {"a4", 14}, {"a5", 15}, {"a6", 16}, {"a7", 17},
+		{"s2", 18}, {"s3", 19}, {"s4", 20}, {"s5", 21}, {"s6", 22}, {"s7", 23}, {"s8", 24}, {"s9", 25},
+		{"s10", 26}, {"s11", 27}, {"t3", 28}, {"t4", 29}, {"t5", 30}, {"t6", 31}
+	};
+	auto it = ABI.find(name);
+	return it == ABI.end() ? -1 : it->second;
+}
+
+enum MemKind { MEM_NONE, MEM_LOAD, MEM_STORE };
+
+struct Inst {
+	std::string text;			// with the comments and blank lines in front of it
+	int def = -1;
+	std::vector<int> uses;
+	MemKind mem = MEM_NONE;
+	int base = -1;				// the address: a register (and its version) and an offset,
+	std::size_t version = 0;	// or a global and an offset
+	std::string global;
+	long offset = 0;
+	int latency = 1;
+};
+
+/*
+	Decodes an instruction line, returning false for what is not moved:
+	control flow, calls, directives, and whatever this doesn't know.
+*/
+bool Decode(std::string_view line, Inst &inst) {
+	auto start = line.find_first_not_of(" \t");
+	if(start == std::string_view::npos) return false;
+	line.remove_prefix(start);
+	auto space = line.find(' ');
+	auto op = line.substr(0, space);
+	std::vector<std::string_view> args;
+	if(space != std::string_view::npos) {
+		auto rest = line.substr(space + 1);
+		while(!rest.empty()) {
+			auto comma = rest.find(", ");
+			args.emplace_back(rest.substr(0, comma));
+			if(comma == std::string_view::npos) break;
+			rest.remove_prefix(comma + 2);
+		}
+	}
+	auto reg = [&](std::size_t i) {
+		return i < args.size() ? RegId(args[i]) : -1;
+	};
+	static const std::map<std::string_view, int> RRR = {
+		{"add", 1}, {"sub", 1}, {"slt", 1}, {"sgt", 1}, {"sltu", 1}, {"xor", 1}, {"or", 1}, {"and", 1},
+		{"sll", 1}, {"srl", 1}, {"sra", 1}, {"czero.eqz", 1}, {"czero.nez", 1},
+		{"mul", 2}, {"mulh", 2}, {"mulhu", 2}, {"mulhsu", 2},
+		{"div", 3}, {"divu", 3}, {"rem", 3}, {"remu", 3},
+	};
+	static const std::map<std::string_view, int> RRI = {
+		{"addi", 2}, {"xori", 2}, {"ori", 2}, {"andi", 2}, {"slti", 2}, {"sltiu", 2},
+		{"slli", 2}, {"srli", 2}, {"srai", 2}, {"mv", 1}, {"seqz", 1}, {"snez", 1}, {"neg", 1}, {"not", 1},
+	};
+	if(auto it = RRR.find(op); it != RRR.end() && args.size() == 3) {
+		inst.def = reg(0);
+		inst.uses = {reg(1), reg(2)};
+		inst.latency = it->second == 2 ? core->mul : it->second == 3 ? core->div : 1;
+	}
+	else if(auto it = RRI.find(op); it != RRI.end() && args.size() == std::size_t(it->second) + 1) {
+		inst.def = reg(0);
+		inst.uses = {reg(1)};
+	}
+	else if((op == "li" || op == "lui" || op == "la") && args.size() == 2) inst.def = reg(0);
+	else if((op == "lw" || op == "sw") && args.size() == 2) {
+		auto addr = args[1];
+		auto open = addr.rfind('(');
+		if(open == std::string_view::npos || addr.back() != ')') return false;
+		inst.base = RegId(addr.substr(open + 1, addr.size() - open - 2));
+		auto disp = addr.substr(0, open);
+		if(disp.substr(0, 4) == "%lo(" && disp.back() == ')') {
+			auto sym = disp.substr(4, disp.size() - 5);
+			auto plus = sym.find('+');
+			inst.global = std::string(sym.substr(0, plus));
+			if(plus != std::string_view::npos) inst.offset = std::atol(std::string(sym.substr(plus + 1)).c_str());
+		}
+		else inst.offset = std::atol(std::string(disp).c_str());
+		if(op == "lw") {
+			inst.mem = MEM_LOAD;
+			inst.def = reg(0);
+			inst.uses = {inst.base};
+			inst.latency = core->load;
+		}
+		else {
+			inst.mem = MEM_STORE;
+			inst.uses = {reg(0), inst.base};
+		}
+	}
+	else return false;
+	if(inst.def == -1 && inst.mem != MEM_STORE) return false;
+	return std::none_of(inst.uses.begin(), inst.uses.end(), [](int r) { return r < 0; });
+}
+
+bool MayAlias(const Inst &x, const Inst &y) {
+	constexpr int SP = 2;
+	bool xGlobal = !x.global.empty(), yGlobal = !y.global.empty();
+	if(xGlobal && yGlobal) return x.global == y.global && x.offset == y.offset;
+	if(xGlobal || yGlobal) return (xGlobal ? y.base : x.base) != SP;
+	if(x.base == y.base && x.version == y.version) return x.offset == y.offset;
+	return true;
+}
+
+// Reorders a stretch of movable instructions, in place
+void Schedule(std::vector<Inst> &code) {
+	std::size_t n = code.size();
+	std::vector<std::vector<std::pair<std::size_t, int> > > succ(n);	// (successor, delay)
+	std::vector<std::size_t> preds(n, 0);
+	auto edge = [&](std::size_t from, std::size_t to, int delay) {
+		succ[from].emplace_back(to, delay);
+		++ preds[to];
+	};
+	std::vector<long> lastDef(32, -1);
+	std::vector<std::vector<std::size_t> > readers(32);
+	std::vector<std::size_t> version(32, 0);
+	for(std::size_t i = 0; i < n; ++ i) {
+		auto &inst = code[i];
+		for(int r: inst.uses) {
+			if(r == 0) continue;
+			if(lastDef[r] >= 0) edge(lastDef[r], i, code[lastDef[r]].latency);
+			readers[r].emplace_back(i);
+		}
+		if(inst.base >= 0) inst.version = version[inst.base];
+		if(inst.mem != MEM_NONE)
+			for(std::size_t j = 0; j < i; ++ j)
+				if(code[j].mem != MEM_NONE && (code[j].mem == MEM_STORE || inst.mem == MEM_STORE) && MayAlias(code[j], inst))
+					edge(j, i, 1);
+		if(inst.def > 0) {
+			int r = inst.def;
+			for(auto j: readers[r]) if(j != i) edge(j, i, 0);
+			if(lastDef[r] >= 0) edge(lastDef[r], i, 1);
+			readers[r].clear();
+			lastDef[r] = i;
+			++ version[r];
+		}
+	}
+	// priority: the longest chain of latencies from an instruction to the end
+	std::vector<long> height(n, 0);
+	for(std::size_t i = n; i -- > 0; ) {
+		height[i] = code[i].latency;
+		for(auto [s, delay]: succ[i]) height[i] = std::max(height[i], long(delay) + height[s]);
+	}
+	std::vector<long> earliest(n, 0);
+	std::vector<std::size_t> ready, order;
+	for(std::size_t i = 0; i < n; ++ i) if(preds[i] == 0) ready.emplace_back(i);
+	long cycle = 0;
+	while(!ready.empty()) {
+		auto best = ready.begin();
+		for(auto it = ready.begin(); it != ready.end(); ++ it) {
+			long at = std::max(earliest[*it], cycle), bestAt = std::max(earliest[*best], cycle);
+			if(at < bestAt || (at == bestAt && (height[*it] > height[*best] || (height[*it] == height[*best] && *it < *best))))
+				best = it;
+		}
+		auto i = *best;
+		ready.erase(best);
+		cycle = std::max(cycle, earliest[i]);
+		order.emplace_back(i);
+		for(auto [s, delay]: succ[i]) {
+			earliest[s] = std::max(earliest[s], cycle + delay);
+			if(-- preds[s] == 0) ready.emplace_back(s);
+		}
+		++ cycle;
+	}
+	std::vector<Inst> scheduled;
+	scheduled.reserve(n);
+	for(auto i: order) scheduled.emplace_back(std::move(code[i]));
+	code = std::move(scheduled);
+}
+
+}
+
+// Tunes for the named core, or turns scheduling off for "none"; false if unknown
+bool SelectCore(const std::string &name) {
+	if(name == "none") {
+		core = nullptr;
+		return true;
+	}
+	for(auto &model: CORES)
+		if(name == model.name) {
+			core = &model;
+			return true;
+		}
+	return false;
+}
+
+// What the blocks are laid out for: the cost of a taken branch, rvsim's when not tuning
+int BranchPenalty() {
+	return (core == nullptr ? &CORES[0] : core)->branch;
+}
+
+std::string ScheduleASM(const std::string &text) {
+	if(core == nullptr) return text;
+	std::string out, pending;		// pending: comments and blank lines before the next instruction
+	std::vector<Inst> code;
+	auto flush = [&]() {
+		for(std::size_t from = 0; from < code.size(); from += WINDOW) {
+			std::vector<Inst> piece(std::make_move_iterator(code.begin() + from),
+									std::make_move_iterator(code.begin() + std::min(code.size(), from + WINDOW)));
+			Schedule(piece);
+			for(auto &inst: piece) out += inst.text;
+		}
+		code.clear();
+	};
+	std::istringstream in(text);
+	for(std::string line; std::getline(in, line); ) {
+		auto first = line.find_first_not_of(" \t");
+		if(first == std::string::npos || line[first] == '#') {
+			pending += line + '\n';
+			continue;
+		}
+		Inst inst;
+		if(line.back() != ':' && Decode(line, inst)) {
+			inst.text = pending + line + '\n';
+			pending.clear();
+			code.emplace_back(std::move(inst));
+			continue;
+		}
+		flush();
+		out += pending + line + '\n';
+		pending.clear();
+	}
+	flush();
+	return out + pending;
+}
@@ -4,6 +4,8 @@
 	#include <memory>
 	#include <string>
 	#include "ast.hpp"
+
+	const std::string *InternIdent(const char *str, std::size_t len);	// in ast.cpp
 }
 // This will be written to the header
 
@@ -24,9 +26,10 @@ void yyerror(ASTree &ast, const char *s);
 %parse-param { ASTree &ast }
 
 %union {
-	std::string *str_val;
+	const std::string *str_val;	// an identifier, interned: see InternIdent
 	int int_val;
 	BaseAST *ast_val;
+	std::vector<PtrAST> *vec_val;
 }
 
 // lexer 返回的所有 token 种类的声明
@@ -41,6 +44,7 @@ void yyerror(ASTree &ast, const char *s);
 %type <ast_val> BType InitVal VarDef VarDefs
 %type <ast_val> ConstInitVal ConstDef ConstDefs
 %type <ast_val> LVal 
+%type <vec_val> ArrayDims InitVals ConstInitVals
 %type <int_val> Number
 
 %%
@@ -64,19 +68,17 @@ CompUnit
 
 FuncDef
 	: BType IDENT '(' FuncFParams ')' ';' {
-		auto tmp = dynamic_cast<FuncDef*>($4);
+		auto tmp = As<FuncDef>($4);
 		tmp -> func_type = PtrAST($1);
 		tmp -> ident = *$2;
 		tmp -> block = nullptr;
-		delete $2;
 		$$ = std::move(tmp);
 	}
 	| BType IDENT '(' FuncFParams ')' Block {
-		auto tmp = dynamic_cast<FuncDef*>($4);
+		auto tmp = As<FuncDef>($4);
 		tmp -> func_type = PtrAST($1);
 		tmp -> ident = *$2;
 		tmp -> block = PtrAST($6);
-		delete $2;
 		$$ = std::move(tmp);
 	}
 	;
@@ -107,7 +109,7 @@ FuncFParams
 		$$ = std::move(tmp);
 	}
 	| FuncFParams ',' FuncFParam {
-		auto tmp = dynamic_cast<FuncDef*>($1);
+		auto tmp = As<FuncDef>($1);
 		tmp->params.emplace_back(PtrAST($3));
 		$$ = std::move(tmp);
 	}
@@ -118,18 +120,35 @@ FuncFParam
 		auto tmp = new FuncParam;
 		tmp->type = PtrAST($1);
 		tmp->name = *$2;
-		delete $2;
+		tmp->isArray = false;
+		$$ = std::move(tmp);
+	}
+	| BType IDENT '[' ']' ArrayDims {
+		auto tmp = new FuncParam;
+		tmp->type = PtrAST($1);
+		tmp->name = *$2;
+		tmp->isArray = true;
+		tmp->dims = std::move(*$5);
+		delete $5;
 		$$ = std::move(tmp);
 	}
 	;
 
+ArrayDims
+	: { $$ = new std::vector<PtrAST>(); }
+	| ArrayDims '[' ConstExp ']' {
+		$1->emplace_back(PtrAST($3));
+		$$ = $1;
+	}
+	;
+
 Block
 	: '{' Stmts '}' {
-		Block *raw = dynamic_cast<Block*>($2),
+		Block *raw = As<Block>($2),
 			  *tmp = new Block;
 		StmtIf* stmtLastIf = nullptr;
 		for(std::size_t i = 0; i < raw->stmt.size(); ++ i) {
-			auto stmtThis = dynamic_cast<Stmt*>(raw->stmt[i].release());
+			auto stmtThis = As<Stmt>(raw->stmt[i].release());
 			if(stmtThis->tag == AST_ST_ELSE) {
 				assert(stmtLastIf != nullptr);
 				bool success = stmtLastIf->tryMatch(stmtThis);
@@ -138,7 +157,7 @@ Block
 			}
 			else{
 				tmp->stmt.emplace_back(PtrAST(stmtThis));
-				if(stmtThis -> tag == AST_ST_IF) stmtLastIf = dynamic_cast<StmtIf*>(stmtThis->detail.get());
+				if(stmtThis -> tag == AST_ST_IF) stmtLastIf = As<StmtIf>(stmtThis->detail.get());
 				else stmtLastIf = nullptr;
 			}
 		}
@@ -154,7 +173,7 @@ Stmts
 		$$ = std::move(tmp);
 	}
 	| Stmts Stmt {
-		Block *tmp = dynamic_cast<Block*>($1);
+		Block *tmp = As<Block>($1);
 		tmp->stmt.emplace_back(PtrAST($2));
 		$$ = std::move(tmp);
 	}
@@ -162,8 +181,8 @@ Stmts
 
 ConstDecl
 	: CONST BType ConstDefs ';' {
-		auto shared = SharedAST($2);
-		for(auto it = dynamic_cast<StmtConstDef*>($3); it != nullptr; it = dynamic_cast<StmtConstDef*>(it->next.get()) ) {
+		auto shared = SharedAST($2, ASTDeleter());
+		for(auto it = As<StmtConstDef>($3); it != nullptr; it = As<StmtConstDef>(it->next.get()) ) {
 			it->type = shared;
 		}
 		auto tmp = new Stmt;
@@ -175,8 +194,8 @@ ConstDecl
 
 VarDecl
 	: BType VarDefs ';' {
-		auto shared = SharedAST($1);
-		for(auto it = dynamic_cast<StmtVarDef*>($2); it != nullptr; it = dynamic_cast<StmtVarDef*>(it->next.get()) ) {
+		auto shared = SharedAST($1, ASTDeleter());
+		for(auto it = As<StmtVarDef>($2); it != nullptr; it = As<StmtVarDef>(it->next.get()) ) {
 			it->type = shared;
 		}
 		auto tmp = new Stmt;
@@ -275,7 +294,11 @@ LVal
 	: IDENT { 
 		auto tmp = new LVal;
 		tmp -> ident = *($1);
-		delete $1;
+		$$ = std::move(tmp);
+	}
+	| LVal '[' Exp ']' {
+		auto tmp = As<LVal>($1);
+		tmp -> index.emplace_back(PtrAST($3));
 		$$ = std::move(tmp);
 	}
 	;
@@ -285,26 +308,45 @@ ConstDefs
 		$$ = std::move($1);
 	}
 	| ConstDef ',' ConstDefs {
-		auto tmp = dynamic_cast<StmtConstDef*>($1);
+		auto tmp = As<StmtConstDef>($1);
 		tmp -> next = PtrAST($3);
 		$$ = std::move(tmp);
 	}
 	;
 
 ConstDef
-	: IDENT '=' ConstInitVal {
+	: IDENT ArrayDims '=' ConstInitVal {
 		auto tmp = new StmtConstDef;
 		tmp->name = *$1;
 		tmp->type = nullptr;
-		tmp->expr = PtrAST($3);
+		tmp->dims = std::move(*$2);
+		tmp->expr = PtrAST($4);
 		tmp->next = nullptr;
-		delete $1;
+		delete $2;
 		$$ = std::move(tmp);
 	}
 	;
 
 ConstInitVal
 	: ConstExp { $$ = std::move($1); }
+	| '{' '}' { $$ = new InitList; }
+	| '{' ConstInitVals '}' {
+		auto tmp = new InitList;
+		tmp->items = std::move(*$2);
+		delete $2;
+		$$ = std::move(tmp);
+	}
+	;
+
+ConstInitVals
+	: ConstInitVal {
+		$$ = new std::vector<PtrAST>();
+		$$->emplace_back(PtrAST($1));
+	}
+	| ConstInitVals ',' ConstInitVal {
+		$1->emplace_back(PtrAST($3));
+		$$ = $1;
+	}
 	;
 
 ConstExp
@@ -316,35 +358,55 @@ VarDefs
 		$$ = std::move($1);
 	}
 	| VarDef ',' VarDefs {
-		auto tmp = dynamic_cast<StmtVarDef*>($1);
+		auto tmp = As<StmtVarDef>($1);
 		tmp -> next = PtrAST($3);
 		$$ = std::move(tmp);
 	}
 	;
 
 VarDef
-	: IDENT {
+	: IDENT ArrayDims {
 		auto tmp = new StmtVarDef;
 		tmp->name = *$1;
 		tmp->type = nullptr;
+		tmp->dims = std::move(*$2);
 		tmp->expr = nullptr;
 		tmp->next = nullptr;
-		delete $1;
+		delete $2;
 		$$ = std::move(tmp);
 	}
-	| IDENT '=' InitVal {
+	| IDENT ArrayDims '=' InitVal {
 		auto tmp = new StmtVarDef;
 		tmp->name = *$1;
 		tmp->type = nullptr;
-		tmp->expr = PtrAST($3);
+		tmp->dims = std::move(*$2);
+		tmp->expr = PtrAST($4);
 		tmp->next = nullptr;
-		delete $1;
+		delete $2;
 		$$ = std::move(tmp);
 	}
 	;
 
 InitVal
 	: Exp { $$ = std::move($1); }
+	| '{' '}' { $$ = new InitList; }
+	| '{' InitVals '}' {
+		auto tmp = new InitList;
+		tmp->items = std::move(*$2);
+		delete $2;
+		$$ = std::move(tmp);
+	}
+	;
+
+InitVals
+	: InitVal {
+		$$ = new std::vector<PtrAST>();
+		$$->emplace_back(PtrAST($1));
+	}
+	| InitVals ',' InitVal {
+		$1->emplace_back(PtrAST($3));
+		$$ = $1;
+	}
 	;
 
 Exp
@@ -369,9 +431,8 @@ UnaryExp
 	| '-' UnaryExp { $$ = new Expr(OP_NEG, std::move($2), nullptr); }
 	| '!' UnaryExp { $$ = new Expr(OP_LNOT, std::move($2), nullptr); }
 	| IDENT '(' FuncRParams ')' {
-		auto tmp = dynamic_cast<FunCall*>($3);
+		auto tmp = As<FunCall>($3);
 		tmp -> func = *$1;
-		delete $1;
 		$$ = std::move(tmp);
 	}
 	;
@@ -389,7 +450,7 @@ FuncRParams
 		$$ = std::move(tmp);
 	}
 	| FuncRParams ',' Exp {
-		auto tmp = dynamic_cast<FunCall*>($1);
+		auto tmp = As<FunCall>($1);
 		tmp->params.emplace_back(PtrAST($3));
 		$$ = std::move(tmp);
 	}
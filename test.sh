@@ -1,4 +1,116 @@
 #!/bin/sh
 
-./build/compiler -koopa test/1.sysy -o 1.koopa
-./build/compiler -riscv test/1.sysy -o 1.S
+BUILD_DIR=${BUILD_DIR:-build}		# e.g. of a LEXER=hand or PARSER=hand build
+COMPILER=$BUILD_DIR/compiler
+RVSIM=$BUILD_DIR/rvsim
+
+$COMPILER -koopa test/1.sysy -o 1.koopa
+$COMPILER -riscv test/1.sysy -o 1.S
+
+# Each test/<name>.sy reads test/<name>.in, if there is one, and must print
+# test/<name>.out: its output, then its exit code on a line of its own. It is
+# run by -run and, compiled with each set of options below, by rvsim
+# (make rvsim), and compiled with a profile of its own run. It is also
+# compiled from the Koopa IR it is lowered to and run from its binary MIR.
+# Compiling it on one thread (-j 1) or several, or with a cache, twice, must
+# give the same assembly as a plain compilation, and so must compiling it
+# with a comment added, which reuses its functions from the cache.
+OPTIONS="
+-mrvv
+-mzicond
+-memo
+-mtune none
+-mtune rocket-rv32
+-mrvv -mzicond -memo"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failed=0
+
+# expect <test> <how>: compares $WORK/stdout and the exit code $code with the .out
+expect() {
+	{
+		cat "$WORK/stdout"
+		[ -n "$(tail -c 1 "$WORK/stdout")" ] && echo
+		echo $code
+	} > "$WORK/got"
+	if ! cmp -s "$WORK/got" "$1.out"; then
+		echo "FAIL $1.sy ($2)"
+		diff "$WORK/got" "$1.out" | head -5
+		failed=1
+	fi
+}
+
+# sim <test> <how>: runs $WORK/t.S on rvsim and checks it
+sim() {
+	$RVSIM -q "$WORK/t.S" < $in > "$WORK/stdout"
+	code=$?
+	expect $1 "$2"
+}
+
+# same <test> <how>: compares $WORK/t.S with the assembly in $WORK/plain.S
+same() {
+	if ! cmp -s "$WORK/t.S" "$WORK/plain.S"; then
+		echo "FAIL $1.sy ($2)"
+		failed=1
+	fi
+}
+
+for sy in test/*.sy; do
+	t=${sy%.sy}
+	in=/dev/null
+	[ -f $t.in ] && in=$t.in
+	$COMPILER -run $sy -o - < $in > "$WORK/stdout" 2>/dev/null
+	code=$?
+	expect $t "-run"
+	while read -r options; do
+		if ! $COMPILER -riscv $sy -o "$WORK/t.S" $options < /dev/null 2>/dev/null; then
+			echo "FAIL $sy (doesn't compile with '$options')"
+			failed=1
+			continue
+		fi
+		sim $t "rvsim, '$options'"
+	done <<END
+$OPTIONS
+END
+	$COMPILER -run $sy -o /dev/null -fprofile-generate "$WORK/t.prof" < $in 2>/dev/null
+	if $COMPILER -riscv $sy -o "$WORK/t.S" -fprofile-use "$WORK/t.prof" 2>/dev/null; then
+		sim $t "rvsim, -fprofile-use"
+	else
+		echo "FAIL $sy (doesn't compile with its profile)"
+		failed=1
+	fi
+	if $COMPILER -koopa $sy -o "$WORK/t.koopa" 2>/dev/null &&
+	   $COMPILER -riscv "$WORK/t.koopa" -o "$WORK/t.S" 2>/dev/null; then
+		sim $t "rvsim, from Koopa IR"
+	else
+		echo "FAIL $sy (doesn't compile from Koopa IR)"
+		failed=1
+	fi
+	$COMPILER -mir $sy -o "$WORK/t.mir" 2>/dev/null
+	$COMPILER -run "$WORK/t.mir" -o - < $in > "$WORK/stdout" 2>/dev/null
+	code=$?
+	expect $t "-run, from binary MIR"
+	$COMPILER -riscv $sy -o "$WORK/plain.S" 2>/dev/null
+	for threads in 1 4; do
+		$COMPILER -riscv $sy -o "$WORK/t.S" -j $threads 2>/dev/null
+		same $t "-j $threads"
+	done
+	{ cat $sy; echo "// changed"; } > "$WORK/changed.sy"
+	for round in first second changed; do
+		src=$sy
+		[ $round = changed ] && src="$WORK/changed.sy"
+		$COMPILER -riscv $src -o "$WORK/t.S" -cache "$WORK/cache" 2>/dev/null
+		same $t "-cache, $round"
+	done
+done
+
+# options that must be rejected
+for options in "-mtune unknown-core"; do
+	if $COMPILER -riscv test/1.sysy -o "$WORK/t.S" $options 2>/dev/null; then
+		echo "FAIL '$options' is accepted"
+		failed=1
+	fi
+done
+
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed